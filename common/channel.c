@@ -0,0 +1,276 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "channel.h"
+#include "dbus-error.h"
+
+#include <gio/gio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/*
+ * Maps errno of a failed socket call, a full socket buffer is reported as
+ * MSGPORT_ERROR_WOULD_BLOCK and a packet beyond the socket limits as
+ * MSGPORT_ERROR_INVALID_PARAMS.
+ */
+static void
+_channel_set_error (GError **error, int err, const gchar *what)
+{
+    MsgPortError code = MSGPORT_ERROR_IO_ERROR;
+
+    if (err == EAGAIN || err == EWOULDBLOCK) code = MSGPORT_ERROR_WOULD_BLOCK;
+    else if (err == EMSGSIZE) code = MSGPORT_ERROR_INVALID_PARAMS;
+
+    if (error) *error = msgport_error_new (code, "channel %s failed : %s", what, g_strerror (err));
+}
+
+/*
+ * Creates the socket pair, the daemon end is non-blocking so that a slow
+ * client never stalls a worker, the client end blocks the sender instead.
+ */
+gboolean
+msgport_channel_new_pair (gint *daemon_fd, gint *client_fd, GError **error)
+{
+    int fds[2];
+
+    g_return_val_if_fail (daemon_fd && client_fd, FALSE);
+
+    if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        _channel_set_error (error, errno, "socketpair");
+        return FALSE;
+    }
+
+    if (fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK) < 0) {
+        _channel_set_error (error, errno, "fcntl");
+        close (fds[0]);
+        close (fds[1]);
+        return FALSE;
+    }
+
+    *daemon_fd = fds[0];
+    *client_fd = fds[1];
+
+    return TRUE;
+}
+
+/*
+ * Writes the payload to a new memfd and seals it, so that it can be
+ * passed as is to the receiver. Returns the fd, or -1 on error.
+ */
+gint
+msgport_channel_payload_to_memfd (gconstpointer payload, gsize payload_size, GError **error)
+{
+#ifdef HAVE_MEMFD_CREATE
+    gsize written = 0;
+    gint fd = -1;
+
+    fd = memfd_create ("msgport-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        _channel_set_error (error, errno, "memfd_create");
+        return -1;
+    }
+
+    while (written < payload_size) {
+        gssize len = write (fd, (const gchar *)payload + written, payload_size - written);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            _channel_set_error (error, errno, "write");
+            close (fd);
+            return -1;
+        }
+        written += len;
+    }
+
+    if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        _channel_set_error (error, errno, "seal");
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+#else
+    if (error) *error = msgport_error_new (MSGPORT_ERROR_IO_ERROR, "large payloads not supported");
+    return -1;
+#endif
+}
+
+/*
+ * Sends one message in a single packet, payload_fd if not -1 is passed
+ * along and is not taken over.
+ */
+gboolean
+msgport_channel_send (
+    gint fd,
+    guint32 service_id,
+    guint32 sender_id,
+    guint16 flags,
+    const gchar *app_id,
+    const gchar *port,
+    gconstpointer payload,
+    gsize payload_size,
+    gint payload_fd,
+    GError **error)
+{
+    MsgPortChannelHeader header;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE (sizeof (int))];
+    } control;
+    struct msghdr msg;
+    struct iovec iov[4];
+    gsize app_id_len = app_id ? strlen (app_id) + 1 : 0;
+    gsize port_len = port ? strlen (port) + 1 : 0;
+    int n_iov = 0;
+
+    if (app_id_len > G_MAXUINT16 || port_len > G_MAXUINT16 ||
+        sizeof (header) + app_id_len + port_len + payload_size > MSGPORT_CHANNEL_MAX_PACKET) {
+        _channel_set_error (error, EMSGSIZE, "send");
+        return FALSE;
+    }
+
+    memset (&header, 0, sizeof (header));
+    header.service_id = service_id;
+    header.sender_id = sender_id;
+    header.flags = flags | (payload_fd >= 0 ? MSGPORT_CHANNEL_FLAG_LARGE : 0);
+    header.app_id_len = (guint16) app_id_len;
+    header.port_len = (guint16) port_len;
+
+    iov[n_iov].iov_base = &header;
+    iov[n_iov++].iov_len = sizeof (header);
+    if (app_id_len) {
+        iov[n_iov].iov_base = (gpointer) app_id;
+        iov[n_iov++].iov_len = app_id_len;
+    }
+    if (port_len) {
+        iov[n_iov].iov_base = (gpointer) port;
+        iov[n_iov++].iov_len = port_len;
+    }
+    if (payload_size) {
+        iov[n_iov].iov_base = (gpointer) payload;
+        iov[n_iov++].iov_len = payload_size;
+    }
+
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n_iov;
+
+    if (payload_fd >= 0) {
+        struct cmsghdr *cmsg = NULL;
+
+        memset (&control, 0, sizeof (control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof (control.buf);
+        cmsg = CMSG_FIRSTHDR (&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+        memcpy (CMSG_DATA (cmsg), &payload_fd, sizeof (int));
+    }
+
+    while (sendmsg (fd, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno == EINTR) continue;
+        _channel_set_error (error, errno, "send");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Receives one message into buffer, the frame points into it and is valid
+ * until the buffer is reused. Fails with MSGPORT_ERROR_WOULD_BLOCK if there
+ * is nothing to read, and with G_IO_ERROR_CLOSED once the peer is gone.
+ */
+gboolean
+msgport_channel_receive (gint fd, guint8 *buffer, gsize buffer_size, MsgPortChannelFrame *frame, GError **error)
+{
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE (sizeof (int))];
+    } control;
+    struct cmsghdr *cmsg = NULL;
+    struct msghdr msg;
+    struct iovec iov;
+    MsgPortChannelHeader *header = NULL;
+    gssize len;
+    gsize offset = sizeof (MsgPortChannelHeader);
+
+    g_return_val_if_fail (buffer && frame, FALSE);
+
+    memset (&msg, 0, sizeof (msg));
+    iov.iov_base = buffer;
+    iov.iov_len = buffer_size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+
+    while ((len = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT)) < 0) {
+        if (errno == EINTR) continue;
+        _channel_set_error (error, errno, "receive");
+        return FALSE;
+    }
+
+    if (len == 0) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED, "channel closed by peer");
+        return FALSE;
+    }
+
+    frame->payload_fd = -1;
+    for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN (sizeof (int)))
+            memcpy (&frame->payload_fd, CMSG_DATA (cmsg), sizeof (int));
+    }
+
+    header = (MsgPortChannelHeader *) buffer;
+    if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || (gsize) len < sizeof (*header) ||
+        offset + header->app_id_len + header->port_len > (gsize) len ||
+        (header->app_id_len && buffer[offset + header->app_id_len - 1] != '\0') ||
+        (header->port_len && buffer[offset + header->app_id_len + header->port_len - 1] != '\0') ||
+        ((header->flags & MSGPORT_CHANNEL_FLAG_LARGE) != 0) != (frame->payload_fd >= 0)) {
+        if (frame->payload_fd >= 0) close (frame->payload_fd);
+        frame->payload_fd = -1;
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "malformed channel packet");
+        return FALSE;
+    }
+
+    memcpy (&frame->header, header, sizeof (*header));
+    frame->app_id = header->app_id_len ? (const gchar *) buffer + offset : "";
+    offset += header->app_id_len;
+    frame->port = header->port_len ? (const gchar *) buffer + offset : "";
+    offset += header->port_len;
+    frame->payload = (header->flags & MSGPORT_CHANNEL_FLAG_LARGE) ? NULL : buffer + offset;
+    frame->payload_size = (header->flags & MSGPORT_CHANNEL_FLAG_LARGE) ? 0 : (gsize) len - offset;
+
+    return TRUE;
+}
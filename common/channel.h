@@ -0,0 +1,98 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __MSGPORT_CHANNEL_H
+#define __MSGPORT_CHANNEL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Data channel, a SOCK_SEQPACKET socket pair handed out by the daemon with
+ * Manager.openChannel(). Each packet carries one message: a fixed header,
+ * the sender app id and port name (daemon to client only, nul terminated),
+ * and the serialized a{sv} data. Large payloads travel as sealed memfd in
+ * SCM_RIGHTS instead of inline data.
+ */
+typedef struct {
+    guint32 service_id;  /* receiving port */
+    guint32 sender_id;   /* sending local port of the client, 0 if none */
+    guint16 flags;       /* MsgPortChannelFlags */
+    guint16 app_id_len;  /* including the nul, 0 if none */
+    guint16 port_len;    /* including the nul, 0 if none */
+    guint16 reserved;
+} MsgPortChannelHeader;
+
+typedef enum {
+    MSGPORT_CHANNEL_FLAG_NONE    = 0,
+    MSGPORT_CHANNEL_FLAG_TRUSTED = 1 << 0, /* sender port is trusted */
+    MSGPORT_CHANNEL_FLAG_LARGE   = 1 << 1, /* payload is the passed fd */
+} MsgPortChannelFlags;
+
+/* packets are bounded by the socket buffer, bigger ones go as memfd */
+#define MSGPORT_CHANNEL_MAX_PACKET (128 * 1024)
+
+typedef struct {
+    MsgPortChannelHeader header;
+    const gchar         *app_id;       /* points into the receive buffer */
+    const gchar         *port;
+    gconstpointer        payload;      /* serialized a{sv}, NULL for large ones */
+    gsize                payload_size;
+    gint                 payload_fd;   /* owned by the receiver, -1 if none */
+} MsgPortChannelFrame;
+
+gboolean
+msgport_channel_new_pair (gint *daemon_fd,
+                          gint *client_fd,
+                          GError **error);
+
+gboolean
+msgport_channel_send (gint fd,
+                      guint32 service_id,
+                      guint32 sender_id,
+                      guint16 flags,
+                      const gchar *app_id,
+                      const gchar *port,
+                      gconstpointer payload,
+                      gsize payload_size,
+                      gint payload_fd,
+                      GError **error);
+
+gint
+msgport_channel_payload_to_memfd (gconstpointer payload,
+                                  gsize payload_size,
+                                  GError **error);
+
+gboolean
+msgport_channel_receive (gint fd,
+                         guint8 *buffer,
+                         gsize buffer_size,
+                         MsgPortChannelFrame *frame,
+                         GError **error);
+
+G_END_DECLS
+
+#endif /* __MSGPORT_CHANNEL_H */
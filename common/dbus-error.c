@@ -37,6 +37,7 @@ GDBusErrorEntry __msgport_errors [] = {
     {MSGPORT_ERROR_NOT_FOUND,            _PREFIX".NotFound"},
     {MSGPORT_ERROR_ALREADY_EXISTING,     _PREFIX".AlreadyExisting"},
     {MSGPORT_ERROR_CERTIFICATE_MISMATCH, _PREFIX".CertificateMismatch"},
+    {MSGPORT_ERROR_WOULD_BLOCK,          _PREFIX".WouldBlock"},
     {MSGPORT_ERROR_UNKNOWN,              _PREFIX".Unknown"}
 };
 
@@ -40,6 +40,7 @@ typedef enum _MsgPortError
     MSGPORT_ERROR_NOT_FOUND,
     MSGPORT_ERROR_ALREADY_EXISTING,
     MSGPORT_ERROR_CERTIFICATE_MISMATCH,
+    MSGPORT_ERROR_WOULD_BLOCK,
     MSGPORT_ERROR_UNKNOWN
 
 } MsgPortError;
@@ -66,6 +67,9 @@ msgport_error_quark ();
 #define msgport_error_certificate_mismatch_new() \
     msgport_error_new (MSGPORT_ERROR_CERTIFICATE_MISMATCH, "cerficates not matched")
 
+#define msgport_error_would_block_new() \
+    msgport_error_new (MSGPORT_ERROR_WOULD_BLOCK, "port queue is full")
+
 #define msgport_error_unknown_new() \
     msgport_error_new (MSGPORT_ERROR_UNKNOWN, "unknown")
 
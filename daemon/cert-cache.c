@@ -0,0 +1,732 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "cert-cache.h"
+#include "common/dbus-error.h"
+#include "common/log.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <pkgmgr-info.h>
+#ifdef HAVE_PKGMGR
+#include <package-manager.h>
+#endif
+
+G_DEFINE_TYPE (MsgPortCertCache, msgport_cert_cache, G_TYPE_OBJECT)
+
+#define MSGPORT_CERT_CACHE_GET_PRIV(obj) \
+    G_TYPE_INSTANCE_GET_PRIVATE ((obj), MSGPORT_TYPE_CERT_CACHE, MsgPortCertCachePrivate)
+
+#ifndef CERT_CACHE_DIR
+#define CERT_CACHE_DIR "/var/lib/message-port"
+#endif
+
+#define CERT_CACHE_FILE         CERT_CACHE_DIR "/cert-cache"
+#define CERT_CACHE_FILE_VERSION 2
+/* (version, [(owner_app_id, peer_app_id, owner_pkgid, peer_pkgid,
+ *             owner_fingerprint, peer_fingerprint, is_valid)]) */
+#define CERT_CACHE_FILE_TYPE    "(ua(ssssssb))"
+/* seconds to wait before writing the changes, so that bursts are written once */
+#define CERT_CACHE_SAVE_DELAY   2
+
+/* pkgmgr-info database access is not thread safe */
+G_LOCK_DEFINE_STATIC (pkgmgrinfo);
+
+struct _MsgPortCertCachePrivate {
+    GHashTable *results; /* {CertKey*:CertEntry*} */
+    GHashTable *pending; /* {CertKey*:GQueue[CertWaiter*]} lookups in progress */
+    guint       generation; /* bumped on every invalidation */
+    guint       save_timeout_id;
+    GMutex      lock; /* validations come from the clients' threads */
+    guint64     n_hits; /* validations answered from the cache */
+    guint64     n_misses; /* validations waited for a comparison */
+#ifdef HAVE_PKGMGR
+    pkgmgr_client *pkgmgr;
+#endif
+};
+
+typedef struct {
+    gchar *owner_app_id;
+    gchar *peer_app_id;
+} CertKey;
+
+typedef struct {
+    gboolean is_valid;
+    gchar   *owner_pkgid; /* packages of the applications, for invalidation */
+    gchar   *peer_pkgid;
+    gchar   *owner_fingerprint; /* package install state the result was computed for */
+    gchar   *peer_fingerprint;
+} CertEntry;
+
+typedef struct {
+    MsgPortCertCacheCallback cb;
+    gpointer                 userdata;
+} CertWaiter;
+
+/* result of the comparison done on worker thread */
+typedef struct {
+    gint     compare_result;
+    gchar   *owner_pkgid;
+    gchar   *peer_pkgid;
+    gchar   *owner_fingerprint;
+    gchar   *peer_fingerprint;
+} CertLookup;
+
+static CertKey *
+_cert_key_new (const gchar *owner_app_id, const gchar *peer_app_id)
+{
+    CertKey *key = g_slice_new (CertKey);
+
+    key->owner_app_id = g_strdup (owner_app_id);
+    key->peer_app_id = g_strdup (peer_app_id);
+
+    return key;
+}
+
+static void
+_cert_key_free (gpointer data)
+{
+    CertKey *key = (CertKey *)data;
+
+    g_free (key->owner_app_id);
+    g_free (key->peer_app_id);
+    g_slice_free (CertKey, key);
+}
+
+static guint
+_cert_key_hash (gconstpointer data)
+{
+    const CertKey *key = (const CertKey *)data;
+
+    return g_str_hash (key->owner_app_id) * 31 + g_str_hash (key->peer_app_id);
+}
+
+static gboolean
+_cert_key_equal (gconstpointer a, gconstpointer b)
+{
+    const CertKey *k1 = (const CertKey *)a;
+    const CertKey *k2 = (const CertKey *)b;
+
+    return !g_strcmp0 (k1->owner_app_id, k2->owner_app_id) &&
+           !g_strcmp0 (k1->peer_app_id, k2->peer_app_id);
+}
+
+static CertEntry *
+_cert_entry_new (gboolean is_valid, const gchar *owner_pkgid, const gchar *peer_pkgid,
+                 const gchar *owner_fingerprint, const gchar *peer_fingerprint)
+{
+    CertEntry *entry = g_slice_new (CertEntry);
+
+    entry->is_valid = is_valid;
+    entry->owner_pkgid = g_strdup (owner_pkgid ? owner_pkgid : "");
+    entry->peer_pkgid = g_strdup (peer_pkgid ? peer_pkgid : "");
+    entry->owner_fingerprint = g_strdup (owner_fingerprint ? owner_fingerprint : "");
+    entry->peer_fingerprint = g_strdup (peer_fingerprint ? peer_fingerprint : "");
+
+    return entry;
+}
+
+static void
+_cert_entry_free (gpointer data)
+{
+    CertEntry *entry = (CertEntry *)data;
+
+    g_free (entry->owner_pkgid);
+    g_free (entry->peer_pkgid);
+    g_free (entry->owner_fingerprint);
+    g_free (entry->peer_fingerprint);
+    g_slice_free (CertEntry, entry);
+}
+
+/*
+ * Entries that can be revalidated after a restart, i.e. whose packages
+ * and their install state are known. Others are kept in memory only.
+ */
+static gboolean
+_cert_entry_is_persistent (const CertEntry *entry)
+{
+    return entry->owner_pkgid[0] && entry->peer_pkgid[0] &&
+           entry->owner_fingerprint[0] && entry->peer_fingerprint[0];
+}
+
+static void
+_cert_lookup_free (gpointer data)
+{
+    CertLookup *lookup = (CertLookup *)data;
+
+    g_free (lookup->owner_pkgid);
+    g_free (lookup->peer_pkgid);
+    g_free (lookup->owner_fingerprint);
+    g_free (lookup->peer_fingerprint);
+    g_slice_free (CertLookup, lookup);
+}
+
+/*
+ * Identifies the installed state of the package, it changes when the
+ * package is reinstalled or updated, possibly with another certificate.
+ * Expects the caller holds the pkgmgrinfo lock.
+ */
+static gchar *
+_get_pkg_fingerprint (const gchar *pkgid)
+{
+    pkgmgrinfo_pkginfo_h handle = NULL;
+    char *version = NULL;
+    int installed_time = 0;
+    gchar *res = NULL;
+
+    if (!pkgid || !pkgid[0]) return NULL;
+
+    if (pkgmgrinfo_pkginfo_get_pkginfo (pkgid, &handle) != PMINFO_R_OK) return NULL;
+
+    if (pkgmgrinfo_pkginfo_get_version (handle, &version) == PMINFO_R_OK &&
+        pkgmgrinfo_pkginfo_get_installed_time (handle, &installed_time) == PMINFO_R_OK)
+        res = g_strdup_printf ("%s:%d", version ? version : "", installed_time);
+
+    pkgmgrinfo_pkginfo_destroy_pkginfo (handle);
+
+    return res;
+}
+
+/*
+ * Checks the saved fingerprint against the installed package, the
+ * current ones are memoized in fingerprints {pkgid:fingerprint}.
+ */
+static gboolean
+_fingerprint_matches (GHashTable *fingerprints, const gchar *pkgid, const gchar *fingerprint)
+{
+    gchar *current = NULL;
+
+    if (!g_hash_table_lookup_extended (fingerprints, pkgid, NULL, (gpointer *)&current)) {
+        current = _get_pkg_fingerprint (pkgid);
+        g_hash_table_insert (fingerprints, g_strdup (pkgid), current);
+    }
+
+    return current && !g_strcmp0 (current, fingerprint);
+}
+
+static void
+_cert_waiters_free (gpointer data)
+{
+    GQueue *waiters = (GQueue *)data;
+    CertWaiter *waiter = NULL;
+
+    while ((waiter = g_queue_pop_head (waiters)) != NULL)
+        g_slice_free (CertWaiter, waiter);
+    g_queue_free (waiters);
+}
+
+/*
+ * Loads the results saved by previous daemon instance. Packages might
+ * have been installed, updated or removed while the daemon was not
+ * listening, so only results whose packages are still installed the
+ * same way are kept.
+ */
+static void
+_cert_cache_load (MsgPortCertCache *cache)
+{
+    GMappedFile *file = NULL;
+    GVariant *content = NULL;
+    GVariantIter *iter = NULL;
+    GHashTable *fingerprints = NULL;
+    GError *error = NULL;
+    const gchar *owner_app_id, *peer_app_id, *owner_pkgid, *peer_pkgid;
+    const gchar *owner_fingerprint, *peer_fingerprint;
+    gboolean is_valid;
+    guint version = 0, n_stale = 0;
+
+    file = g_mapped_file_new (CERT_CACHE_FILE, FALSE, &error);
+    if (!file) {
+        DBG ("No certificate cache loaded : %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    content = g_variant_new_from_data (G_VARIANT_TYPE (CERT_CACHE_FILE_TYPE),
+            g_mapped_file_get_contents (file), g_mapped_file_get_length (file),
+            FALSE, (GDestroyNotify)g_mapped_file_unref, file);
+    g_variant_ref_sink (content);
+
+    /* older files carry no fingerprints, nothing in them can be revalidated */
+    g_variant_get_child (content, 0, "u", &version);
+    if (version != CERT_CACHE_FILE_VERSION) {
+        WARN ("Ignoring certificate cache of version %u", version);
+        g_variant_unref (content);
+        return;
+    }
+
+    fingerprints = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+    g_variant_get (content, CERT_CACHE_FILE_TYPE, &version, &iter);
+
+    G_LOCK (pkgmgrinfo);
+    while (g_variant_iter_next (iter, "(&s&s&s&s&s&sb)", &owner_app_id, &peer_app_id,
+                &owner_pkgid, &peer_pkgid, &owner_fingerprint, &peer_fingerprint, &is_valid)) {
+        CertEntry *entry = NULL;
+
+        if (!owner_app_id[0] || !peer_app_id[0]) continue;
+
+        entry = _cert_entry_new (is_valid, owner_pkgid, peer_pkgid, owner_fingerprint, peer_fingerprint);
+        if (!_cert_entry_is_persistent (entry) ||
+            !_fingerprint_matches (fingerprints, owner_pkgid, owner_fingerprint) ||
+            !_fingerprint_matches (fingerprints, peer_pkgid, peer_fingerprint)) {
+            _cert_entry_free (entry);
+            n_stale++;
+            continue;
+        }
+
+        g_hash_table_insert (cache->priv->results, _cert_key_new (owner_app_id, peer_app_id), entry);
+    }
+    G_UNLOCK (pkgmgrinfo);
+
+    DBG ("Loaded %u certificate comparison results, dropped %u stale ones",
+            g_hash_table_size (cache->priv->results), n_stale);
+
+    /* stale ones are left out of the file by the next save */
+    g_hash_table_unref (fingerprints);
+    g_variant_iter_free (iter);
+    g_variant_unref (content);
+}
+
+static gboolean
+_cert_cache_save (gpointer userdata)
+{
+    MsgPortCertCache *cache = MSGPORT_CERT_CACHE (userdata);
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    CertKey *key = NULL;
+    CertEntry *entry = NULL;
+    GVariant *content = NULL;
+    GError *error = NULL;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssssssb)"));
+
+    g_mutex_lock (&cache->priv->lock);
+    cache->priv->save_timeout_id = 0;
+    g_hash_table_iter_init (&iter, cache->priv->results);
+    while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&entry)) {
+        /* could not be revalidated, nor invalidated, once loaded back */
+        if (!_cert_entry_is_persistent (entry)) continue;
+        g_variant_builder_add (&builder, "(ssssssb)", key->owner_app_id, key->peer_app_id,
+                entry->owner_pkgid, entry->peer_pkgid,
+                entry->owner_fingerprint, entry->peer_fingerprint, entry->is_valid);
+    }
+    g_mutex_unlock (&cache->priv->lock);
+
+    content = g_variant_ref_sink (g_variant_new (CERT_CACHE_FILE_TYPE, CERT_CACHE_FILE_VERSION, &builder));
+
+    if (g_mkdir_with_parents (CERT_CACHE_DIR, 0700) != 0) {
+        WARN ("Fail to create '%s' : %s", CERT_CACHE_DIR, g_strerror (errno));
+    }
+    else if (!g_file_set_contents (CERT_CACHE_FILE, g_variant_get_data (content),
+                g_variant_get_size (content), &error)) {
+        WARN ("Fail to save certificate cache : %s", error->message);
+        g_error_free (error);
+    }
+
+    g_variant_unref (content);
+
+    return FALSE;
+}
+
+/*
+ * Expects the caller holds the lock
+ */
+static void
+_cert_cache_schedule_save (MsgPortCertCache *cache)
+{
+    if (cache->priv->save_timeout_id) return;
+
+    cache->priv->save_timeout_id = g_timeout_add_seconds (CERT_CACHE_SAVE_DELAY, _cert_cache_save, cache);
+}
+
+static gboolean
+_match_package (gpointer key, gpointer value, gpointer userdata)
+{
+    CertEntry *entry = (CertEntry *)value;
+    const gchar *pkgid = (const gchar *)userdata;
+
+    return !g_strcmp0 (entry->owner_pkgid, pkgid) || !g_strcmp0 (entry->peer_pkgid, pkgid);
+}
+
+/*
+ * Drops the results involving the given package, as its certificate
+ * might have changed.
+ */
+void
+msgport_cert_cache_invalidate_package (MsgPortCertCache *cache, const gchar *pkgid)
+{
+    guint n_removed = 0;
+
+    msgport_return_if_fail (cache && MSGPORT_IS_CERT_CACHE (cache));
+    msgport_return_if_fail (pkgid);
+
+    g_mutex_lock (&cache->priv->lock);
+
+    /* results of the lookups in progress can not be trusted either */
+    cache->priv->generation++;
+
+    n_removed = g_hash_table_foreach_remove (cache->priv->results, _match_package, (gpointer)pkgid);
+    if (n_removed) _cert_cache_schedule_save (cache);
+
+    g_mutex_unlock (&cache->priv->lock);
+
+    DBG ("Package '%s' changed, dropped %u certificate results", pkgid, n_removed);
+}
+
+#ifdef HAVE_PKGMGR
+typedef struct {
+    MsgPortCertCache *cache;
+    gchar            *pkgid;
+} PackageEvent;
+
+static gboolean
+_on_package_changed_idle (gpointer userdata)
+{
+    PackageEvent *event = (PackageEvent *)userdata;
+
+    msgport_cert_cache_invalidate_package (event->cache, event->pkgid);
+
+    g_object_unref (event->cache);
+    g_free (event->pkgid);
+    g_slice_free (PackageEvent, event);
+
+    return FALSE;
+}
+
+static int
+_on_package_status (int req_id, const char *pkg_type, const char *pkgid,
+                    const char *key, const char *val, const void *pmsg, void *userdata)
+{
+    PackageEvent *event = NULL;
+
+    /* install, update and uninstall all finish with 'end' status */
+    if (!pkgid || g_strcmp0 (key, "end") || g_strcmp0 (val, "ok")) return 0;
+
+    event = g_slice_new (PackageEvent);
+    event->cache = g_object_ref (MSGPORT_CERT_CACHE (userdata));
+    event->pkgid = g_strdup (pkgid);
+    g_main_context_invoke (NULL, _on_package_changed_idle, event);
+
+    return 0;
+}
+#endif
+
+static void
+_cert_cache_dispose (GObject *self)
+{
+    MsgPortCertCache *cache = MSGPORT_CERT_CACHE (self);
+
+#ifdef HAVE_PKGMGR
+    if (cache->priv->pkgmgr) {
+        pkgmgr_client_free (cache->priv->pkgmgr);
+        cache->priv->pkgmgr = NULL;
+    }
+#endif
+
+    /* flush pending changes */
+    if (cache->priv->save_timeout_id) {
+        g_source_remove (cache->priv->save_timeout_id);
+        _cert_cache_save (cache);
+    }
+
+    if (cache->priv->results) {
+        g_hash_table_unref (cache->priv->results);
+        cache->priv->results = NULL;
+    }
+
+    if (cache->priv->pending) {
+        g_hash_table_unref (cache->priv->pending);
+        cache->priv->pending = NULL;
+    }
+
+    G_OBJECT_CLASS (msgport_cert_cache_parent_class)->dispose (self);
+}
+
+static void
+_cert_cache_finalize (GObject *self)
+{
+    MsgPortCertCache *cache = MSGPORT_CERT_CACHE (self);
+
+    g_mutex_clear (&cache->priv->lock);
+
+    G_OBJECT_CLASS (msgport_cert_cache_parent_class)->finalize (self);
+}
+
+static void
+msgport_cert_cache_class_init (MsgPortCertCacheClass *klass)
+{
+    GObjectClass *gklass = G_OBJECT_CLASS(klass);
+
+    g_type_class_add_private (klass, sizeof(MsgPortCertCachePrivate));
+
+    gklass->dispose = _cert_cache_dispose;
+    gklass->finalize = _cert_cache_finalize;
+}
+
+static void
+msgport_cert_cache_init (MsgPortCertCache *self)
+{
+    MsgPortCertCachePrivate *priv = MSGPORT_CERT_CACHE_GET_PRIV (self);
+
+    priv->results = g_hash_table_new_full (_cert_key_hash, _cert_key_equal, _cert_key_free, _cert_entry_free);
+    priv->pending = g_hash_table_new_full (_cert_key_hash, _cert_key_equal, _cert_key_free, _cert_waiters_free);
+    priv->generation = 0;
+    priv->save_timeout_id = 0;
+    g_mutex_init (&priv->lock);
+    priv->n_hits = 0;
+    priv->n_misses = 0;
+
+    self->priv = priv;
+
+    _cert_cache_load (self);
+
+#ifdef HAVE_PKGMGR
+    priv->pkgmgr = pkgmgr_client_new (PC_LISTENING);
+    if (!priv->pkgmgr || pkgmgr_client_listen_status (priv->pkgmgr, _on_package_status, self) < 0)
+        WARN ("Fail to listen package changes, cached certificates might go stale");
+#endif
+}
+
+/*
+ * Certificate cache is shared by all the connections, so that
+ * comparison results survive client reconnections.
+ */
+MsgPortCertCache *
+msgport_cert_cache_new ()
+{
+    static GObject *cache = NULL;
+
+    if (!cache) {
+        cache = g_object_new (MSGPORT_TYPE_CERT_CACHE, NULL);
+        g_object_add_weak_pointer (cache, (gpointer *)&cache);
+
+        return MSGPORT_CERT_CACHE (cache);
+    }
+
+    return MSGPORT_CERT_CACHE (g_object_ref (cache));
+}
+
+static gchar *
+_get_pkgid (const gchar *app_id)
+{
+    pkgmgrinfo_appinfo_h handle = NULL;
+    char *pkgid = NULL;
+    gchar *res = NULL;
+
+    if (pkgmgrinfo_appinfo_get_appinfo (app_id, &handle) != PMINFO_R_OK) return NULL;
+
+    if (pkgmgrinfo_appinfo_get_pkgid (handle, &pkgid) == PMINFO_R_OK)
+        res = g_strdup (pkgid);
+
+    pkgmgrinfo_appinfo_destroy_appinfo (handle);
+
+    return res;
+}
+
+/*
+ * Runs on a worker thread, so that slow package database queries
+ * do not block the daemon main loop.
+ */
+static void
+_cert_cache_compare_thread (GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    CertKey *key = (CertKey *)task_data;
+    CertLookup *lookup = NULL;
+    pkgmgrinfo_cert_compare_result_type_e compare_result;
+    int res;
+
+    lookup = g_slice_new0 (CertLookup);
+
+    G_LOCK (pkgmgrinfo);
+    res = pkgmgrinfo_pkginfo_compare_app_cert_info (key->owner_app_id, key->peer_app_id, &compare_result);
+    if (res == PMINFO_R_OK) {
+        lookup->owner_pkgid = _get_pkgid (key->owner_app_id);
+        lookup->peer_pkgid = _get_pkgid (key->peer_app_id);
+        lookup->owner_fingerprint = _get_pkg_fingerprint (lookup->owner_pkgid);
+        lookup->peer_fingerprint = _get_pkg_fingerprint (lookup->peer_pkgid);
+    }
+    G_UNLOCK (pkgmgrinfo);
+
+    if (res != PMINFO_R_OK) {
+        _cert_lookup_free (lookup);
+        g_task_return_error (task, msgport_error_new (MSGPORT_ERROR_IO_ERROR,
+                "Fail to compare certificates of applications('%s', '%s') : error %d",
+                key->owner_app_id, key->peer_app_id, res));
+        return;
+    }
+
+    lookup->compare_result = compare_result;
+    g_task_return_pointer (task, lookup, _cert_lookup_free);
+}
+
+static void
+_on_cert_compare_done (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    MsgPortCertCache *cache = MSGPORT_CERT_CACHE (source);
+    CertKey *key = (CertKey *)g_task_get_task_data (G_TASK (result));
+    CertLookup *lookup = NULL;
+    GError *error = NULL;
+    GQueue *waiters = NULL;
+    CertWaiter *waiter = NULL;
+    gpointer orig_key = NULL;
+    gboolean is_valid = FALSE;
+    guint generation = GPOINTER_TO_UINT (userdata);
+
+    lookup = (CertLookup *)g_task_propagate_pointer (G_TASK (result), &error);
+    if (!lookup) {
+        /* not cached, will be retried on next message */
+        WARN ("%s", error->message);
+        g_error_free (error);
+    }
+    else {
+        DBG ("certificate comparison result of ('%s', '%s') : %d",
+                key->owner_app_id, key->peer_app_id, lookup->compare_result);
+
+        /* owner without certificate information is treated as untrusted port */
+        is_valid = lookup->compare_result == PMINFO_CERT_COMPARE_MATCH ||
+                   lookup->compare_result == PMINFO_CERT_COMPARE_LHS_NO_CERT ||
+                   lookup->compare_result == PMINFO_CERT_COMPARE_BOTH_NO_CERT;
+
+    }
+
+    g_mutex_lock (&cache->priv->lock);
+
+    /* do not cache if a package changed while comparing */
+    if (lookup && cache->priv->results && generation == cache->priv->generation) {
+        g_hash_table_insert (cache->priv->results,
+                _cert_key_new (key->owner_app_id, key->peer_app_id),
+                _cert_entry_new (is_valid, lookup->owner_pkgid, lookup->peer_pkgid,
+                        lookup->owner_fingerprint, lookup->peer_fingerprint));
+        _cert_cache_schedule_save (cache);
+    }
+
+    /* waiters may queue new lookups, detach them first */
+    if (cache->priv->pending &&
+        g_hash_table_lookup_extended (cache->priv->pending, key, &orig_key, (gpointer *)&waiters))
+        g_hash_table_steal (cache->priv->pending, key);
+    else
+        waiters = NULL;
+
+    g_mutex_unlock (&cache->priv->lock);
+
+    if (lookup) _cert_lookup_free (lookup);
+    if (!waiters) return;
+
+    while ((waiter = g_queue_pop_head (waiters)) != NULL) {
+        waiter->cb (is_valid, waiter->userdata);
+        g_slice_free (CertWaiter, waiter);
+    }
+
+    g_queue_free (waiters);
+    _cert_key_free (orig_key);
+}
+
+/*
+ * Checks if the peer application is allowed to send messages to the trusted
+ * ports of owner application, i.e, both are signed with the same certificate.
+ * #cb is called right away if the result is cached, otherwise once the
+ * comparison is done, in the order the requests were made. Concurrent
+ * requests from other threads join the same comparison, so #cb might be
+ * called on the thread that started it.
+ */
+void
+msgport_cert_cache_validate (
+    MsgPortCertCache *cache,
+    const gchar *owner_app_id,
+    const gchar *peer_app_id,
+    MsgPortCertCacheCallback cb,
+    gpointer userdata)
+{
+    CertKey key = { (gchar *)owner_app_id, (gchar *)peer_app_id };
+    GQueue *waiters = NULL;
+    CertWaiter *waiter = NULL;
+    CertEntry *entry = NULL;
+    GTask *task = NULL;
+    guint generation = 0;
+
+    msgport_return_if_fail (cache && MSGPORT_IS_CERT_CACHE (cache));
+    msgport_return_if_fail (cb);
+
+    if (!owner_app_id || !peer_app_id) {
+        cb (FALSE, userdata);
+        return;
+    }
+
+    g_mutex_lock (&cache->priv->lock);
+
+    if ((entry = g_hash_table_lookup (cache->priv->results, &key)) != NULL) {
+        gboolean is_valid = entry->is_valid;
+
+        cache->priv->n_hits++;
+        g_mutex_unlock (&cache->priv->lock);
+        cb (is_valid, userdata);
+        return;
+    }
+
+    cache->priv->n_misses++;
+
+    waiter = g_slice_new (CertWaiter);
+    waiter->cb = cb;
+    waiter->userdata = userdata;
+
+    /* join the lookup already in progress, if any */
+    waiters = g_hash_table_lookup (cache->priv->pending, &key);
+    if (waiters) {
+        g_queue_push_tail (waiters, waiter);
+        g_mutex_unlock (&cache->priv->lock);
+        return;
+    }
+
+    waiters = g_queue_new ();
+    g_queue_push_tail (waiters, waiter);
+    g_hash_table_insert (cache->priv->pending, _cert_key_new (owner_app_id, peer_app_id), waiters);
+    generation = cache->priv->generation;
+
+    g_mutex_unlock (&cache->priv->lock);
+
+    DBG ("Comparing certificates of ('%s', '%s')", owner_app_id, peer_app_id);
+
+    /* remember the generation, to detect packages changed meanwhile */
+    task = g_task_new (cache, NULL, _on_cert_compare_done, GUINT_TO_POINTER (generation));
+    g_task_set_task_data (task, _cert_key_new (owner_app_id, peer_app_id), _cert_key_free);
+    g_task_run_in_thread (task, _cert_cache_compare_thread);
+    g_object_unref (task);
+}
+
+void
+msgport_cert_cache_get_stats (MsgPortCertCache *cache, guint64 *n_hits, guint64 *n_misses)
+{
+    msgport_return_if_fail (cache && MSGPORT_IS_CERT_CACHE (cache));
+
+    g_mutex_lock (&cache->priv->lock);
+    if (n_hits) *n_hits = cache->priv->n_hits;
+    if (n_misses) *n_misses = cache->priv->n_misses;
+    g_mutex_unlock (&cache->priv->lock);
+}
@@ -0,0 +1,87 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __MSGPORT_CERT_CACHE_H
+#define __MSGPORT_CERT_CACHE_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define MSGPORT_TYPE_CERT_CACHE (msgport_cert_cache_get_type())
+#define MSGPORT_CERT_CACHE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), MSGPORT_TYPE_CERT_CACHE, MsgPortCertCache))
+#define MSGPORT_CERT_CACHE_CLASS(obj)  (G_TYPE_CHECK_CLASS_CAST((kls), MSGPORT_TYPE_CERT_CACHE, MsgPortCertCacheClass))
+#define MSGPORT_IS_CERT_CACHE(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), MSGPORT_TYPE_CERT_CACHE))
+#define MSGPORT_IS_CERT_CACHE_CLASS(kls) (G_TYPE_CHECK_CLASS_TYPE((kls), MSGPORT_TYPE_CERT_CACHE))
+
+typedef struct _MsgPortCertCache MsgPortCertCache;
+typedef struct _MsgPortCertCacheClass MsgPortCertCacheClass;
+typedef struct _MsgPortCertCachePrivate MsgPortCertCachePrivate;
+
+struct _MsgPortCertCache
+{
+    GObject parent;
+
+    /* private */
+    MsgPortCertCachePrivate *priv;
+};
+
+struct _MsgPortCertCacheClass
+{
+    GObjectClass parenet_class;
+};
+
+/*
+ * Called with the certificate comparison result, is_valid is TRUE if
+ * the peer is allowed to send messages to the owner's trusted ports.
+ */
+typedef void (*MsgPortCertCacheCallback) (gboolean is_valid, gpointer userdata);
+
+GType msgport_cert_cache_get_type (void);
+
+MsgPortCertCache *
+msgport_cert_cache_new ();
+
+void
+msgport_cert_cache_validate (MsgPortCertCache *cache,
+                             const gchar *owner_app_id,
+                             const gchar *peer_app_id,
+                             MsgPortCertCacheCallback cb,
+                             gpointer userdata);
+
+void
+msgport_cert_cache_invalidate_package (MsgPortCertCache *cache,
+                                       const gchar *pkgid);
+
+void
+msgport_cert_cache_get_stats (MsgPortCertCache *cache,
+                              guint64 *n_hits,
+                              guint64 *n_misses);
+
+G_END_DECLS
+
+#endif /* __MSGPORT_CERT_CACHE_H */
+
@@ -24,6 +24,7 @@
  */
 
 #include "dbus-manager.h"
+#include "common/channel.h"
 #include "common/dbus-manager-glue.h"
 #include "common/dbus-service-glue.h"
 #include "common/dbus-error.h"
@@ -31,10 +32,15 @@
 #include "dbus-service.h"
 #include "dbus-server.h"
 #include "manager.h"
+#include "outbox.h"
+#include "stats.h"
 #include "utils.h"
 
+#include <string.h>
+#include <unistd.h>
 #include <aul/aul.h>
-#include <pkgmgr-info.h>
+#include <glib-unix.h>
+#include <gio/gunixfdlist.h>
 
 G_DEFINE_TYPE (MsgPortDbusManager, msgport_dbus_manager, G_TYPE_OBJECT)
 
@@ -48,18 +54,72 @@ struct _MsgPortDbusManagerPrivate {
     MsgPortDbusServer      *server;
     gchar                  *app_id;
     gboolean                is_null_cert;
-    GHashTable             *peer_certs;
+    MsgPortCertCache       *cert_cache;
+    gboolean                app_id_resolved;
+    GQueue                  parked; /* GDBusMethodInvocation* arrived before app id resolved */
+    GMainContext           *context; /* requests from this client are served on */
+    MsgPortOutbox          *outbox; /* messages delivered to this client */
+    MsgPortDbusGlueStats   *stats_skeleton;
+    MsgPortTraffic          sent; /* messages sent by this client */
+    gint                    channel_fd; /* data channel, -1 if not opened */
+    GSource                *channel_watch;
+    guint8                 *channel_buffer;
+    volatile gint           codecs; /* payload codecs the client decodes, read by other threads */
 };
 
+/* frames read from a data channel at once, so that a busy client
+ * does not starve the others served on the same worker */
+#define MSGPORT_CHANNEL_BATCH 64
+
+/* aul calls are not known to be thread safe */
+G_LOCK_DEFINE_STATIC (aul);
+
+/* pid to app id cache, shared by all the connections */
+G_LOCK_DEFINE_STATIC (app_id_cache);
+static GHashTable *__app_id_cache = NULL; /* {pid:AppIdEntry*} */
+
+/* dead processes are pruned only when cache grows beyond this */
+#define APP_ID_CACHE_PRUNE_SIZE 128
+
+typedef struct {
+    gchar   *app_id;
+    gboolean is_valid;
+    guint64  start_time; /* process start time, to detect pid reuse */
+} AppIdEntry;
+
 
 static void
 _dbus_manager_finalize (GObject *self)
 {
-    //MsgPortDbusManager *manager = MSGPORT_DBUS_MANAGER (self);
+    MsgPortDbusManager *dbus_mgr = MSGPORT_DBUS_MANAGER (self);
+
+    g_free (dbus_mgr->priv->app_id);
+
+    if (dbus_mgr->priv->context) g_main_context_unref (dbus_mgr->priv->context);
 
     G_OBJECT_CLASS (msgport_dbus_manager_parent_class)->finalize (self);
 }
 
+static void
+_dbus_manager_close_channel (MsgPortDbusManager *dbus_mgr)
+{
+    if (dbus_mgr->priv->outbox) msgport_outbox_close_channel (dbus_mgr->priv->outbox);
+
+    if (dbus_mgr->priv->channel_watch) {
+        g_source_destroy (dbus_mgr->priv->channel_watch);
+        g_source_unref (dbus_mgr->priv->channel_watch);
+        dbus_mgr->priv->channel_watch = NULL;
+    }
+
+    if (dbus_mgr->priv->channel_fd >= 0) {
+        close (dbus_mgr->priv->channel_fd);
+        dbus_mgr->priv->channel_fd = -1;
+    }
+
+    g_free (dbus_mgr->priv->channel_buffer);
+    dbus_mgr->priv->channel_buffer = NULL;
+}
+
 static void
 _dbus_manager_dispose (GObject *self)
 {
@@ -71,22 +131,67 @@ _dbus_manager_dispose (GObject *self)
                 G_DBUS_INTERFACE_SKELETON (dbus_mgr->priv->dbus_skeleton));
         g_clear_object (&dbus_mgr->priv->dbus_skeleton);
     }
+    if (dbus_mgr->priv->stats_skeleton) {
+        g_dbus_interface_skeleton_unexport (
+                G_DBUS_INTERFACE_SKELETON (dbus_mgr->priv->stats_skeleton));
+        g_clear_object (&dbus_mgr->priv->stats_skeleton);
+    }
+
+    _dbus_manager_close_channel (dbus_mgr);
+
+    /* connection gone before its app id got resolved */
+    g_queue_foreach (&dbus_mgr->priv->parked, (GFunc)g_object_unref, NULL);
+    g_queue_clear (&dbus_mgr->priv->parked);
 
     g_clear_object (&dbus_mgr->priv->connection);
 
     /* unregister all services owned by this connection */
     msgport_manager_unregister_services (dbus_mgr->priv->manager, dbus_mgr, NULL);
 
+    g_clear_object (&dbus_mgr->priv->outbox);
+
     g_clear_object (&dbus_mgr->priv->manager);
 
-    if (dbus_mgr->priv->peer_certs) {
-        g_hash_table_unref (dbus_mgr->priv->peer_certs);
-        dbus_mgr->priv->peer_certs = NULL;
-    }
+    g_clear_object (&dbus_mgr->priv->cert_cache);
 
     G_OBJECT_CLASS (msgport_dbus_manager_parent_class)->dispose (self);
 }
 
+/*
+ * Holds back the requests arrived before the client app id is known,
+ * they are replayed in order once it gets resolved.
+ */
+static gboolean
+_dbus_manager_park_invocation (MsgPortDbusManager *dbus_mgr, GDBusMethodInvocation *invocation)
+{
+    if (dbus_mgr->priv->app_id_resolved) return FALSE;
+
+    DBG ("Parking '%s' request on %p until app id is resolved",
+            g_dbus_method_invocation_get_method_name (invocation), dbus_mgr);
+    g_queue_push_tail (&dbus_mgr->priv->parked, invocation);
+
+    return TRUE;
+}
+
+static void
+_dbus_manager_replay_parked (MsgPortDbusManager *dbus_mgr)
+{
+    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (dbus_mgr->priv->dbus_skeleton);
+    GDBusInterfaceVTable *vtable = g_dbus_interface_skeleton_get_vtable (skeleton);
+    GDBusMethodInvocation *invocation = NULL;
+
+    /* dispatch them the same way the skeleton does for the new requests */
+    while ((invocation = g_queue_pop_head (&dbus_mgr->priv->parked)) != NULL) {
+        vtable->method_call (
+                g_dbus_method_invocation_get_connection (invocation),
+                g_dbus_method_invocation_get_sender (invocation),
+                g_dbus_method_invocation_get_object_path (invocation),
+                g_dbus_method_invocation_get_interface_name (invocation),
+                g_dbus_method_invocation_get_method_name (invocation),
+                g_dbus_method_invocation_get_parameters (invocation),
+                invocation, skeleton);
+    }
+}
 
 static gboolean
 _dbus_manager_handle_register_service (
@@ -94,28 +199,40 @@ _dbus_manager_handle_register_service (
     GDBusMethodInvocation *invocation,
     const gchar           *port_name,
     gboolean               is_trusted,
+    guint                  priority,
     gpointer               userdata)
 {
     GError *error = NULL;
     MsgPortDbusService *dbus_service = NULL;
+    gint64 started = g_get_monotonic_time ();
     msgport_return_val_if_fail (dbus_mgr &&  MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
 
-    DBG ("register service request from %p('%s') for port '%s', is_trusted: %d",
-        dbus_mgr, dbus_mgr->priv->app_id, port_name, is_trusted);
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
+    DBG ("register service request from %p('%s') for port '%s', is_trusted: %d, priority: %u",
+        dbus_mgr, dbus_mgr->priv->app_id, port_name, is_trusted, priority);
+
+    if (priority >= MSGPORT_PRIORITY_LAST) {
+        g_dbus_method_invocation_take_error (invocation,
+                msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "invalid priority"));
+        return TRUE;
+    }
 
     dbus_service = msgport_manager_register_service (
             dbus_mgr->priv->manager, dbus_mgr, 
-            port_name, is_trusted, &error);
+            port_name, is_trusted, (MsgPortPriority)priority, &error);
 
     if (dbus_service) {
         msgport_dbus_glue_manager_complete_register_service (
                 dbus_mgr->priv->dbus_skeleton, invocation, 
                 msgport_dbus_service_get_object_path(dbus_service));
+        msgport_stats_record_latency (MSGPORT_STATS_HANDLER_REGISTER_SERVICE, started);
         return TRUE;
     }
 
     if (!error) error = msgport_error_unknown_new ();
     g_dbus_method_invocation_take_error (invocation, error);
+    msgport_stats_record_latency (MSGPORT_STATS_HANDLER_REGISTER_SERVICE, started);
 
     return TRUE;
 }
@@ -131,34 +248,112 @@ _dbus_manager_handle_check_for_remote_service (
 {
     GError *error = NULL;
     MsgPortDbusService *dbus_service = NULL;
-    MsgPortDbusManager *remote_dbus_manager = NULL;
+    GList *remote_dbus_managers = NULL;
+    GList *item = NULL;
+    gint64 started = g_get_monotonic_time ();
 
     msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
 
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
     DBG ("check remote service request from %p for '%s' '%s', is_trusted: %d", 
             dbus_mgr, remote_app_id, remote_port_name, is_trusted);
 
-    remote_dbus_manager = msgport_dbus_server_get_dbus_manager_by_app_id (
+    /* an application might have more than one connection,
+     * first connection that owns the port wins */
+    remote_dbus_managers = msgport_dbus_server_get_dbus_managers_by_app_id (
                 dbus_mgr->priv->server, remote_app_id);
 
-    if (remote_dbus_manager) {
+    for (item = remote_dbus_managers; item && !dbus_service; item = item->next) {
+        g_clear_error (&error);
         dbus_service = msgport_manager_get_service (dbus_mgr->priv->manager, 
-                            remote_dbus_manager, remote_port_name, is_trusted, &error);
-        if (dbus_service) {
-            DBG ("Found service id : %d", msgport_dbus_service_get_id (dbus_service));
-            msgport_dbus_glue_manager_complete_check_for_remote_service (
-                dbus_mgr->priv->dbus_skeleton, invocation, 
-                msgport_dbus_service_get_id (dbus_service));
-            return TRUE;
-        }
+                            MSGPORT_DBUS_MANAGER (item->data),
+                            remote_port_name, is_trusted, &error);
+    }
+    g_list_free_full (remote_dbus_managers, g_object_unref);
+
+    if (dbus_service) {
+        DBG ("Found service id : %d", msgport_dbus_service_get_id (dbus_service));
+        /* client caches the resolved id, keep it informed about the service life */
+        msgport_dbus_service_add_watcher (dbus_service, dbus_mgr);
+        msgport_dbus_glue_manager_complete_check_for_remote_service (
+            dbus_mgr->priv->dbus_skeleton, invocation, 
+            msgport_dbus_service_get_id (dbus_service));
+        g_clear_error (&error);
+        g_object_unref (dbus_service);
+        msgport_stats_record_latency (MSGPORT_STATS_HANDLER_CHECK_FOR_REMOTE_SERVICE, started);
+        return TRUE;
     }
 
     if (!error) error = msgport_error_port_not_found (remote_app_id, remote_port_name);
     g_dbus_method_invocation_take_error (invocation, error);
+    msgport_stats_record_latency (MSGPORT_STATS_HANDLER_CHECK_FOR_REMOTE_SERVICE, started);
 
     return TRUE;
 }
 
+/*
+ * Pending send request, completed once the message is delivered
+ * to the remote service, or failed.
+ */
+typedef struct {
+    MsgPortDbusManager    *sender;
+    GDBusMethodInvocation *invocation;
+    guint                  service_id;
+    gboolean               no_reply;
+    MsgPortStatsHandler    handler;
+    gint64                 started;
+} SendRequest;
+
+gpointer
+msgport_dbus_manager_send_request_new (
+    MsgPortDbusManager    *sender,
+    GDBusMethodInvocation *invocation,
+    guint                  service_id,
+    MsgPortStatsHandler    handler)
+{
+    SendRequest *request = NULL;
+
+    msgport_return_val_if_fail (sender && MSGPORT_IS_DBUS_MANAGER (sender), NULL);
+
+    request = g_slice_new (SendRequest);
+    request->sender = g_object_ref (sender);
+    request->invocation = invocation;
+    request->service_id = service_id;
+    /* messages from the data channel have no invocation, never replied */
+    request->no_reply = !invocation || msgport_dbus_invocation_no_reply_expected (invocation);
+    request->handler = handler;
+    request->started = g_get_monotonic_time ();
+
+    return request;
+}
+
+void
+msgport_dbus_manager_send_request_complete (const GError *error, gpointer userdata)
+{
+    SendRequest *request = (SendRequest *)userdata;
+
+    if (error) msgport_stats_count_send_error (error);
+
+    if (!error) {
+        if (!request->no_reply) g_dbus_method_invocation_return_value (request->invocation, NULL);
+        else if (request->invocation) g_object_unref (request->invocation);
+    }
+    else if (request->no_reply) {
+        /* caller is not waiting for reply, report it out-of-band */
+        msgport_dbus_manager_notify_delivery_failed (request->sender, request->service_id, error);
+        if (request->invocation) g_object_unref (request->invocation);
+    }
+    else {
+        g_dbus_method_invocation_return_gerror (request->invocation, error);
+    }
+
+    msgport_stats_record_latency (request->handler, request->started);
+
+    g_object_unref (request->sender);
+    g_slice_free (SendRequest, request);
+}
+
 static gboolean
 _dbus_manager_handle_send_message (
     MsgPortDbusManager    *dbus_mgr,
@@ -169,25 +364,405 @@ _dbus_manager_handle_send_message (
 {
     GError *error = NULL;
     MsgPortDbusService *peer_dbus_service = 0;
+    gpointer request = NULL;
 
     msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
 
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
     DBG ("send_message from %p('%s') to service_id %d", 
         dbus_mgr, dbus_mgr->priv->app_id, service_id);
 
+    request = msgport_dbus_manager_send_request_new (dbus_mgr, invocation, service_id,
+            MSGPORT_STATS_HANDLER_SEND_MESSAGE);
+    msgport_traffic_add (&dbus_mgr->priv->sent, g_variant_get_size (data));
+
     peer_dbus_service = msgport_manager_get_service_by_id (
             dbus_mgr->priv->manager, service_id, &error);
 
-    if (peer_dbus_service) {
-        if (msgport_dbus_service_send_message (peer_dbus_service, data, dbus_mgr->priv->app_id, "", FALSE, &error)) {
-            msgport_dbus_glue_manager_complete_send_message (
-                dbus_mgr->priv->dbus_skeleton, invocation);
-            return TRUE;
+    if (!peer_dbus_service) {
+        if (!error) error = msgport_error_unknown_new ();
+        msgport_dbus_manager_send_request_complete (error, request);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    msgport_dbus_service_send_message (peer_dbus_service, data, dbus_mgr->priv->app_id, "", FALSE,
+            msgport_dbus_manager_send_request_complete, request);
+    g_object_unref (peer_dbus_service);
+
+    return TRUE;
+}
+
+static gboolean
+_dbus_manager_handle_send_large_message (
+    MsgPortDbusManager    *dbus_mgr,
+    GDBusMethodInvocation *invocation,
+    GUnixFDList           *fd_list,
+    guint                  service_id,
+    gint                   payload,
+    gpointer               userdata)
+{
+    GError *error = NULL;
+    MsgPortDbusService *peer_dbus_service = 0;
+    gpointer request = NULL;
+
+    msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
+
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
+    DBG ("send_large_message from %p('%s') to service_id %d", 
+        dbus_mgr, dbus_mgr->priv->app_id, service_id);
+
+    request = msgport_dbus_manager_send_request_new (dbus_mgr, invocation, service_id,
+            MSGPORT_STATS_HANDLER_SEND_LARGE_MESSAGE);
+    msgport_traffic_add (&dbus_mgr->priv->sent, msgport_stats_get_payload_size (fd_list, payload));
+
+    peer_dbus_service = msgport_manager_get_service_by_id (
+            dbus_mgr->priv->manager, service_id, &error);
+
+    if (!peer_dbus_service) {
+        if (!error) error = msgport_error_unknown_new ();
+        msgport_dbus_manager_send_request_complete (error, request);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    msgport_dbus_service_send_large_message (peer_dbus_service, fd_list, payload,
+            dbus_mgr->priv->app_id, "", FALSE,
+            msgport_dbus_manager_send_request_complete, request);
+    g_object_unref (peer_dbus_service);
+
+    return TRUE;
+}
+
+/*
+ * Pending sendMessages request, replied once all the messages
+ * in the batch are either delivered or failed.
+ */
+typedef struct {
+    GDBusMethodInvocation *invocation;
+    guint                 *results;
+    guint                  n_results;
+    gint                   n_pending; /* atomic, completions may come from other threads */
+    gint64                 started;
+} BatchRequest;
+
+typedef struct {
+    BatchRequest *batch;
+    guint         index;
+} BatchSlot;
+
+static void
+_batch_request_unref_pending (BatchRequest *batch)
+{
+    GVariant *results = NULL;
+
+    if (!g_atomic_int_dec_and_test (&batch->n_pending)) return;
+
+    results = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+            batch->results, batch->n_results, sizeof (guint32));
+    g_dbus_method_invocation_return_value (batch->invocation, g_variant_new_tuple (&results, 1));
+    msgport_stats_record_latency (MSGPORT_STATS_HANDLER_SEND_MESSAGES, batch->started);
+
+    g_free (batch->results);
+    g_slice_free (BatchRequest, batch);
+}
+
+static void
+_on_batch_message_sent (const GError *error, gpointer userdata)
+{
+    BatchSlot *slot = (BatchSlot *)userdata;
+
+    if (error) {
+        msgport_stats_count_send_error (error);
+        slot->batch->results[slot->index] = error->domain == MSGPORT_ERROR_QUARK
+                ? (guint)error->code : (guint)MSGPORT_ERROR_UNKNOWN;
+    }
+
+    _batch_request_unref_pending (slot->batch);
+    g_slice_free (BatchSlot, slot);
+}
+
+/*
+ * Delivers a batch of messages in one go, replies with array of
+ * per message results: 0 on success, otherwise MsgPortError code.
+ */
+static gboolean
+_dbus_manager_handle_send_messages (
+    MsgPortDbusManager    *dbus_mgr,
+    GDBusMethodInvocation *invocation,
+    GVariant              *messages,
+    gpointer               userdata)
+{
+    GVariantIter iter;
+    GVariant *data = NULL;
+    guint service_id = 0;
+    guint last_service_id = 0;
+    MsgPortDbusService *peer_dbus_service = NULL;
+    BatchRequest *batch = NULL;
+    guint index = 0;
+
+    msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
+
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
+    DBG ("send_messages from %p('%s'), batch of %"G_GSIZE_FORMAT" messages",
+        dbus_mgr, dbus_mgr->priv->app_id, g_variant_n_children (messages));
+
+    batch = g_slice_new (BatchRequest);
+    batch->invocation = invocation;
+    batch->n_results = g_variant_n_children (messages);
+    batch->results = g_new0 (guint, batch->n_results);
+    batch->n_pending = 1; /* held until all the messages are dispatched */
+    batch->started = g_get_monotonic_time ();
+
+    g_variant_iter_init (&iter, messages);
+
+    for (index = 0; g_variant_iter_next (&iter, "(u@a{sv})", &service_id, &data); index++) {
+        GError *error = NULL;
+
+        msgport_traffic_add (&dbus_mgr->priv->sent, g_variant_get_size (data));
+
+        /* batches usually target one port, avoid looking it up for every message */
+        if (!peer_dbus_service || service_id != last_service_id) {
+            if (peer_dbus_service) g_object_unref (peer_dbus_service);
+            peer_dbus_service = msgport_manager_get_service_by_id (
+                    dbus_mgr->priv->manager, service_id, &error);
+            last_service_id = service_id;
+        }
+
+        if (peer_dbus_service) {
+            BatchSlot *slot = g_slice_new (BatchSlot);
+            slot->batch = batch;
+            slot->index = index;
+            g_atomic_int_inc (&batch->n_pending);
+            msgport_dbus_service_send_message (peer_dbus_service, data, dbus_mgr->priv->app_id, "", FALSE,
+                    _on_batch_message_sent, slot);
+        }
+        else {
+            if (error) msgport_stats_count_send_error (error);
+            batch->results[index] = error ? (guint)error->code : (guint)MSGPORT_ERROR_UNKNOWN;
+        }
+
+        if (error) g_error_free (error);
+        g_variant_unref (data);
+    }
+
+    if (peer_dbus_service) g_object_unref (peer_dbus_service);
+
+    _batch_request_unref_pending (batch);
+
+    return TRUE;
+}
+
+/*
+ * Payload codecs, the daemon only keeps track of what each client
+ * can decode, compressed messages are forwarded untouched.
+ */
+static gboolean
+_dbus_manager_handle_set_codecs (
+    MsgPortDbusManager    *dbus_mgr,
+    GDBusMethodInvocation *invocation,
+    guint                  codecs,
+    gpointer               userdata)
+{
+    msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
+
+    DBG ("client %p('%s') decodes codecs 0x%x", dbus_mgr, dbus_mgr->priv->app_id, codecs);
+
+    g_atomic_int_set (&dbus_mgr->priv->codecs, (gint)codecs);
+
+    msgport_dbus_glue_manager_complete_set_codecs (dbus_mgr->priv->dbus_skeleton, invocation);
+
+    return TRUE;
+}
+
+static gboolean
+_dbus_manager_handle_get_service_codecs (
+    MsgPortDbusManager    *dbus_mgr,
+    GDBusMethodInvocation *invocation,
+    guint                  service_id,
+    gpointer               userdata)
+{
+    MsgPortDbusService *dbus_service = NULL;
+    MsgPortDbusManager *owner = NULL;
+    GError *error = NULL;
+
+    msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
+
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
+    dbus_service = msgport_manager_get_service_by_id (dbus_mgr->priv->manager, service_id, &error);
+    if (!dbus_service) {
+        if (!error) error = msgport_error_port_id_not_found_new (service_id);
+        g_dbus_method_invocation_take_error (invocation, error);
+        return TRUE;
+    }
+
+    owner = msgport_dbus_service_get_owner (dbus_service);
+    msgport_dbus_glue_manager_complete_get_service_codecs (dbus_mgr->priv->dbus_skeleton,
+            invocation, owner ? msgport_dbus_manager_get_codecs (owner) : 0);
+    g_object_unref (dbus_service);
+
+    return TRUE;
+}
+
+/*
+ * Data channel
+ */
+static void
+_dbus_manager_handle_frame (MsgPortDbusManager *dbus_mgr, MsgPortChannelFrame *frame)
+{
+    MsgPortDbusService *sender = NULL;
+    MsgPortDbusService *peer_dbus_service = NULL;
+    const gchar *port_name = "";
+    gboolean is_trusted = FALSE;
+    gboolean is_large = frame->payload_fd >= 0;
+    GError *error = NULL;
+    gpointer request = NULL;
+
+    request = msgport_dbus_manager_send_request_new (dbus_mgr, NULL, frame->header.service_id,
+            is_large ? MSGPORT_STATS_HANDLER_SEND_LARGE_MESSAGE : MSGPORT_STATS_HANDLER_SEND_MESSAGE);
+
+    /* bidirectional messages are sent from a port of this very client */
+    if (frame->header.sender_id) {
+        sender = msgport_manager_get_service_by_id (dbus_mgr->priv->manager,
+                frame->header.sender_id, &error);
+        if (sender && msgport_dbus_service_get_owner (sender) != dbus_mgr) {
+            g_clear_object (&sender);
+            error = msgport_error_port_id_not_found_new (frame->header.sender_id);
         }
+        if (!sender) goto fail;
+
+        port_name = msgport_dbus_service_get_port_name (sender);
+        is_trusted = msgport_dbus_service_get_is_trusted (sender);
     }
 
+    peer_dbus_service = msgport_manager_get_service_by_id (
+            dbus_mgr->priv->manager, frame->header.service_id, &error);
+    if (!peer_dbus_service) goto fail;
+
+    if (is_large) {
+        GUnixFDList *fd_list = g_unix_fd_list_new_from_array (&frame->payload_fd, 1);
+
+        frame->payload_fd = -1;
+        msgport_traffic_add (&dbus_mgr->priv->sent, msgport_stats_get_payload_size (fd_list, 0));
+        msgport_dbus_service_send_large_message (peer_dbus_service, fd_list, 0,
+                dbus_mgr->priv->app_id, port_name, is_trusted,
+                msgport_dbus_manager_send_request_complete, request);
+        g_object_unref (fd_list);
+    }
+    else {
+        /* frame points into the receive buffer, which is reused */
+        GBytes *bytes = g_bytes_new (frame->payload, frame->payload_size);
+        GVariant *data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE));
+
+        g_bytes_unref (bytes);
+        msgport_traffic_add (&dbus_mgr->priv->sent, frame->payload_size);
+        msgport_dbus_service_send_message (peer_dbus_service, data,
+                dbus_mgr->priv->app_id, port_name, is_trusted,
+                msgport_dbus_manager_send_request_complete, request);
+        g_variant_unref (data);
+    }
+
+    g_object_unref (peer_dbus_service);
+    if (sender) g_object_unref (sender);
+
+    return;
+
+fail:
+    if (frame->payload_fd >= 0) close (frame->payload_fd);
     if (!error) error = msgport_error_unknown_new ();
-    g_dbus_method_invocation_take_error (invocation, error);
+    msgport_dbus_manager_send_request_complete (error, request);
+    g_error_free (error);
+}
+
+static gboolean
+_dbus_manager_on_channel_readable (gint fd, GIOCondition condition, gpointer userdata)
+{
+    MsgPortDbusManager *dbus_mgr = g_weak_ref_get ((GWeakRef *)userdata);
+    MsgPortChannelFrame frame;
+    GError *error = NULL;
+    guint i;
+
+    if (!dbus_mgr) return FALSE;
+
+    for (i = 0; i < MSGPORT_CHANNEL_BATCH; i++) {
+        if (!msgport_channel_receive (fd, dbus_mgr->priv->channel_buffer,
+                    MSGPORT_CHANNEL_MAX_PACKET, &frame, &error))
+            break;
+        _dbus_manager_handle_frame (dbus_mgr, &frame);
+    }
+
+    if (error && !g_error_matches (error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_WOULD_BLOCK)) {
+        /* client closed it or broke the framing, deliveries go over dbus again */
+        DBG ("Closing data channel of %p('%s') : %s", dbus_mgr, dbus_mgr->priv->app_id, error->message);
+        g_error_free (error);
+        _dbus_manager_close_channel (dbus_mgr);
+        g_object_unref (dbus_mgr);
+        return FALSE;
+    }
+    g_clear_error (&error);
+
+    g_object_unref (dbus_mgr);
+
+    return TRUE;
+}
+
+static void
+_weak_ref_free (gpointer data)
+{
+    g_weak_ref_clear ((GWeakRef *)data);
+    g_slice_free (GWeakRef, data);
+}
+
+static gboolean
+_dbus_manager_handle_open_channel (
+    MsgPortDbusManager    *dbus_mgr,
+    GDBusMethodInvocation *invocation,
+    GUnixFDList           *fd_list,
+    gpointer               userdata)
+{
+    GUnixFDList *out_fd_list = NULL;
+    GWeakRef *weak_ref = NULL;
+    GError *error = NULL;
+    gint daemon_fd = -1, client_fd = -1;
+
+    msgport_return_val_if_fail (dbus_mgr && MSGPORT_IS_DBUS_MANAGER (dbus_mgr), FALSE);
+
+    if (_dbus_manager_park_invocation (dbus_mgr, invocation)) return TRUE;
+
+    DBG ("open channel request from %p('%s')", dbus_mgr, dbus_mgr->priv->app_id);
+
+    if (dbus_mgr->priv->channel_fd >= 0) {
+        g_dbus_method_invocation_take_error (invocation,
+                msgport_error_new (MSGPORT_ERROR_ALREADY_EXISTING, "data channel already opened"));
+        return TRUE;
+    }
+
+    if (!msgport_channel_new_pair (&daemon_fd, &client_fd, &error)) {
+        g_dbus_method_invocation_take_error (invocation, error);
+        return TRUE;
+    }
+
+    dbus_mgr->priv->channel_fd = daemon_fd;
+    dbus_mgr->priv->channel_buffer = g_malloc (MSGPORT_CHANNEL_MAX_PACKET);
+
+    /* watched on the serving thread, might outlive the manager on other threads */
+    weak_ref = g_slice_new0 (GWeakRef);
+    g_weak_ref_init (weak_ref, dbus_mgr);
+    dbus_mgr->priv->channel_watch = g_unix_fd_source_new (daemon_fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
+    g_source_set_callback (dbus_mgr->priv->channel_watch,
+            (GSourceFunc)_dbus_manager_on_channel_readable, weak_ref, _weak_ref_free);
+    g_source_attach (dbus_mgr->priv->channel_watch, dbus_mgr->priv->context);
+
+    msgport_outbox_set_channel (dbus_mgr->priv->outbox, daemon_fd, dbus_mgr->priv->context);
+
+    out_fd_list = g_unix_fd_list_new_from_array (&client_fd, 1);
+    msgport_dbus_glue_manager_complete_open_channel (dbus_mgr->priv->dbus_skeleton,
+            invocation, out_fd_list, 0);
+    g_object_unref (out_fd_list);
 
     return TRUE;
 }
@@ -211,7 +786,16 @@ msgport_dbus_manager_init (MsgPortDbusManager *self)
     priv->dbus_skeleton = msgport_dbus_glue_manager_skeleton_new ();
     priv->manager = msgport_manager_new ();
     priv->is_null_cert = FALSE;
-    priv->peer_certs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->cert_cache = msgport_cert_cache_new ();
+    priv->app_id_resolved = FALSE;
+    g_queue_init (&priv->parked);
+    priv->stats_skeleton = NULL;
+    priv->sent.messages = 0;
+    priv->sent.bytes = 0;
+    priv->channel_fd = -1;
+    priv->channel_watch = NULL;
+    priv->channel_buffer = NULL;
+    priv->codecs = 0;
 
     g_signal_connect_swapped (priv->dbus_skeleton, "handle-register-service",
                 G_CALLBACK (_dbus_manager_handle_register_service), (gpointer)self);
@@ -219,19 +803,172 @@ msgport_dbus_manager_init (MsgPortDbusManager *self)
                 G_CALLBACK (_dbus_manager_handle_check_for_remote_service), (gpointer)self);
     g_signal_connect_swapped (priv->dbus_skeleton, "handle-send-message",
                 G_CALLBACK (_dbus_manager_handle_send_message), (gpointer)self);
+    g_signal_connect_swapped (priv->dbus_skeleton, "handle-send-large-message",
+                G_CALLBACK (_dbus_manager_handle_send_large_message), (gpointer)self);
+    g_signal_connect_swapped (priv->dbus_skeleton, "handle-send-messages",
+                G_CALLBACK (_dbus_manager_handle_send_messages), (gpointer)self);
+    g_signal_connect_swapped (priv->dbus_skeleton, "handle-open-channel",
+                G_CALLBACK (_dbus_manager_handle_open_channel), (gpointer)self);
+    g_signal_connect_swapped (priv->dbus_skeleton, "handle-set-codecs",
+                G_CALLBACK (_dbus_manager_handle_set_codecs), (gpointer)self);
+    g_signal_connect_swapped (priv->dbus_skeleton, "handle-get-service-codecs",
+                G_CALLBACK (_dbus_manager_handle_get_service_codecs), (gpointer)self);
 
     self->priv = priv;
 }
-static gchar *
-_get_app_id_from_connection (GDBusConnection *connection, gboolean *is_valid)
+static guint64
+_get_process_start_time (pid_t pid)
 {
-    pid_t peer_pid;
-    GError *error = NULL;
+    gchar *path = g_strdup_printf ("/proc/%d/stat", pid);
+    gchar *contents = NULL;
+    gchar *fields_start = NULL;
+    gchar **fields = NULL;
+    guint64 start_time = 0;
+
+    if (g_file_get_contents (path, &contents, NULL, NULL)) {
+        /* process name might contain spaces, count the fields after it */
+        if ((fields_start = strrchr (contents, ')')) != NULL) {
+            fields = g_strsplit (fields_start + 1, " ", 22);
+            /* start time is 22nd field, i.e, 20th after process name */
+            if (g_strv_length (fields) > 20) start_time = g_ascii_strtoull (fields[20], NULL, 10);
+            g_strfreev (fields);
+        }
+        g_free (contents);
+    }
+    g_free (path);
+
+    return start_time;
+}
+
+static void
+_app_id_entry_free (gpointer data)
+{
+    AppIdEntry *entry = (AppIdEntry *)data;
+
+    g_free (entry->app_id);
+    g_slice_free (AppIdEntry, entry);
+}
+
+static gboolean
+_app_id_entry_is_dead (gpointer key, gpointer value, gpointer userdata)
+{
+    AppIdEntry *entry = (AppIdEntry *)value;
+
+    return _get_process_start_time (GPOINTER_TO_INT (key)) != entry->start_time;
+}
+
+/*
+ * Runs on a worker thread, aul lookups might take long when many
+ * applications are launching.
+ */
+static void
+_resolve_app_id_thread (GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+    pid_t pid = GPOINTER_TO_INT (task_data);
+    guint64 start_time = _get_process_start_time (pid);
+    AppIdEntry *entry = NULL;
+    AppIdEntry *result = NULL;
     char app_id[255];
     aul_return_val res;
-    GCredentials *cred = g_dbus_connection_get_peer_credentials (connection);
 
-    msgport_return_val_if_fail (cred != NULL, NULL);
+    G_LOCK (app_id_cache);
+    if (__app_id_cache) entry = g_hash_table_lookup (__app_id_cache, GINT_TO_POINTER (pid));
+    if (entry && start_time && entry->start_time == start_time) {
+        result = g_slice_new (AppIdEntry);
+        result->app_id = g_strdup (entry->app_id);
+        result->is_valid = entry->is_valid;
+        result->start_time = start_time;
+    }
+    G_UNLOCK (app_id_cache);
+
+    if (result) {
+        g_task_return_pointer (task, result, _app_id_entry_free);
+        return;
+    }
+
+    result = g_slice_new (AppIdEntry);
+    result->start_time = start_time;
+
+    G_LOCK (aul);
+    res = aul_app_get_appid_bypid (pid, app_id, sizeof(app_id));
+    G_UNLOCK (aul);
+
+    if (res != AUL_R_OK) {
+    	WARN ("Fail to get appid of peer pid '%d', error : %d, considering pid as app_id", pid, res);
+        result->is_valid = FALSE;
+        result->app_id = g_strdup_printf ("%d", pid);
+    }
+    else {
+        result->is_valid = TRUE;
+        result->app_id = g_strdup (app_id);
+    }
+
+    /* pid can not be trusted without knowing the process life */
+    if (start_time) {
+        entry = g_slice_new (AppIdEntry);
+        entry->app_id = g_strdup (result->app_id);
+        entry->is_valid = result->is_valid;
+        entry->start_time = start_time;
+
+        G_LOCK (app_id_cache);
+        if (!__app_id_cache)
+            __app_id_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, _app_id_entry_free);
+        if (g_hash_table_size (__app_id_cache) >= APP_ID_CACHE_PRUNE_SIZE)
+            g_hash_table_foreach_remove (__app_id_cache, _app_id_entry_is_dead, NULL);
+        g_hash_table_replace (__app_id_cache, GINT_TO_POINTER (pid), entry);
+        G_UNLOCK (app_id_cache);
+    }
+
+    g_task_return_pointer (task, result, _app_id_entry_free);
+}
+
+static void
+_dbus_manager_set_app_id (MsgPortDbusManager *dbus_mgr, const gchar *app_id, gboolean is_valid)
+{
+    dbus_mgr->priv->app_id = g_strdup (app_id);
+    /* treat invalid tizen apps has null certificate */
+    dbus_mgr->priv->is_null_cert = !is_valid;
+    dbus_mgr->priv->app_id_resolved = TRUE;
+
+    if (app_id)
+        msgport_dbus_server_index_dbus_manager (dbus_mgr->priv->server, dbus_mgr);
+
+    _dbus_manager_replay_parked (dbus_mgr);
+}
+
+static void
+_on_app_id_resolved (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    MsgPortDbusManager *dbus_mgr = MSGPORT_DBUS_MANAGER (source);
+    AppIdEntry *entry = NULL;
+
+    entry = (AppIdEntry *)g_task_propagate_pointer (G_TASK (result), NULL);
+    /* client went away meanwhile, parked requests are dropped on dispose */
+    if (g_dbus_connection_is_closed (dbus_mgr->priv->connection)) {
+        _app_id_entry_free (entry);
+        return;
+    }
+
+    DBG ("Connection %p belongs to app '%s'", dbus_mgr->priv->connection, entry->app_id);
+    _dbus_manager_set_app_id (dbus_mgr, entry->app_id, entry->is_valid);
+
+    _app_id_entry_free (entry);
+}
+
+static gboolean
+_resolve_app_id_from_connection (gpointer userdata)
+{
+    MsgPortDbusManager *dbus_mgr = MSGPORT_DBUS_MANAGER (userdata);
+    pid_t peer_pid;
+    GError *error = NULL;
+    GTask *task = NULL;
+    GCredentials *cred = g_dbus_connection_get_peer_credentials (dbus_mgr->priv->connection);
+
+    if (!cred) {
+        WARN ("No peer credentials on connection %p", dbus_mgr->priv->connection);
+        _dbus_manager_set_app_id (dbus_mgr, NULL, FALSE);
+        return FALSE;
+    }
 #ifdef ENABLE_DEBUG
     gchar *str_cred = g_credentials_to_string (cred);
     DBG ("Client Credentials : %s", str_cred);
@@ -240,34 +977,49 @@ _get_app_id_from_connection (GDBusConnection *connection, gboolean *is_valid)
 
     peer_pid = g_credentials_get_unix_pid (cred, &error);
     if (error) {
-        WARN ("Faild to get peer pid on conneciton %p : %s", connection, error->message);
+        WARN ("Faild to get peer pid on conneciton %p : %s", dbus_mgr->priv->connection, error->message);
         g_error_free (error);
-        return NULL;
+        _dbus_manager_set_app_id (dbus_mgr, NULL, FALSE);
+        return FALSE;
     }
 
-    if ((res = aul_app_get_appid_bypid (peer_pid, app_id, sizeof(app_id))) != AUL_R_OK) {
-    	WARN ("Fail to get appid of peer pid '%d', error : %d, considering pid as app_id", peer_pid, res);
-        if (is_valid) *is_valid = FALSE;
-    	return g_strdup_printf ("%d", peer_pid);
-    }
-    if (is_valid) *is_valid = TRUE;
-    return g_strdup (app_id);
+    task = g_task_new (dbus_mgr, NULL, _on_app_id_resolved, NULL);
+    g_task_set_task_data (task, GINT_TO_POINTER (peer_pid), NULL);
+    g_task_run_in_thread (task, _resolve_app_id_thread);
+    g_object_unref (task);
+
+    return FALSE;
 }
 
+/*
+ * Creates dbus manager for the client connection. Client application id
+ * is resolved asynchronously, the requests arriving meanwhile are
+ * served once it is known. Client requests are served on the thread
+ * default main context of the caller.
+ *
+ * peer_app_id, if given, is used as is and is never considered as a
+ * valid tizen application.
+ */
 MsgPortDbusManager *
 msgport_dbus_manager_new (
     GDBusConnection *connection,
     MsgPortDbusServer *server,
+    const gchar *peer_app_id,
     GError **error)
 {
     MsgPortDbusManager *dbus_mgr = NULL;
-    gboolean valid_app = FALSE;
+    GError *stats_error = NULL;
 
     dbus_mgr = MSGPORT_DBUS_MANAGER (g_object_new (MSGPORT_TYPE_DBUS_MANAGER, NULL));
     if (!dbus_mgr) {
         if (error) *error = msgport_error_new (MSGPORT_ERROR_OUT_OF_MEMORY, "Out of memory");
         return NULL;
     }
+    /* requests might be dispatched right after export */
+    dbus_mgr->priv->connection = g_object_ref (connection);
+    dbus_mgr->priv->server = server;
+    dbus_mgr->priv->context = g_main_context_ref_thread_default ();
+    dbus_mgr->priv->outbox = msgport_outbox_new (connection);
 
     if (!g_dbus_interface_skeleton_export (
             G_DBUS_INTERFACE_SKELETON (dbus_mgr->priv->dbus_skeleton),
@@ -279,11 +1031,36 @@ msgport_dbus_manager_new (
         g_object_unref (dbus_mgr);
         return NULL;
     }
-    dbus_mgr->priv->connection = g_object_ref (connection);
-    dbus_mgr->priv->server = server;
-    dbus_mgr->priv->app_id =  _get_app_id_from_connection (connection, &valid_app);
-    /* treat invalid tizen apps has null certificate */
-    if (!valid_app) dbus_mgr->priv->is_null_cert = TRUE;
+
+    /* statistics are not essential for serving the client */
+    dbus_mgr->priv->stats_skeleton = msgport_stats_skeleton_new (server);
+    if (dbus_mgr->priv->stats_skeleton &&
+        !g_dbus_interface_skeleton_export (
+            G_DBUS_INTERFACE_SKELETON (dbus_mgr->priv->stats_skeleton),
+            connection, "/", &stats_error)) {
+        WARN ("Failed to export stats object on connection %p : %s", connection, stats_error->message);
+        g_clear_error (&stats_error);
+        g_clear_object (&dbus_mgr->priv->stats_skeleton);
+    }
+
+    if (peer_app_id) {
+        AppIdEntry *entry = g_slice_new0 (AppIdEntry);
+        GTask *task = NULL;
+
+        entry->app_id = g_strdup (peer_app_id);
+        entry->is_valid = FALSE;
+
+        /* completes on the serving thread, same as the resolved ones */
+        task = g_task_new (dbus_mgr, NULL, _on_app_id_resolved, NULL);
+        g_task_return_pointer (task, entry, _app_id_entry_free);
+        g_object_unref (task);
+
+        return dbus_mgr;
+    }
+
+    /* parked requests are touched only from the serving thread */
+    g_main_context_invoke_full (dbus_mgr->priv->context, G_PRIORITY_DEFAULT,
+            _resolve_app_id_from_connection, g_object_ref (dbus_mgr), g_object_unref);
 
     return dbus_mgr;
 }
@@ -304,6 +1081,39 @@ msgport_dbus_manager_get_connection (MsgPortDbusManager *dbus_manager)
     return dbus_manager->priv->connection;
 }
 
+GMainContext *
+msgport_dbus_manager_get_context (MsgPortDbusManager *dbus_manager)
+{
+    msgport_return_val_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager), NULL);
+
+    return dbus_manager->priv->context;
+}
+
+MsgPortOutbox *
+msgport_dbus_manager_get_outbox (MsgPortDbusManager *dbus_manager)
+{
+    msgport_return_val_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager), NULL);
+
+    return dbus_manager->priv->outbox;
+}
+
+void
+msgport_dbus_manager_add_sent_traffic (MsgPortDbusManager *dbus_manager, gsize n_bytes)
+{
+    msgport_return_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager));
+
+    msgport_traffic_add (&dbus_manager->priv->sent, n_bytes);
+}
+
+void
+msgport_dbus_manager_get_traffic (MsgPortDbusManager *dbus_manager, guint64 *messages, guint64 *bytes)
+{
+    msgport_return_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager));
+
+    if (messages) *messages = msgport_traffic_get_messages (&dbus_manager->priv->sent);
+    if (bytes) *bytes = msgport_traffic_get_bytes (&dbus_manager->priv->sent);
+}
+
 const gchar *
 msgport_dbus_manager_get_app_id (MsgPortDbusManager *dbus_manager)
 {
@@ -312,42 +1122,69 @@ msgport_dbus_manager_get_app_id (MsgPortDbusManager *dbus_manager)
     return (const gchar *)dbus_manager->priv->app_id;
 }
 
-gboolean
-msgport_dbus_manager_validate_peer_certificate (MsgPortDbusManager *dbus_manager, const gchar *peer_app_id)
+guint
+msgport_dbus_manager_get_codecs (MsgPortDbusManager *dbus_manager)
 {
-    int res ;
-    pkgmgrinfo_cert_compare_result_type_e compare_result;
-    gboolean is_valid_cert = FALSE;
+    msgport_return_val_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager), 0);
+
+    return (guint)g_atomic_int_get (&dbus_manager->priv->codecs);
+}
+
+/*
+ * Checks if the peer is allowed to send messages to trusted ports of this
+ * client. The result is either served from the daemon wide cache, or #cb is
+ * called later once the certificates are compared on a worker thread.
+ */
+void
+msgport_dbus_manager_validate_peer_certificate (
+    MsgPortDbusManager *dbus_manager,
+    const gchar *peer_app_id,
+    MsgPortCertCacheCallback cb,
+    gpointer userdata)
+{
+    msgport_return_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager));
+    msgport_return_if_fail (cb);
 
     /* check if the source application has no certificate info */
     if (dbus_manager->priv->is_null_cert) {
         DBG("Service owner has no certifcate information, treating port as untrusted");
-        return TRUE; /* allow all peers to connect */
+        cb (TRUE, userdata); /* allow all peers to connect */
+        return;
     }
 
-    /* check if we have cached status */
-    if (g_hash_table_contains (dbus_manager->priv->peer_certs, peer_app_id))
-        return ((gboolean)(glong)g_hash_table_lookup (dbus_manager->priv->peer_certs, peer_app_id));
+    msgport_cert_cache_validate (dbus_manager->priv->cert_cache,
+            dbus_manager->priv->app_id, peer_app_id, cb, userdata);
+}
 
-    if ((res = pkgmgrinfo_pkginfo_compare_app_cert_info (dbus_manager->priv->app_id,
-                    peer_app_id, &compare_result)) != PMINFO_R_OK) {
-        WARN ("Fail to compare certificates of applications('%s', '%s') : error %d", 
-                dbus_manager->priv->app_id, peer_app_id, res);
-        return FALSE;
-    }
+void
+msgport_dbus_manager_notify_remote_service_unregistered (MsgPortDbusManager *dbus_manager, guint service_id)
+{
+    msgport_return_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager));
 
-    if (compare_result == PMINFO_CERT_COMPARE_LHS_NO_CERT ||
-        compare_result == PMINFO_CERT_COMPARE_BOTH_NO_CERT) {
-        DBG("Service owner has no certifcate information, treating port as untrusted");
-        dbus_manager->priv->is_null_cert = TRUE;
-        return TRUE;
-    }
+    /* skeleton is already gone if the client itself is going down */
+    if (!dbus_manager->priv->dbus_skeleton) return;
+
+    DBG ("Notifying %p('%s') about unregistered service %d",
+            dbus_manager, dbus_manager->priv->app_id, service_id);
+    msgport_dbus_glue_manager_emit_remote_service_unregistered (
+            dbus_manager->priv->dbus_skeleton, service_id);
+}
 
-    DBG("certificate comparison result : %d", compare_result);
+void
+msgport_dbus_manager_notify_delivery_failed (MsgPortDbusManager *dbus_manager, guint service_id, const GError *error)
+{
+    gchar *error_name = NULL;
 
-    is_valid_cert = (compare_result == PMINFO_CERT_COMPARE_MATCH) ;
-    g_hash_table_insert (dbus_manager->priv->peer_certs, g_strdup (peer_app_id), (gpointer)is_valid_cert);
+    msgport_return_if_fail (dbus_manager && MSGPORT_IS_DBUS_MANAGER (dbus_manager));
+    msgport_return_if_fail (error);
 
-    return is_valid_cert;
-}
+    if (!dbus_manager->priv->dbus_skeleton) return;
 
+    WARN ("Delivery of message from %p('%s') to service %d failed : %s",
+            dbus_manager, dbus_manager->priv->app_id, service_id, error->message);
+
+    error_name = g_dbus_error_encode_gerror (error);
+    msgport_dbus_glue_manager_emit_message_delivery_failed (
+            dbus_manager->priv->dbus_skeleton, service_id, error_name, error->message);
+    g_free (error_name);
+}
@@ -29,6 +29,9 @@
 #include <glib.h>
 #include <gio/gio.h>
 #include <glib-object.h>
+#include "cert-cache.h"
+#include "outbox.h"
+#include "stats.h"
 
 G_BEGIN_DECLS
 
@@ -64,6 +67,7 @@ MsgPortDbusManager *
 msgport_dbus_manager_new (
     GDBusConnection *connection,
     MsgPortDbusServer *server,
+    const gchar *peer_app_id,
     GError **error);
 
 MsgPortManager *
@@ -72,12 +76,51 @@ msgport_dbus_manager_get_manager (MsgPortDbusManager *dbus_manager);
 GDBusConnection *
 msgport_dbus_manager_get_connection (MsgPortDbusManager *dbus_manager);
 
+GMainContext *
+msgport_dbus_manager_get_context (MsgPortDbusManager *dbus_manager);
+
+MsgPortOutbox *
+msgport_dbus_manager_get_outbox (MsgPortDbusManager *dbus_manager);
+
+void
+msgport_dbus_manager_add_sent_traffic (MsgPortDbusManager *dbus_manager,
+                                       gsize n_bytes);
+
+void
+msgport_dbus_manager_get_traffic (MsgPortDbusManager *dbus_manager,
+                                  guint64 *messages,
+                                  guint64 *bytes);
+
 const gchar *
 msgport_dbus_manager_get_app_id (MsgPortDbusManager *dbus_manager);
 
-gboolean
+guint
+msgport_dbus_manager_get_codecs (MsgPortDbusManager *dbus_manager);
+
+void
 msgport_dbus_manager_validate_peer_certificate (MsgPortDbusManager *dbus_manager,
-                                                const gchar *peer_app_id);
+                                                const gchar *peer_app_id,
+                                                MsgPortCertCacheCallback cb,
+                                                gpointer userdata);
+
+gpointer
+msgport_dbus_manager_send_request_new (MsgPortDbusManager *sender,
+                                       GDBusMethodInvocation *invocation,
+                                       guint service_id,
+                                       MsgPortStatsHandler handler);
+
+void
+msgport_dbus_manager_send_request_complete (const GError *error,
+                                            gpointer request);
+
+void
+msgport_dbus_manager_notify_remote_service_unregistered (MsgPortDbusManager *dbus_manager,
+                                                         guint service_id);
+
+void
+msgport_dbus_manager_notify_delivery_failed (MsgPortDbusManager *dbus_manager,
+                                             guint service_id,
+                                             const GError *error);
 
 G_END_DECLS
 
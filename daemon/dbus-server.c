@@ -51,18 +51,139 @@ enum
 
 static GParamSpec *properties[N_PROPERTIES];
 
+/*
+ * Thread serving the client connections assigned to it,
+ * on its own main context.
+ */
+typedef struct {
+    GThread      *thread;
+    GMainContext *context;
+    GMainLoop    *loop;
+    gint          n_connections; /* atomic */
+} MsgPortWorker;
+
 struct _MsgPortDbusServerPrivate
 {
     GDBusServer    *bus_server;
     gchar          *address;
     GHashTable     *dbus_managers; /* {GDBusConnection,MsgPortDbusManager} */
+    GHashTable     *app_id_index;  /* {gchar*,GQueue[MsgPortDbusManager*]} in connection order */
+    GMutex          lock;          /* guards dbus_managers and app_id_index */
+    GPtrArray      *workers;       /* MsgPortWorker*, empty if all served on main thread */
 };
 
+#define MSGPORT_WORKER_KEY "msgport-worker"
+
 static void _on_connection_closed (GDBusConnection *connection,
                        gboolean         remote_peer_vanished,
                        GError          *error,
                        gpointer         user_data);
 
+static gpointer
+_worker_thread (gpointer data)
+{
+    MsgPortWorker *worker = (MsgPortWorker *)data;
+
+    g_main_context_push_thread_default (worker->context);
+    g_main_loop_run (worker->loop);
+    g_main_context_pop_thread_default (worker->context);
+
+    return NULL;
+}
+
+static MsgPortWorker *
+_worker_new (guint index)
+{
+    MsgPortWorker *worker = g_slice_new0 (MsgPortWorker);
+    gchar *name = g_strdup_printf ("msgport-worker-%u", index);
+
+    worker->context = g_main_context_new ();
+    worker->loop = g_main_loop_new (worker->context, FALSE);
+    worker->thread = g_thread_new (name, _worker_thread, worker);
+    g_free (name);
+
+    return worker;
+}
+
+static gboolean
+_worker_quit_idle (gpointer data)
+{
+    g_main_loop_quit ((GMainLoop *)data);
+
+    return FALSE;
+}
+
+static void
+_worker_free (gpointer data)
+{
+    MsgPortWorker *worker = (MsgPortWorker *)data;
+    GSource *source = g_idle_source_new ();
+
+    /* low priority, so that the clients released before are gone first */
+    g_source_set_priority (source, G_PRIORITY_LOW);
+    g_source_set_callback (source, _worker_quit_idle, worker->loop, NULL);
+    g_source_attach (source, worker->context);
+    g_source_unref (source);
+
+    g_thread_join (worker->thread);
+
+    g_main_loop_unref (worker->loop);
+    g_main_context_unref (worker->context);
+    g_slice_free (MsgPortWorker, worker);
+}
+
+/*
+ * Number of worker threads is taken from MESSAGEPORT_WORKER_THREADS,
+ * 'auto' for one per processor, none by default.
+ */
+static guint
+_get_worker_count ()
+{
+    const gchar *value = g_getenv ("MESSAGEPORT_WORKER_THREADS");
+
+    if (!value) return 0;
+
+    if (!g_strcmp0 (value, "auto")) return g_get_num_processors ();
+
+    return (guint)g_ascii_strtoull (value, NULL, 10);
+}
+
+static MsgPortWorker *
+_pick_worker (MsgPortDbusServer *server)
+{
+    MsgPortWorker *picked = NULL;
+    guint i;
+
+    for (i = 0; i < server->priv->workers->len; i++) {
+        MsgPortWorker *worker = g_ptr_array_index (server->priv->workers, i);
+        if (!picked || g_atomic_int_get (&worker->n_connections) < g_atomic_int_get (&picked->n_connections))
+            picked = worker;
+    }
+
+    return picked;
+}
+
+static gboolean
+_unref_dbus_manager_idle (gpointer data)
+{
+    g_object_unref (data);
+
+    return FALSE;
+}
+
+/*
+ * Drops the server reference to the client on the thread serving it,
+ * it might be handling a request right now.
+ */
+static void
+_release_dbus_manager (gpointer data)
+{
+    MsgPortDbusManager *dbus_manager = MSGPORT_DBUS_MANAGER (data);
+
+    g_main_context_invoke (msgport_dbus_manager_get_context (dbus_manager),
+            _unref_dbus_manager_idle, dbus_manager);
+}
+
 static void
 _set_property (GObject *object,
         guint property_id,
@@ -116,11 +237,24 @@ _dispose (GObject *object)
         g_clear_object (&self->priv->bus_server);
     }
 
+    g_mutex_lock (&self->priv->lock);
+    if (self->priv->app_id_index) {
+        g_hash_table_unref (self->priv->app_id_index);
+        self->priv->app_id_index = NULL;
+    }
+
     if (self->priv->dbus_managers) {
         g_hash_table_foreach (self->priv->dbus_managers, _clear_watchers, self);
         g_hash_table_unref (self->priv->dbus_managers);
         self->priv->dbus_managers = NULL;
     }
+    g_mutex_unlock (&self->priv->lock);
+
+    /* waits for the clients released above */
+    if (self->priv->workers) {
+        g_ptr_array_unref (self->priv->workers);
+        self->priv->workers = NULL;
+    }
 
     G_OBJECT_CLASS (msgport_dbus_server_parent_class)->dispose (object);
 }
@@ -135,6 +269,8 @@ _finalize (GObject *object)
         self->priv->address = NULL;
     }
 
+    g_mutex_clear (&self->priv->lock);
+
     G_OBJECT_CLASS (msgport_dbus_server_parent_class)->finalize (object);
 }
 
@@ -169,7 +305,67 @@ msgport_dbus_server_init (MsgPortDbusServer *self)
     self->priv->address = NULL;
 
     self->priv->dbus_managers = g_hash_table_new_full (
-        g_direct_hash, g_direct_equal, NULL, g_object_unref);
+        g_direct_hash, g_direct_equal, NULL, _release_dbus_manager);
+    self->priv->app_id_index = g_hash_table_new_full (
+        g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_queue_free);
+    g_mutex_init (&self->priv->lock);
+    self->priv->workers = g_ptr_array_new_with_free_func (_worker_free);
+}
+
+/*
+ * Expects the caller holds the lock
+ */
+static void
+_index_dbus_manager (MsgPortDbusServer *server, MsgPortDbusManager *dbus_manager)
+{
+    const gchar *app_id = msgport_dbus_manager_get_app_id (dbus_manager);
+    GQueue *managers = NULL;
+
+    if (!app_id) return;
+
+    managers = g_hash_table_lookup (server->priv->app_id_index, app_id);
+    if (!managers) {
+        managers = g_queue_new ();
+        g_hash_table_insert (server->priv->app_id_index, g_strdup (app_id), managers);
+    }
+
+    /* keep the connection order, so that lookups by app id are deterministic */
+    g_queue_push_tail (managers, dbus_manager);
+}
+
+static void
+_unindex_dbus_manager (MsgPortDbusServer *server, MsgPortDbusManager *dbus_manager)
+{
+    const gchar *app_id = msgport_dbus_manager_get_app_id (dbus_manager);
+    GQueue *managers = NULL;
+
+    if (!app_id || !server->priv->app_id_index) return;
+
+    managers = g_hash_table_lookup (server->priv->app_id_index, app_id);
+    if (!managers) return;
+
+    g_queue_remove (managers, dbus_manager);
+    if (g_queue_is_empty (managers))
+        g_hash_table_remove (server->priv->app_id_index, app_id);
+}
+
+/*
+ * Makes the client lookable by its app id, called once the dbus manager
+ * resolved the app id of its connection.
+ */
+void
+msgport_dbus_server_index_dbus_manager (MsgPortDbusServer *server, MsgPortDbusManager *dbus_manager)
+{
+    GDBusConnection *connection = msgport_dbus_manager_get_connection (dbus_manager);
+
+    g_return_if_fail (server && MSGPORT_IS_DBUS_SERVER (server));
+
+    g_mutex_lock (&server->priv->lock);
+    /* connection might be closed meanwhile */
+    if (server->priv->dbus_managers &&
+        g_hash_table_lookup (server->priv->dbus_managers, connection) == dbus_manager)
+        _index_dbus_manager (server, dbus_manager);
+    g_mutex_unlock (&server->priv->lock);
 }
 
 const gchar *
@@ -187,33 +383,134 @@ _on_connection_closed (GDBusConnection *connection,
                        gpointer         user_data)
 {
     MsgPortDbusServer *server = MSGPORT_DBUS_SERVER (user_data);
+    MsgPortDbusManager *dbus_manager = NULL;
+    MsgPortWorker *worker = NULL;
 
     g_signal_handlers_disconnect_by_func (connection, _on_connection_closed, user_data);
     DBG("dbus connection(%p) closed (peer vanished : %d) : %s",
             connection, remote_peer_vanished, error ? error->message : "unknwon reason");
 
-    g_hash_table_remove (server->priv->dbus_managers, connection);
+    if ((worker = g_object_get_data (G_OBJECT (connection), MSGPORT_WORKER_KEY)) != NULL)
+        g_atomic_int_add (&worker->n_connections, -1);
+
+    g_mutex_lock (&server->priv->lock);
+    dbus_manager = g_hash_table_lookup (server->priv->dbus_managers, connection);
+    if (dbus_manager) {
+        _unindex_dbus_manager (server, dbus_manager);
+        g_hash_table_steal (server->priv->dbus_managers, connection);
+    }
+    g_mutex_unlock (&server->priv->lock);
+
+    if (dbus_manager) _release_dbus_manager (dbus_manager);
+}
+
+/*
+ * Creation of a dbus manager handed over to a worker
+ */
+typedef struct {
+    MsgPortDbusServer  *server;
+    GDBusConnection    *connection;
+    const gchar        *peer_app_id;
+    MsgPortDbusManager *dbus_manager;
+    GError             *error;
+    gboolean            done;
+    GMutex              lock;
+    GCond               cond;
+} DbusManagerStart;
+
+static gboolean
+_create_dbus_manager_in_worker (gpointer data)
+{
+    DbusManagerStart *start = (DbusManagerStart *)data;
+    MsgPortDbusManager *dbus_manager = NULL;
+    GError *error = NULL;
+
+    /* the worker context is the thread default here */
+    dbus_manager = msgport_dbus_manager_new (
+        start->connection, start->server, start->peer_app_id, &error);
+
+    g_mutex_lock (&start->lock);
+    start->dbus_manager = dbus_manager;
+    start->error = error;
+    start->done = TRUE;
+    g_cond_signal (&start->cond);
+    g_mutex_unlock (&start->lock);
+
+    return FALSE;
+}
+
+/*
+ * Creates the dbus manager on the worker thread, so that its objects are
+ * exported and the client requests dispatched there. Waits for it, the
+ * connection starts processing messages once this returns.
+ */
+static MsgPortDbusManager *
+_create_dbus_manager_on_worker (
+    MsgPortDbusServer *server,
+    MsgPortWorker *worker,
+    GDBusConnection *connection,
+    const gchar *peer_app_id,
+    GError **error)
+{
+    DbusManagerStart start = { server, connection, peer_app_id, NULL, NULL, FALSE };
+
+    g_mutex_init (&start.lock);
+    g_cond_init (&start.cond);
+
+    g_main_context_invoke (worker->context, _create_dbus_manager_in_worker, &start);
+
+    g_mutex_lock (&start.lock);
+    while (!start.done)
+        g_cond_wait (&start.cond, &start.lock);
+    g_mutex_unlock (&start.lock);
+
+    g_mutex_clear (&start.lock);
+    g_cond_clear (&start.cond);
+
+    if (start.error) g_propagate_error (error, start.error);
+
+    return start.dbus_manager;
 }
 
+/*
+ * Serves the client on the connection, peer_app_id is used for the
+ * in-process peers whose app id can not be resolved from the
+ * connection credentials, NULL otherwise.
+ */
 void
 msgport_dbus_server_start_dbus_manager_for_connection (
     MsgPortDbusServer *server,
-    GDBusConnection *connection)
+    GDBusConnection *connection,
+    const gchar *peer_app_id)
 {
     MsgPortDbusManager *dbus_manager = NULL;
+    MsgPortWorker *worker = NULL;
     GError *error = NULL;
 
     DBG("Starting dbus manager on connection %p", connection);
 
-    dbus_manager = msgport_dbus_manager_new (
-        connection, server, &error);
+    /* client requests are dispatched on the context the objects are exported */
+    worker = _pick_worker (server);
+    if (worker)
+        dbus_manager = _create_dbus_manager_on_worker (server, worker, connection, peer_app_id, &error);
+    else
+        dbus_manager = msgport_dbus_manager_new (connection, server, peer_app_id, &error);
+
     if (!dbus_manager) {
         WARN ("Could not create dbus manager on conneciton %p: %s", connection, error->message);
         g_error_free (error);
         return;
     }
 
+    if (worker) {
+        g_atomic_int_inc (&worker->n_connections);
+        g_object_set_data (G_OBJECT (connection), MSGPORT_WORKER_KEY, worker);
+    }
+
+    /* indexed by app id once its resolved, see msgport_dbus_server_index_dbus_manager */
+    g_mutex_lock (&server->priv->lock);
     g_hash_table_insert (server->priv->dbus_managers, connection, dbus_manager);
+    g_mutex_unlock (&server->priv->lock);
 
     g_signal_connect (connection, "closed", G_CALLBACK(_on_connection_closed), server);
 }
@@ -225,7 +522,7 @@ _on_client_request (GDBusServer *dbus_server, GDBusConnection *connection, gpoin
     
     g_return_val_if_fail (server && MSGPORT_IS_DBUS_SERVER (server), FALSE);
 
-    msgport_dbus_server_start_dbus_manager_for_connection (server, connection);
+    msgport_dbus_server_start_dbus_manager_for_connection (server, connection, NULL);
 
     return TRUE;
 }
@@ -300,28 +597,86 @@ _start_bus_server (MsgPortDbusServer *server)
 MsgPortDbusServer *
 msgport_dbus_server_new () {
     MsgPortDbusServer *server = NULL;
+    guint n_workers, i;
     
     server = MSGPORT_DBUS_SERVER (g_object_new (MSGPORT_TYPE_DBUS_SERVER, NULL));
 
+    n_workers = _get_worker_count ();
+    for (i = 0; i < n_workers; i++)
+        g_ptr_array_add (server->priv->workers, _worker_new (i));
+    if (n_workers) DBG ("Serving clients on %u worker threads", n_workers);
+
    _start_bus_server (server);
 
     return server;
 }
 
-static gboolean
-_find_dbus_manager_by_app_id (
-    GDBusConnection *key,
-    MsgPortDbusManager *value,
-    const gchar *app_id_to_find)
+/*
+ * Returns a new reference to the dbus manager of the first connected
+ * client with given app id
+ */
+MsgPortDbusManager *
+msgport_dbus_server_get_dbus_manager_by_app_id (MsgPortDbusServer *server, const gchar *app_id)
+{
+    GQueue *managers = NULL;
+    MsgPortDbusManager *dbus_manager = NULL;
+
+    g_return_val_if_fail (server && MSGPORT_IS_DBUS_SERVER (server), NULL);
+
+    g_mutex_lock (&server->priv->lock);
+    if (server->priv->app_id_index &&
+        (managers = g_hash_table_lookup (server->priv->app_id_index, app_id)) != NULL)
+        dbus_manager = g_object_ref (g_queue_peek_head (managers));
+    g_mutex_unlock (&server->priv->lock);
+
+    return dbus_manager;
+}
+
+/*
+ * Returns the dbus managers of all the connected clients, the list
+ * holds references, free it with g_list_free_full (list, g_object_unref).
+ */
+GList *
+msgport_dbus_server_get_dbus_managers (MsgPortDbusServer *server)
 {
-    return !g_strcmp0 (msgport_dbus_manager_get_app_id (value), app_id_to_find);
+    GHashTableIter iter;
+    gpointer dbus_manager = NULL;
+    GList *res = NULL;
+
+    g_return_val_if_fail (server && MSGPORT_IS_DBUS_SERVER (server), NULL);
+
+    g_mutex_lock (&server->priv->lock);
+    if (server->priv->dbus_managers) {
+        g_hash_table_iter_init (&iter, server->priv->dbus_managers);
+        while (g_hash_table_iter_next (&iter, NULL, &dbus_manager))
+            res = g_list_prepend (res, g_object_ref (dbus_manager));
+    }
+    g_mutex_unlock (&server->priv->lock);
+
+    return res;
 }
 
-MsgPortDbusManager *
-msgport_dbus_server_get_dbus_manager_by_app_id (MsgPortDbusServer *server, const gchar *app_id)
+/*
+ * Returns the dbus managers of all the clients with given app id, in
+ * the order they connected. Clients might go away on other threads,
+ * so the list holds references, free it with g_list_free_full (list, g_object_unref).
+ */
+GList *
+msgport_dbus_server_get_dbus_managers_by_app_id (MsgPortDbusServer *server, const gchar *app_id)
 {
+    GQueue *managers = NULL;
+    GList *res = NULL;
+    GList *item = NULL;
+
     g_return_val_if_fail (server && MSGPORT_IS_DBUS_SERVER (server), NULL);
 
-    return (MsgPortDbusManager *)g_hash_table_find (server->priv->dbus_managers,
-            (GHRFunc)_find_dbus_manager_by_app_id, (gpointer)app_id);
+    g_mutex_lock (&server->priv->lock);
+    if (server->priv->app_id_index &&
+        (managers = g_hash_table_lookup (server->priv->app_id_index, app_id)) != NULL) {
+        for (item = managers->tail; item; item = item->prev)
+            res = g_list_prepend (res, g_object_ref (item->data));
+    }
+    g_mutex_unlock (&server->priv->lock);
+
+    return res;
 }
@@ -29,6 +29,7 @@
 #include <config.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -70,4 +71,18 @@ MsgPortManager    * msgport_dbus_server_get_manager (MsgPortDbusServer *server);
 MsgPortDbusManager *
 msgport_dbus_server_get_dbus_manager_by_app_id (MsgPortDbusServer *server, const gchar *app_id);
 
+GList *
+msgport_dbus_server_get_dbus_managers_by_app_id (MsgPortDbusServer *server, const gchar *app_id);
+
+GList *
+msgport_dbus_server_get_dbus_managers (MsgPortDbusServer *server);
+
+void
+msgport_dbus_server_start_dbus_manager_for_connection (MsgPortDbusServer *server,
+                                                       GDBusConnection *connection,
+                                                       const gchar *peer_app_id);
+
+void
+msgport_dbus_server_index_dbus_manager (MsgPortDbusServer *server, MsgPortDbusManager *dbus_manager);
+
 #endif /* __MSGPORT_DBUS_SERVER_H */
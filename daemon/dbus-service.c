@@ -23,32 +23,102 @@
  * 02110-1301 USA
  */
 
+#include "config.h"
+
 #include "dbus-service.h"
 #include "common/dbus-service-glue.h"
 #include "common/dbus-error.h"
 #include "common/log.h"
 #include "manager.h"
+#include "outbox.h"
+#include "stats.h"
 #include "utils.h"
 
+#include <fcntl.h>
+#include <gio/gunixfdlist.h>
+
 G_DEFINE_TYPE (MsgPortDbusService, msgport_dbus_service, G_TYPE_OBJECT)
 
 #define MSGPORT_DBUS_SERVICE_GET_PRIV(obj) \
     G_TYPE_INSTANCE_GET_PRIVATE ((obj), MSGPORT_TYPE_DBUS_SERVICE, MsgPortDbusServicePrivate)
 
+#define MSGPORT_DBUS_SERVICE_INTERFACE "org.tizen.messageport.Service"
+
 struct _MsgPortDbusServicePrivate {
     guint                   id;
     MsgPortDbusGlueService *dbus_skeleton;
-    MsgPortDbusManager     *owner;
+    MsgPortDbusManager     *owner; /* not owned, safe to use only on the owner's thread */
+    GWeakRef                owner_ref; /* for the other threads delivering messages */
+    GDBusConnection        *connection;
+    gchar                  *app_id; /* owner app id */
+    gchar                  *object_path;
     gchar                  *port_name;
     gboolean                is_trusted;
+    GHashTable             *watchers; /* {MsgPortDbusManager*:GWeakRef*} clients resolved this service */
+    GMutex                  watchers_lock; /* watchers are added from the clients' threads */
+
+    MsgPortOutbox          *outbox; /* shared by the owner's ports */
+    MsgPortPriority         priority;
+    MsgPortTraffic          received; /* messages sent to this port */
 };
 
+static GWeakRef *
+_watcher_ref_new (MsgPortDbusManager *watcher)
+{
+    GWeakRef *ref = g_slice_new (GWeakRef);
+
+    g_weak_ref_init (ref, watcher);
+
+    return ref;
+}
+
+static void
+_watcher_ref_free (gpointer data)
+{
+    GWeakRef *ref = (GWeakRef *)data;
+
+    g_weak_ref_clear (ref);
+    g_slice_free (GWeakRef, ref);
+}
+
+static gboolean
+_watcher_is_gone (gpointer key, gpointer value, gpointer userdata)
+{
+    GObject *watcher = g_weak_ref_get ((GWeakRef *)value);
+
+    if (!watcher) return TRUE;
+
+    g_object_unref (watcher);
+    return FALSE;
+}
+
+static void
+_dbus_service_notify_watcher (gpointer key, gpointer value, gpointer userdata)
+{
+    MsgPortDbusService *dbus_service = MSGPORT_DBUS_SERVICE (userdata);
+    MsgPortDbusManager *watcher = g_weak_ref_get ((GWeakRef *)value);
+
+    if (!watcher) return;
+
+    msgport_dbus_manager_notify_remote_service_unregistered (watcher, dbus_service->priv->id);
+    g_object_unref (watcher);
+}
 
 static void
 _dbus_service_finalize (GObject *self)
 {
     MsgPortDbusService *dbus_service = MSGPORT_DBUS_SERVICE (self);
 
+    g_free (dbus_service->priv->object_path);
+    dbus_service->priv->object_path = NULL;
+
+    g_free (dbus_service->priv->app_id);
+    dbus_service->priv->app_id = NULL;
+
+    g_weak_ref_clear (&dbus_service->priv->owner_ref);
+
+    g_mutex_clear (&dbus_service->priv->watchers_lock);
+
     G_OBJECT_CLASS (msgport_dbus_service_parent_class)->finalize (self);
 }
 
@@ -56,6 +126,8 @@ static void
 _dbus_service_dispose (GObject *self)
 {
     MsgPortDbusService *dbus_service = MSGPORT_DBUS_SERVICE (self);
+    GHashTable *watchers = NULL;
+
     DBG ("Unregistering service '%s'", dbus_service->priv->port_name);
     if (dbus_service->priv->dbus_skeleton) {
         g_dbus_interface_skeleton_unexport (
@@ -63,6 +135,26 @@ _dbus_service_dispose (GObject *self)
         g_clear_object (&dbus_service->priv->dbus_skeleton);
     }
 
+    if (dbus_service->priv->outbox) {
+        GError *error = msgport_error_new (MSGPORT_ERROR_NOT_FOUND, "port unregistered before delivery");
+        msgport_outbox_cancel_port (dbus_service->priv->outbox, dbus_service->priv->id, error);
+        g_error_free (error);
+        g_clear_object (&dbus_service->priv->outbox);
+    }
+
+    g_clear_object (&dbus_service->priv->connection);
+
+    /* let the clients drop their cached references to this service */
+    g_mutex_lock (&dbus_service->priv->watchers_lock);
+    watchers = dbus_service->priv->watchers;
+    dbus_service->priv->watchers = NULL;
+    g_mutex_unlock (&dbus_service->priv->watchers_lock);
+
+    if (watchers) {
+        g_hash_table_foreach (watchers, _dbus_service_notify_watcher, dbus_service);
+        g_hash_table_unref (watchers);
+    }
+
     G_OBJECT_CLASS (msgport_dbus_service_parent_class)->dispose (self);
 }
 
@@ -77,28 +169,72 @@ _dbus_service_handle_send_message (
 {
     MsgPortDbusService *peer_dbus_service = NULL;
     MsgPortManager *manager = NULL;
-    GError *error;
+    GError *error = NULL;
+    gpointer request = NULL;
 
     msgport_return_val_if_fail_with_error (dbus_service &&  MSGPORT_IS_DBUS_SERVICE (dbus_service), FALSE, &error);
 
     DBG ("Send Message rquest on service %p to remote service id : %d", dbus_service, remote_service_id);
+    request = msgport_dbus_manager_send_request_new (dbus_service->priv->owner, invocation, remote_service_id,
+            MSGPORT_STATS_HANDLER_SEND_MESSAGE);
+    msgport_dbus_manager_add_sent_traffic (dbus_service->priv->owner, g_variant_get_size (data));
     manager = msgport_dbus_manager_get_manager (dbus_service->priv->owner);
     peer_dbus_service = msgport_manager_get_service_by_id (manager, remote_service_id, &error);
 
-    if (peer_dbus_service) {
-        if (msgport_dbus_service_send_message (peer_dbus_service, data,
-                msgport_dbus_service_get_app_id (dbus_service),
-                dbus_service->priv->port_name,
-                dbus_service->priv->is_trusted, &error)) {
-            msgport_dbus_glue_service_complete_send_message (
-                    dbus_service->priv->dbus_skeleton, invocation);
+    if (!peer_dbus_service) {
+        if (!error) error = msgport_error_unknown_new ();
+        msgport_dbus_manager_send_request_complete (error, request);
+        g_error_free (error);
+        return TRUE;
+    }
+
+    msgport_dbus_service_send_message (peer_dbus_service, data,
+            msgport_dbus_service_get_app_id (dbus_service),
+            dbus_service->priv->port_name,
+            dbus_service->priv->is_trusted,
+            msgport_dbus_manager_send_request_complete, request);
+    g_object_unref (peer_dbus_service);
+
+    return TRUE;
+}
+
+static gboolean
+_dbus_service_handle_send_large_message (
+    MsgPortDbusService    *dbus_service,
+    GDBusMethodInvocation *invocation,
+    GUnixFDList           *fd_list,
+    guint                  remote_service_id,
+    gint                   payload,
+    gpointer               userdata)
+{
+    MsgPortDbusService *peer_dbus_service = NULL;
+    MsgPortManager *manager = NULL;
+    GError *error = NULL;
+    gpointer request = NULL;
+
+    msgport_return_val_if_fail_with_error (dbus_service &&  MSGPORT_IS_DBUS_SERVICE (dbus_service), FALSE, &error);
 
-            return TRUE;
-        }
+    DBG ("Send large message request on service %p to remote service id : %d", dbus_service, remote_service_id);
+    request = msgport_dbus_manager_send_request_new (dbus_service->priv->owner, invocation, remote_service_id,
+            MSGPORT_STATS_HANDLER_SEND_LARGE_MESSAGE);
+    msgport_dbus_manager_add_sent_traffic (dbus_service->priv->owner,
+            msgport_stats_get_payload_size (fd_list, payload));
+    manager = msgport_dbus_manager_get_manager (dbus_service->priv->owner);
+    peer_dbus_service = msgport_manager_get_service_by_id (manager, remote_service_id, &error);
+
+    if (!peer_dbus_service) {
+        if (!error) error = msgport_error_unknown_new ();
+        msgport_dbus_manager_send_request_complete (error, request);
+        g_error_free (error);
+        return TRUE;
     }
-    
-    if (!error) error = msgport_error_unknown_new ();
-    g_dbus_method_invocation_take_error (invocation, error);
+
+    msgport_dbus_service_send_large_message (peer_dbus_service, fd_list, payload,
+            msgport_dbus_service_get_app_id (dbus_service),
+            dbus_service->priv->port_name,
+            dbus_service->priv->is_trusted,
+            msgport_dbus_manager_send_request_complete, request);
+    g_object_unref (peer_dbus_service);
 
     return TRUE;
 }
@@ -123,11 +259,23 @@ msgport_dbus_service_init (MsgPortDbusService *self)
 
     priv->dbus_skeleton = msgport_dbus_glue_service_skeleton_new ();
     priv->owner = NULL;
+    g_weak_ref_init (&priv->owner_ref, NULL);
+    priv->connection = NULL;
+    priv->app_id = NULL;
     priv->id = 0;
+    priv->object_path = NULL;
     priv->port_name = NULL;
+    priv->watchers = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, _watcher_ref_free);
+    g_mutex_init (&priv->watchers_lock);
+    priv->outbox = NULL;
+    priv->priority = MSGPORT_PRIORITY_NORMAL;
+    priv->received.messages = 0;
+    priv->received.bytes = 0;
 
     g_signal_connect_swapped (priv->dbus_skeleton, "handle-send-message",
                 G_CALLBACK (_dbus_service_handle_send_message), (gpointer)self);
+    g_signal_connect_swapped (priv->dbus_skeleton, "handle-send-large-message",
+                G_CALLBACK (_dbus_service_handle_send_large_message), (gpointer)self);
     g_signal_connect_swapped (priv->dbus_skeleton, "handle-unregister",
                 G_CALLBACK (_dbus_service_handle_unregister), (gpointer)self);
 
@@ -145,17 +293,20 @@ msgport_dbus_service_class_init (MsgPortDbusServiceClass *klass)
     gklass->dispose = _dbus_service_dispose;
 }
 
+/*
+ * Service ids are given out by the manager, see msgport_manager_register_service()
+ */
 MsgPortDbusService *
-msgport_dbus_service_new (MsgPortDbusManager *owner, const gchar *name, gboolean is_trusted, GError **error)
+msgport_dbus_service_new (MsgPortDbusManager *owner, const gchar *name, gboolean is_trusted, MsgPortPriority priority, guint id, GError **error)
 {
-    static guint object_conter = 0;
-
     MsgPortDbusService *dbus_service = NULL;
     GDBusConnection *connection = NULL;
     gchar *object_path = 0;
 
     msgport_return_val_if_fail_with_error (owner && MSGPORT_IS_DBUS_MANAGER (owner), NULL, error);
     msgport_return_val_if_fail_with_error (name && name[0], NULL, error);
+    msgport_return_val_if_fail_with_error (id != 0, NULL, error);
+    msgport_return_val_if_fail_with_error (priority < MSGPORT_PRIORITY_LAST, NULL, error);
 
     connection = msgport_dbus_manager_get_connection (owner),
     dbus_service = MSGPORT_DBUS_SERVICE (g_object_new (MSGPORT_TYPE_DBUS_SERVICE, NULL));
@@ -164,7 +315,12 @@ msgport_dbus_service_new (MsgPortDbusManager *owner, const gchar *name, gboolean
         return NULL;
     }
     dbus_service->priv->owner = owner;
-    dbus_service->priv->id = object_conter + 1;
+    g_weak_ref_set (&dbus_service->priv->owner_ref, owner);
+    dbus_service->priv->connection = g_object_ref (connection);
+    dbus_service->priv->outbox = g_object_ref (msgport_dbus_manager_get_outbox (owner));
+    dbus_service->priv->priority = priority;
+    dbus_service->priv->app_id = g_strdup (msgport_dbus_manager_get_app_id (owner));
+    dbus_service->priv->id = id;
     dbus_service->priv->port_name = g_strdup (name);
     dbus_service->priv->is_trusted = is_trusted;
 
@@ -179,20 +335,19 @@ msgport_dbus_service_new (MsgPortDbusManager *owner, const gchar *name, gboolean
                     connection, error ? (*error)->message : "");
         g_object_unref (dbus_service);
         g_free (object_path);
-        object_conter--;
 
         return NULL;
     }
-    g_free (object_path);
+    /* kept for addressing the messages delivered to the owner */
+    dbus_service->priv->object_path = object_path;
 
     /* set dbus-properties */
     g_object_set (G_OBJECT (dbus_service->priv->dbus_skeleton), 
                             "id", dbus_service->priv->id,
                             "port-name", dbus_service->priv->port_name,
-                            "is-trusted", dbus_service->priv->is_trusted, NULL);
+                            "is-trusted", dbus_service->priv->is_trusted,
+                            "priority", (guint)dbus_service->priv->priority, NULL);
 
-    ++object_conter;
-    
     return dbus_service;
 }
 
@@ -218,7 +373,7 @@ msgport_dbus_service_get_connection (MsgPortDbusService *dbus_service)
 {
     g_return_val_if_fail (dbus_service && MSGPORT_IS_DBUS_SERVICE (dbus_service), NULL);
 
-    return msgport_dbus_manager_get_connection (dbus_service->priv->owner);
+    return dbus_service->priv->connection;
 }
 
 MsgPortDbusManager *
@@ -242,7 +397,7 @@ msgport_dbus_service_get_app_id (MsgPortDbusService *dbus_service)
 {
     g_return_val_if_fail (dbus_service && MSGPORT_IS_DBUS_SERVICE (dbus_service), NULL);
 
-    return msgport_dbus_manager_get_app_id (dbus_service->priv->owner);
+    return (const gchar *)dbus_service->priv->app_id;
 }
 
 gboolean
@@ -253,26 +408,269 @@ msgport_dbus_service_get_is_trusted (MsgPortDbusService *dbus_service)
     return dbus_service->priv->is_trusted;
 }
 
-gboolean
+MsgPortPriority
+msgport_dbus_service_get_priority (MsgPortDbusService *dbus_service)
+{
+    g_return_val_if_fail (dbus_service && MSGPORT_IS_DBUS_SERVICE (dbus_service), MSGPORT_PRIORITY_NORMAL);
+
+    return dbus_service->priv->priority;
+}
+
+void
+msgport_dbus_service_get_traffic (MsgPortDbusService *dbus_service, guint64 *messages, guint64 *bytes)
+{
+    g_return_if_fail (dbus_service && MSGPORT_IS_DBUS_SERVICE (dbus_service));
+
+    if (messages) *messages = msgport_traffic_get_messages (&dbus_service->priv->received);
+    if (bytes) *bytes = msgport_traffic_get_bytes (&dbus_service->priv->received);
+}
+
+void
+msgport_dbus_service_add_watcher (
+    MsgPortDbusService *dbus_service,
+    MsgPortDbusManager *watcher)
+{
+    g_return_if_fail (dbus_service && MSGPORT_IS_DBUS_SERVICE (dbus_service));
+    g_return_if_fail (watcher && MSGPORT_IS_DBUS_MANAGER (watcher));
+
+    g_mutex_lock (&dbus_service->priv->watchers_lock);
+
+    if (dbus_service->priv->watchers) {
+        /* forget the watchers went away, also covers reused addresses */
+        g_hash_table_foreach_remove (dbus_service->priv->watchers, _watcher_is_gone, NULL);
+        if (!g_hash_table_contains (dbus_service->priv->watchers, watcher))
+            g_hash_table_insert (dbus_service->priv->watchers, watcher, _watcher_ref_new (watcher));
+    }
+
+    g_mutex_unlock (&dbus_service->priv->watchers_lock);
+}
+
+/*
+ * Sends the given signal to the service owner. The owner is the only peer
+ * on this connection, so skip the skeleton's signal marshalling and hand
+ * the pre-addressed message to the owner's outbox, in the port's lane.
+ * #cb is called once the message is sent, see msgport_outbox_send().
+ */
+static void
+_dbus_service_deliver_and_notify (
+    MsgPortDbusService *dbus_service,
+    const gchar *signal_name,
+    GVariant *body,
+    GUnixFDList *fd_list,
+    MsgPortDbusServiceSendCallback cb,
+    gpointer userdata)
+{
+    GDBusMessage *message = NULL;
+
+    if (!dbus_service->priv->outbox) {
+        GError *error = msgport_error_new (MSGPORT_ERROR_NOT_FOUND, "port unregistered before delivery");
+        g_variant_unref (g_variant_ref_sink (body));
+        if (cb) cb (error, userdata);
+        g_error_free (error);
+        return;
+    }
+
+    message = g_dbus_message_new_signal (dbus_service->priv->object_path,
+                    MSGPORT_DBUS_SERVICE_INTERFACE, signal_name);
+    g_dbus_message_set_body (message, body);
+    if (fd_list) g_dbus_message_set_unix_fd_list (message, fd_list);
+
+    msgport_outbox_send (dbus_service->priv->outbox, message, dbus_service->priv->id,
+            dbus_service->priv->priority, (MsgPortOutboxCallback)cb, userdata);
+    g_object_unref (message);
+}
+
+/*
+ * Message waiting for the peer certificate validation
+ */
+typedef struct {
+    GWeakRef                       dbus_service; /* thread safe weak reference */
+    const gchar                   *signal_name;
+    GVariant                      *body;
+    GUnixFDList                   *fd_list;
+    MsgPortDbusServiceSendCallback cb;
+    gpointer                       userdata;
+} PendingDelivery;
+
+static void
+_on_peer_certificate_validated (gboolean is_valid, gpointer userdata)
+{
+    PendingDelivery *pending = (PendingDelivery *)userdata;
+    MsgPortDbusService *dbus_service = g_weak_ref_get (&pending->dbus_service);
+    GError *error = NULL;
+
+    if (!dbus_service)
+        error = msgport_error_new (MSGPORT_ERROR_NOT_FOUND, "port unregistered before delivery");
+    else if (!is_valid)
+        error = msgport_error_certificate_mismatch_new ();
+
+    if (error) {
+        if (pending->cb) pending->cb (error, pending->userdata);
+        g_error_free (error);
+    }
+    else {
+        _dbus_service_deliver_and_notify (dbus_service, pending->signal_name,
+                pending->body, pending->fd_list, pending->cb, pending->userdata);
+    }
+
+    if (dbus_service) g_object_unref (dbus_service);
+    g_weak_ref_clear (&pending->dbus_service);
+    g_variant_unref (pending->body);
+    if (pending->fd_list) g_object_unref (pending->fd_list);
+    g_slice_free (PendingDelivery, pending);
+}
+
+/*
+ * Trusted ports accept messages only from the applications signed with the
+ * same certificate. Certificate check may not be cached yet, in that case
+ * the message is queued until the check is done, without blocking others.
+ */
+static void
+_dbus_service_send (
+    MsgPortDbusService *dbus_service,
+    const gchar *signal_name,
+    GVariant *body,
+    GUnixFDList *fd_list,
+    const gchar *r_app_id,
+    MsgPortDbusServiceSendCallback cb,
+    gpointer userdata)
+{
+    PendingDelivery *pending = NULL;
+    MsgPortDbusManager *owner = NULL;
+
+    if (!dbus_service->priv->is_trusted) {
+        _dbus_service_deliver_and_notify (dbus_service, signal_name, body, fd_list, cb, userdata);
+        return;
+    }
+
+    /* sender might be served on other thread than the owner */
+    owner = g_weak_ref_get (&dbus_service->priv->owner_ref);
+    if (!owner) {
+        GError *error = msgport_error_new (MSGPORT_ERROR_NOT_FOUND, "port unregistered before delivery");
+        g_variant_unref (g_variant_ref_sink (body));
+        if (cb) cb (error, userdata);
+        g_error_free (error);
+        return;
+    }
+
+    pending = g_slice_new0 (PendingDelivery);
+    g_weak_ref_init (&pending->dbus_service, dbus_service);
+    pending->signal_name = signal_name;
+    pending->body = g_variant_ref_sink (body);
+    pending->fd_list = fd_list ? g_object_ref (fd_list) : NULL;
+    pending->cb = cb;
+    pending->userdata = userdata;
+
+    msgport_dbus_manager_validate_peer_certificate (owner, r_app_id,
+            _on_peer_certificate_validated, pending);
+    g_object_unref (owner);
+}
+
+void
 msgport_dbus_service_send_message (
     MsgPortDbusService *dbus_service,
     GVariant *data,
     const gchar *r_app_id,
     const gchar *r_port,
     gboolean r_is_trusted,
-    GError **error)
+    MsgPortDbusServiceSendCallback cb,
+    gpointer userdata)
+{
+    if (!dbus_service || !MSGPORT_IS_DBUS_SERVICE (dbus_service)) {
+        GError *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "invalid service");
+        if (cb) cb (error, userdata);
+        g_error_free (error);
+        g_return_if_reached ();
+    }
+
+    DBG ("Sending message to %p from ('%s':'%s':%d)", dbus_service, r_app_id, r_port, r_is_trusted);
+
+    msgport_traffic_add (&dbus_service->priv->received, g_variant_get_size (data));
+
+    _dbus_service_send (dbus_service, "onMessage",
+            g_variant_new ("(@a{sv}ssb)", data, r_app_id, r_port, r_is_trusted), NULL,
+            r_app_id, cb, userdata);
+}
+
+/*
+ * Checks that the payload fd is a memfd sealed against any modification,
+ * so that the receiver can safely map it while the sender still holds it.
+ */
+static gboolean
+_dbus_service_validate_payload (gint fd, GError **error)
 {
-    msgport_return_val_if_fail_with_error (dbus_service && MSGPORT_IS_DBUS_SERVICE (dbus_service), FALSE, error);
+#ifdef F_GET_SEALS
+    const int required_seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+    int seals = fcntl (fd, F_GET_SEALS);
 
-    if (dbus_service->priv->is_trusted &&
-        !msgport_dbus_manager_validate_peer_certificate (dbus_service->priv->owner, r_app_id)) {
-        if (error) *error = msgport_error_certificate_mismatch_new ();
+    if (seals < 0 || (seals & required_seals) != required_seals) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "payload is not sealed");
         return FALSE;
     }
 
-    DBG ("Sending message to %p from ('%s':'%s':%d)", dbus_service, r_app_id, r_port, r_is_trusted);
-    msgport_dbus_glue_service_emit_on_message (dbus_service->priv->dbus_skeleton, data, r_app_id, r_port, r_is_trusted);
- 
     return TRUE;
+#else
+    if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "large payloads not supported");
+    return FALSE;
+#endif
+}
+
+void
+msgport_dbus_service_send_large_message (
+    MsgPortDbusService *dbus_service,
+    GUnixFDList *fd_list,
+    gint payload,
+    const gchar *r_app_id,
+    const gchar *r_port,
+    gboolean r_is_trusted,
+    MsgPortDbusServiceSendCallback cb,
+    gpointer userdata)
+{
+    GUnixFDList *payload_fd_list = NULL;
+    const gint *fds = NULL;
+    gint n_fds = 0;
+    GError *error = NULL;
+
+    if (!dbus_service || !MSGPORT_IS_DBUS_SERVICE (dbus_service) || !fd_list) {
+        error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "invalid service or payload");
+        if (cb) cb (error, userdata);
+        g_error_free (error);
+        g_return_if_reached ();
+    }
+
+    /* anything besides the payload would be injected into the receiver */
+    fds = g_unix_fd_list_peek_fds (fd_list, &n_fds);
+    if (n_fds != 1)
+        error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "expected a single payload fd, got %d", n_fds);
+    else if (payload != 0)
+        error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "invalid payload handle %d", payload);
+    else
+        _dbus_service_validate_payload (fds[payload], &error);
+
+    if (error) {
+        if (cb) cb (error, userdata);
+        g_error_free (error);
+        return;
+    }
+
+    DBG ("Sending large message to %p from ('%s':'%s':%d)", dbus_service, r_app_id, r_port, r_is_trusted);
+
+    msgport_traffic_add (&dbus_service->priv->received, msgport_stats_get_payload_size (fd_list, payload));
+
+    /* forward only the validated fd, payload bytes are never touched by the daemon */
+    payload_fd_list = g_unix_fd_list_new ();
+    if (g_unix_fd_list_append (payload_fd_list, fds[payload], &error) < 0) {
+        GError *forward_error = msgport_error_new (MSGPORT_ERROR_IO_ERROR, "fail to forward payload : %s", error->message);
+        if (cb) cb (forward_error, userdata);
+        g_error_free (forward_error);
+        g_error_free (error);
+        g_object_unref (payload_fd_list);
+        return;
+    }
+
+    _dbus_service_send (dbus_service, "onLargeMessage",
+            g_variant_new ("(hssb)", 0, r_app_id, r_port, r_is_trusted), payload_fd_list,
+            r_app_id, cb, userdata);
+    g_object_unref (payload_fd_list);
 }
 
@@ -28,8 +28,10 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib-object.h>
 #include "dbus-manager.h"
+#include "outbox.h"
 
 G_BEGIN_DECLS
 
@@ -56,12 +58,20 @@ struct _MsgPortDbusServiceClass
     GObjectClass parenet_class;
 };
 
+/*
+ * Called with the message delivery result, error is NULL on success.
+ * It might be called before the send function returns.
+ */
+typedef void (*MsgPortDbusServiceSendCallback) (const GError *error, gpointer userdata);
+
 GType msgport_dbus_service_get_type (void);
 
 MsgPortDbusService *
 msgport_dbus_service_new (MsgPortDbusManager *owner,
                           const gchar *name,
                           gboolean is_trusted,
+                          MsgPortPriority priority,
+                          guint id,
                           GError **error_out);
 
 const gchar *
@@ -85,13 +95,36 @@ msgport_dbus_service_get_port_name (MsgPortDbusService *dbus_service);
 gboolean
 msgport_dbus_service_get_is_trusted (MsgPortDbusService *dbus_service);
 
-gboolean
+MsgPortPriority
+msgport_dbus_service_get_priority (MsgPortDbusService *dbus_service);
+
+void
+msgport_dbus_service_get_traffic (MsgPortDbusService *dbus_service,
+                                  guint64 *messages,
+                                  guint64 *bytes);
+
+void
+msgport_dbus_service_add_watcher (MsgPortDbusService *dbus_service,
+                                  MsgPortDbusManager *watcher);
+
+void
 msgport_dbus_service_send_message (MsgPortDbusService *dbus_service,
                                    GVariant    *data,
                                    const gchar *remote_app_id,
                                    const gchar *remote_port_name,
                                    gboolean     remote_is_trusted,
-                                   GError     **error_out);
+                                   MsgPortDbusServiceSendCallback cb,
+                                   gpointer     userdata);
+
+void
+msgport_dbus_service_send_large_message (MsgPortDbusService *dbus_service,
+                                         GUnixFDList *fd_list,
+                                         gint         payload,
+                                         const gchar *remote_app_id,
+                                         const gchar *remote_port_name,
+                                         gboolean     remote_is_trusted,
+                                         MsgPortDbusServiceSendCallback cb,
+                                         gpointer     userdata);
 
 G_END_DECLS
 
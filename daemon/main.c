@@ -33,10 +33,19 @@
 #include "utils.h"
 #endif
 #include "dbus-server.h"
+#ifdef USE_WEBSOCKET
+#include "server-socket.h"
+
+/* overridden with MESSAGEPORT_WEBSOCKET_PORT, 0 disables */
+#define MESSAGEPORT_WEBSOCKET_DEFAULT_PORT 0
+#endif
 
 typedef struct {
     GMainLoop             *m_loop;
     MsgPortDbusServer     *server;
+#ifdef USE_WEBSOCKET
+    MsgPortServerSocket   *server_socket;
+#endif
 #ifdef USE_SESSION_BUS
     MsgPortDbusGlueServer *dbus_skeleten;
 #endif
@@ -52,6 +61,9 @@ static void
 daemon_data_free (DaemonData *data)
 {
     if (!data) return;
+#ifdef USE_WEBSOCKET
+    if (data->server_socket) g_clear_object (&data->server_socket);
+#endif
     if (data->server) g_clear_object (&data->server);
 #ifdef USE_SESSION_BUS
     if (data->dbus_skeleten) {
@@ -65,6 +77,38 @@ daemon_data_free (DaemonData *data)
     g_slice_free (DaemonData, data);
 }
 
+#ifdef USE_WEBSOCKET
+static void
+_start_server_socket (DaemonData *data)
+{
+    const gchar *env = g_getenv ("MESSAGEPORT_WEBSOCKET_PORT");
+    guint port = env ? (guint) g_ascii_strtoull (env, NULL, 10) : MESSAGEPORT_WEBSOCKET_DEFAULT_PORT;
+    gchar **origins = NULL;
+    GError *error = NULL;
+
+    if (!port) return;
+
+    /* comma separated origins the web clients may connect from */
+    env = g_getenv ("MESSAGEPORT_WEBSOCKET_ORIGINS");
+    origins = g_strsplit (env ? env : "", ",", -1);
+    if (!origins[0] || !origins[0][0]) {
+        WARN ("Not serving web clients on port %u, MESSAGEPORT_WEBSOCKET_ORIGINS is not set", port);
+        g_strfreev (origins);
+        return;
+    }
+
+    /* native clients are still served without it */
+    data->server_socket = msgport_server_socket_new (data->server, port,
+            (const gchar * const *)origins, &error);
+    if (!data->server_socket) {
+        WARN ("Failed to serve web clients : %s", error->message);
+        g_error_free (error);
+    }
+
+    g_strfreev (origins);
+}
+#endif
+
 #ifdef USE_SESSION_BUS
 static gboolean
 _handle_get_bus_address (DaemonData *data,
@@ -99,6 +143,9 @@ _on_bus_acquired (GDBusConnection *connection,
     GError *error = NULL;
 
     data->server = msgport_dbus_server_new ();
+#ifdef USE_WEBSOCKET
+    _start_server_socket (data);
+#endif
  
     data->dbus_skeleten = msgport_dbus_glue_server_skeleton_new ();
 
@@ -166,6 +213,9 @@ int main (int argc, char *argv[])
         daemon_data_free (data);
         return (-1);
     }
+#ifdef USE_WEBSOCKET
+    _start_server_socket (data);
+#endif
 #endif /* USE_SESSION_BUS */
 
     data->m_loop = g_main_loop_new (NULL, FALSE);
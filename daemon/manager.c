@@ -30,30 +30,255 @@
 #include "dbus-service.h"
 #include "utils.h"
 
+#include <string.h>
+
 G_DEFINE_TYPE (MsgPortManager, msgport_manager, G_TYPE_OBJECT)
 
 #define MSGPORT_MANAGER_GET_PRIV(obj) \
     G_TYPE_INSTANCE_GET_PRIVATE ((obj), MSGPORT_TYPE_MANAGER, MsgPortManagerPrivate)
 
+/*
+ * Service id is made of a slot index and the generation of the slot, so
+ * that the slots of unregistered services can be reused, while the ids
+ * still held by clients do not match the new service.
+ * Slot 0 is never used, so that 0 is never a valid id. Ids stay within
+ * G_MAXINT, clients hold them as int, and a slot whose generation is
+ * used up is retired rather than wrapped, so that an id is never reused.
+ */
+#define SERVICE_ID_SLOT_BITS   20
+#define SERVICE_ID_SLOT_MASK   ((1u << SERVICE_ID_SLOT_BITS) - 1)
+#define SERVICE_ID_GEN_MASK    ((guint)G_MAXINT >> SERVICE_ID_SLOT_BITS)
+#define SERVICE_ID_MAKE(gen, slot) (((gen) << SERVICE_ID_SLOT_BITS) | (slot))
+#define SERVICE_ID_SLOT(id)    ((id) & SERVICE_ID_SLOT_MASK)
+
 struct _MsgPortManagerPrivate {
     /*
-     * Key :   guint - Id of the service
-     * Value : MsgPortDbusService * (transfe full)
+     * Index : slot of the service id
+     * Value : MsgPortDbusService * (transfe full), NULL for free slots
      */
-    GHashTable *service_cache; /* {service_id,MsgPortDbusService} */
+    GPtrArray  *service_cache;
+    GArray     *generations; /* guint, current generation of each slot */
+    GQueue      free_slots;  /* oldest freed first, delays the reuse of a slot */
 
     /*
      * Holds services owned by a client 
      * Key : MsgPortDbusManager *
-     * Value : GList<MsgPortDbusService *> (tranfer none)
+     * Value : GHashTable {ServiceKey*, MsgPortDbusService *(transfer none)}
+     */
+    GHashTable *owner_service_map; /* {MsgPortDbusManager*,{ServiceKey*,MsgPortDbusService*}} */
+
+    /*
+     * Clients might be served on several threads, lookups happen on
+     * every message where as (un)registrations are rare.
+     */
+    GRWLock     lock;
+
+    /*
+     * Read only copy of service_cache for lock free lookups by id, see
+     * msgport_manager_get_service_by_id(). Replaced on every change, old
+     * copy is freed once no reader could be looking at it.
      */
-    GHashTable *owner_service_map; /* {MsgPortDbusManager*,GList[MsgPortDbusService]} */
+    gpointer    services_by_id; /* ServiceTable* */
+    gint        epoch;
+    gint        readers[2]; /* readers in progress, per epoch parity */
 };
 
+/*
+ * Services indexed by slot of their id
+ */
+typedef struct {
+    guint               n_slots;
+    MsgPortDbusService *slots[1];
+} ServiceTable;
+
+/*
+ * Key of per owner service index : (port_name, is_trusted)
+ */
+typedef struct {
+    gchar   *port_name;
+    gboolean is_trusted;
+} ServiceKey;
+
+static ServiceKey *
+_service_key_new (const gchar *port_name, gboolean is_trusted)
+{
+    ServiceKey *key = g_slice_new (ServiceKey);
+
+    key->port_name = g_strdup (port_name);
+    key->is_trusted = is_trusted != FALSE;
+
+    return key;
+}
+
+static void
+_service_key_free (gpointer data)
+{
+    ServiceKey *key = (ServiceKey *)data;
+
+    g_free (key->port_name);
+    g_slice_free (ServiceKey, key);
+}
+
+static guint
+_service_key_hash (gconstpointer data)
+{
+    const ServiceKey *key = (const ServiceKey *)data;
+
+    return g_str_hash (key->port_name) ^ (guint)key->is_trusted;
+}
+
+static gboolean
+_service_key_equal (gconstpointer a, gconstpointer b)
+{
+    const ServiceKey *k1 = (const ServiceKey *)a;
+    const ServiceKey *k2 = (const ServiceKey *)b;
+
+    return k1->is_trusted == k2->is_trusted && !g_strcmp0 (k1->port_name, k2->port_name);
+}
+
+static ServiceTable *
+_service_table_new (GPtrArray *service_cache)
+{
+    ServiceTable *table = NULL;
+
+    if (!service_cache || !service_cache->len) return NULL;
+
+    table = g_malloc (G_STRUCT_OFFSET (ServiceTable, slots) +
+                      service_cache->len * sizeof (MsgPortDbusService *));
+    table->n_slots = service_cache->len;
+    memcpy (table->slots, service_cache->pdata, service_cache->len * sizeof (MsgPortDbusService *));
+
+    return table;
+}
+
+/*
+ * Waits until the readers, that might have seen the previous table, are done.
+ * New readers check the epoch after announcing them, so they either see the
+ * new table or retry on the other counter.
+ */
+static void
+_service_table_synchronize (MsgPortManagerPrivate *priv)
+{
+    gint epoch = g_atomic_int_get (&priv->epoch);
+
+    g_atomic_int_set (&priv->epoch, epoch + 1);
+
+    while (g_atomic_int_get (&priv->readers[epoch & 1]) > 0)
+        g_thread_yield ();
+}
+
+/*
+ * Publishes the current state of service_cache to the readers,
+ * expects the caller holds the writer lock. The services removed
+ * from service_cache can be released once this returns.
+ */
+static void
+_service_table_publish (MsgPortManagerPrivate *priv)
+{
+    ServiceTable *old_table = (ServiceTable *)priv->services_by_id;
+
+    g_atomic_pointer_set (&priv->services_by_id, _service_table_new (priv->service_cache));
+    _service_table_synchronize (priv);
+
+    g_free (old_table);
+}
+
+/*
+ * Returns a new reference to the service with given id, never blocks.
+ */
+static MsgPortDbusService *
+_service_table_lookup (MsgPortManagerPrivate *priv, guint service_id)
+{
+    ServiceTable *table = NULL;
+    MsgPortDbusService *dbus_service = NULL;
+    gint epoch;
+
+    for (;;) {
+        epoch = g_atomic_int_get (&priv->epoch);
+        g_atomic_int_inc (&priv->readers[epoch & 1]);
+        if (g_atomic_int_get (&priv->epoch) == epoch) break;
+        /* writer flipped meanwhile, it might not wait for us */
+        g_atomic_int_add (&priv->readers[epoch & 1], -1);
+    }
+
+    table = (ServiceTable *)g_atomic_pointer_get (&priv->services_by_id);
+    if (table && SERVICE_ID_SLOT (service_id) < table->n_slots)
+        dbus_service = table->slots[SERVICE_ID_SLOT (service_id)];
+    /* stale id of a reused slot */
+    if (dbus_service && msgport_dbus_service_get_id (dbus_service) != service_id)
+        dbus_service = NULL;
+    if (dbus_service) g_object_ref (dbus_service);
+
+    g_atomic_int_add (&priv->readers[epoch & 1], -1);
+
+    return dbus_service;
+}
+
+/*
+ * Reserves a slot for a new service and returns its id, 0 if ran out of slots.
+ * Expects the caller holds the writer lock.
+ */
+static guint
+_service_id_alloc (MsgPortManagerPrivate *priv)
+{
+    guint slot = GPOINTER_TO_UINT (g_queue_pop_head (&priv->free_slots));
+    guint gen = 0;
+
+    if (!slot) {
+        if (priv->service_cache->len > SERVICE_ID_SLOT_MASK) return 0;
+        slot = priv->service_cache->len;
+        g_ptr_array_add (priv->service_cache, NULL);
+        g_array_append_val (priv->generations, gen);
+    }
+
+    return SERVICE_ID_MAKE (g_array_index (priv->generations, guint, slot), slot);
+}
+
+/*
+ * Gives back the slot of the service id, the ids of its previous
+ * users stop matching. Expects the caller holds the writer lock.
+ */
+static void
+_service_id_free (MsgPortManagerPrivate *priv, guint service_id)
+{
+    guint slot = SERVICE_ID_SLOT (service_id);
+    guint *gen = &g_array_index (priv->generations, guint, slot);
+
+    g_ptr_array_index (priv->service_cache, slot) = NULL;
+
+    if (*gen == SERVICE_ID_GEN_MASK) {
+        DBG ("Retiring service id slot %u, its generations are used up", slot);
+        return;
+    }
+
+    (*gen)++;
+    g_queue_push_tail (&priv->free_slots, GUINT_TO_POINTER (slot));
+}
+
+/*
+ * Returns the registered service with given id, if any. Expects the
+ * caller holds the lock.
+ */
+static MsgPortDbusService *
+_service_cache_lookup (MsgPortManagerPrivate *priv, guint service_id)
+{
+    guint slot = SERVICE_ID_SLOT (service_id);
+    MsgPortDbusService *dbus_service = NULL;
+
+    if (!priv->service_cache || !slot || slot >= priv->service_cache->len) return NULL;
+
+    dbus_service = g_ptr_array_index (priv->service_cache, slot);
+    if (dbus_service && msgport_dbus_service_get_id (dbus_service) != service_id) return NULL;
+
+    return dbus_service;
+}
+
 static void
 _manager_finalize (GObject *self)
 {
-    //MsgPortManager *manager = MSGPORT_MANAGER (self);
+    MsgPortManager *manager = MSGPORT_MANAGER (self);
+
+    g_rw_lock_clear (&manager->priv->lock);
 
     G_OBJECT_CLASS (msgport_manager_parent_class)->finalize (self);
 }
@@ -63,25 +288,62 @@ _manager_dispose (GObject *self)
 {
     MsgPortManager *manager = MSGPORT_MANAGER (self);
 
-    g_hash_table_unref (manager->priv->owner_service_map);
-    manager->priv->owner_service_map = NULL;
+    g_rw_lock_writer_lock (&manager->priv->lock);
+
+    /* unpublish before the services are released */
+    if (manager->priv->services_by_id) {
+        ServiceTable *table = (ServiceTable *)manager->priv->services_by_id;
+
+        g_atomic_pointer_set (&manager->priv->services_by_id, NULL);
+        _service_table_synchronize (manager->priv);
+        g_free (table);
+    }
+
+    if (manager->priv->owner_service_map) {
+        g_hash_table_unref (manager->priv->owner_service_map);
+        manager->priv->owner_service_map = NULL;
+    }
+
+    if (manager->priv->service_cache) {
+        g_ptr_array_unref (manager->priv->service_cache);
+        manager->priv->service_cache = NULL;
+    }
+
+    if (manager->priv->generations) {
+        g_array_unref (manager->priv->generations);
+        manager->priv->generations = NULL;
+    }
+    g_queue_clear (&manager->priv->free_slots);
 
-    g_hash_table_unref (manager->priv->service_cache);
-    manager->priv->service_cache = NULL;
+    g_rw_lock_writer_unlock (&manager->priv->lock);
 
     G_OBJECT_CLASS (msgport_manager_parent_class)->dispose (self);
 }
 
+static void
+_service_unref (gpointer data)
+{
+    if (data) g_object_unref (data);
+}
+
 static void
 msgport_manager_init (MsgPortManager *self)
 {
     MsgPortManagerPrivate *priv = MSGPORT_MANAGER_GET_PRIV (self);
 
-    priv->service_cache = g_hash_table_new_full (
-                g_direct_hash, g_direct_equal, NULL, g_object_unref);
+    priv->service_cache = g_ptr_array_new_with_free_func (_service_unref);
+    priv->generations = g_array_new (FALSE, TRUE, sizeof (guint));
+    g_queue_init (&priv->free_slots);
+    /* reserve slot 0 */
+    g_ptr_array_add (priv->service_cache, NULL);
+    g_array_set_size (priv->generations, 1);
     priv->owner_service_map = g_hash_table_new_full (
                 g_direct_hash, g_direct_equal, 
-                NULL, (GDestroyNotify) g_list_free);
+                NULL, (GDestroyNotify) g_hash_table_unref);
+    g_rw_lock_init (&priv->lock);
+    priv->services_by_id = NULL;
+    priv->epoch = 0;
+    priv->readers[0] = priv->readers[1] = 0;
 
     self->priv = priv;
 }
@@ -101,20 +363,30 @@ MsgPortManager *
 msgport_manager_new ()
 {
     static GObject *manager = NULL;
+    MsgPortManager *res = NULL;
+
+    /* dbus managers are created on the server thread only,
+     * still keep it safe against concurrent first use */
+    G_LOCK_DEFINE_STATIC (manager_new);
 
+    G_LOCK (manager_new);
     if (!manager) {
         manager =  g_object_new (MSGPORT_TYPE_MANAGER, NULL);
         g_object_add_weak_pointer (manager, (gpointer *)&manager);
 
-        return MSGPORT_MANAGER (manager);
+        res = MSGPORT_MANAGER (manager);
     }
+    else {
+        res = MSGPORT_MANAGER (g_object_ref (manager));
+    }
+    G_UNLOCK (manager_new);
 
-    return MSGPORT_MANAGER (g_object_ref (manager));
+    return res;
 }
 
 /*
  * It returns the serice pointer, if found with given owner, port_name and is_trusted 
- * It assues the given arguments are valid.
+ * It assues the given arguments are valid, and the caller holds the lock.
  */
 MsgPortDbusService *
 _manager_get_service_internal (
@@ -123,73 +395,94 @@ _manager_get_service_internal (
     const gchar        *port_name,
     gboolean            is_trusted)
 {
-    GList *service_list = g_hash_table_lookup (manager->priv->owner_service_map, owner);
+    GHashTable *services = NULL;
+    ServiceKey key = { (gchar *)port_name, is_trusted != FALSE };
+    MsgPortDbusService *dbus_service = NULL;
     
     DBG ("Checking for port '%s', is_tursted : %d owned by : %p('%s')",
             port_name, is_trusted, owner, msgport_dbus_manager_get_app_id (owner));
 
-    while (service_list != NULL) {
-        MsgPortDbusService *dbus_service = MSGPORT_DBUS_SERVICE (service_list->data);
+    if (!manager->priv->owner_service_map) return NULL;
 
-        if ( !g_strcmp0 (port_name, msgport_dbus_service_get_port_name (dbus_service)) && 
-             is_trusted == msgport_dbus_service_get_is_trusted (dbus_service)) {
-            DBG ("   Found with %d", msgport_dbus_service_get_id (dbus_service));
-            return dbus_service ;
-        }
+    services = g_hash_table_lookup (manager->priv->owner_service_map, owner);
+    if (services) dbus_service = g_hash_table_lookup (services, &key);
 
-        service_list = service_list->next;
-    }
-
-    DBG ("   Not Found");
+    if (dbus_service) DBG ("   Found with %d", msgport_dbus_service_get_id (dbus_service));
+    else DBG ("   Not Found");
 
-    return NULL;
+    return dbus_service;
 }
 
+/*
+ * Registers a new service for owner, or returns the one already registered with
+ * the same parameters. Returned service is owned by the manager, and stays valid
+ * until the owner unregisters it.
+ */
 MsgPortDbusService *
 msgport_manager_register_service (
     MsgPortManager     *manager,
     MsgPortDbusManager *owner,
     const gchar        *port_name,
     gboolean            is_trusted,
+    MsgPortPriority     priority,
     GError            **error)
 {
-    GList   *service_list  = NULL; /* services list owned by a client */
-    gboolean list_was_empty = TRUE;
+    GHashTable *services = NULL; /* services owned by a client */
     MsgPortDbusService *dbus_service = NULL;
+    guint service_id = 0;
 
     msgport_return_val_if_fail_with_error (manager && MSGPORT_IS_MANAGER (manager), NULL, error);
     msgport_return_val_if_fail_with_error (owner && MSGPORT_IS_DBUS_MANAGER (owner), NULL, error);
     msgport_return_val_if_fail_with_error (port_name && port_name[0], NULL, error);
 
+    g_rw_lock_writer_lock (&manager->priv->lock);
+
     /* check if port already existing with given params */
     dbus_service = _manager_get_service_internal (manager, owner, port_name, is_trusted);
-    if (dbus_service != NULL)
+    if (dbus_service != NULL) {
+        g_rw_lock_writer_unlock (&manager->priv->lock);
         return dbus_service;
+    }
+
+    service_id = _service_id_alloc (manager->priv);
+    if (!service_id) {
+        g_rw_lock_writer_unlock (&manager->priv->lock);
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_OUT_OF_MEMORY, "too many services");
+        return NULL;
+    }
 
     /* create  new port/service */
-    dbus_service = msgport_dbus_service_new (owner, port_name, is_trusted, error);
+    dbus_service = msgport_dbus_service_new (owner, port_name, is_trusted, priority, service_id, error);
     if (!dbus_service) {
+        _service_id_free (manager->priv, service_id);
+        g_rw_lock_writer_unlock (&manager->priv->lock);
         ERR ("Failed to create new servcie");
         return NULL;
     }
     /* cache newly created service */
-    g_hash_table_insert (manager->priv->service_cache, 
-        GINT_TO_POINTER (msgport_dbus_service_get_id (dbus_service)),
-        (gpointer)dbus_service);
+    g_ptr_array_index (manager->priv->service_cache, SERVICE_ID_SLOT (service_id)) = dbus_service;
 
-    service_list = g_hash_table_lookup (manager->priv->owner_service_map, owner);
-    list_was_empty = (service_list == NULL);
-
-   /* append to list of services */
-    service_list = g_list_append (service_list, dbus_service);
-    if (list_was_empty) {
-        g_hash_table_insert (manager->priv->owner_service_map, owner, service_list);
+    services = g_hash_table_lookup (manager->priv->owner_service_map, owner);
+    if (!services) {
+        services = g_hash_table_new_full (_service_key_hash, _service_key_equal,
+                _service_key_free, NULL);
+        g_hash_table_insert (manager->priv->owner_service_map, owner, services);
     }
 
+    /* index the service on owner */
+    g_hash_table_insert (services, _service_key_new (port_name, is_trusted), dbus_service);
+
+    _service_table_publish (manager->priv);
+
+    g_rw_lock_writer_unlock (&manager->priv->lock);
+
     return dbus_service;
 }
 
-
+/*
+ * Returns a new reference to the service, the owner might unregister it
+ * meanwhile from an other thread.
+ */
 MsgPortDbusService *
 msgport_manager_get_service (
     MsgPortManager      *manager,
@@ -204,7 +497,10 @@ msgport_manager_get_service (
     msgport_return_val_if_fail_with_error (owner && MSGPORT_IS_DBUS_MANAGER (owner), NULL, error);
     msgport_return_val_if_fail_with_error (port_name && port_name[0], NULL, error);
 
+    g_rw_lock_reader_lock (&manager->priv->lock);
     service = _manager_get_service_internal (manager, owner, port_name, is_trusted);
+    if (service) g_object_ref (service);
+    g_rw_lock_reader_unlock (&manager->priv->lock);
 
     if (!service && error) 
         *error = msgport_error_port_not_found (msgport_dbus_manager_get_app_id (owner), port_name);
@@ -212,6 +508,10 @@ msgport_manager_get_service (
     return service;
 }
 
+/*
+ * Returns a new reference to the service, see msgport_manager_get_service().
+ * It is on the path of every message, so it does not take the lock.
+ */
 MsgPortDbusService *
 msgport_manager_get_service_by_id (
     MsgPortManager *manager,
@@ -223,27 +523,49 @@ msgport_manager_get_service_by_id (
     msgport_return_val_if_fail_with_error (manager && MSGPORT_IS_MANAGER (manager), NULL, error);
     msgport_return_val_if_fail_with_error (service_id != 0, NULL, error);
 
-    dbus_service = MSGPORT_DBUS_SERVICE (g_hash_table_lookup (
-            manager->priv->service_cache, GINT_TO_POINTER(service_id)));
+    dbus_service = _service_table_lookup (manager->priv, service_id);
+
+    /* clients holding a cached id resolve the port again on NotFound */
+    if (!dbus_service && error)
+        *error = msgport_error_port_id_not_found_new (service_id);
 
     return dbus_service;
 }
 
+/*
+ * Returns all the registered services, the list holds references,
+ * free it with g_list_free_full (list, g_object_unref).
+ */
+GList *
+msgport_manager_get_services (MsgPortManager *manager)
+{
+    GList *res = NULL;
+    guint i;
+
+    msgport_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), NULL);
+
+    g_rw_lock_reader_lock (&manager->priv->lock);
+    for (i = manager->priv->service_cache->len; i > 0; i--) {
+        MsgPortDbusService *dbus_service = g_ptr_array_index (manager->priv->service_cache, i - 1);
+        if (dbus_service) res = g_list_prepend (res, g_object_ref (dbus_service));
+    }
+    g_rw_lock_reader_unlock (&manager->priv->lock);
+
+    return res;
+}
+
 static void
-_manager_unref_dbus_manager_cb (gpointer data, gpointer user_data)
+_manager_collect_service_cb (gpointer key, gpointer data, gpointer user_data)
 {
-    MsgPortManager *manager = MSGPORT_MANAGER (user_data);
+    GPtrArray *removed = (GPtrArray *)user_data;
     MsgPortDbusService *service = MSGPORT_DBUS_SERVICE (data);
-    guint id = msgport_dbus_service_get_id (service);
 
 #ifdef ENABLE_DEBUG
     DBG ("Unregistering service %s:%s(%d)", 
         msgport_dbus_manager_get_app_id (msgport_dbus_service_get_owner (service)),
-        msgport_dbus_service_get_port_name (service), id);
+        msgport_dbus_service_get_port_name (service), msgport_dbus_service_get_id (service));
 #endif
-    /* remove the service from id:service map,
-     * as its being unregisted */
-    g_hash_table_remove (manager->priv->service_cache, GINT_TO_POINTER(id));
+    g_ptr_array_add (removed, service);
 }
 
 /*
@@ -257,31 +579,43 @@ msgport_manager_unregister_service (
 {
     MsgPortDbusService *service = NULL;
     MsgPortDbusManager *owner = NULL;
-    GList *service_list = NULL, *new_service_list = NULL;
+    GHashTable *services = NULL;
 
     msgport_return_val_if_fail_with_error (manager && MSGPORT_IS_MANAGER (manager), FALSE, error);
 
-    service = g_hash_table_lookup (manager->priv->service_cache, GINT_TO_POINTER (service_id));
+    g_rw_lock_writer_lock (&manager->priv->lock);
+
+    service = _service_cache_lookup (manager->priv, (guint)service_id);
 
     if (!service) {
+        g_rw_lock_writer_unlock (&manager->priv->lock);
         if (error) *error = msgport_error_port_id_not_found_new (service_id);
         return FALSE;
     }
 
     owner = msgport_dbus_service_get_owner (service);
 
-    service_list = g_hash_table_lookup (manager->priv->owner_service_map, owner);
+    services = g_hash_table_lookup (manager->priv->owner_service_map, owner);
+
+    /* remove service from services owned by the 'owner'*/
+    if (services) {
+        ServiceKey key = {
+            (gchar *)msgport_dbus_service_get_port_name (service),
+            msgport_dbus_service_get_is_trusted (service) != FALSE
+        };
 
-    /* remove service from services list owned by the 'owner'*/
-    new_service_list = g_list_remove (service_list, service);
-    if (new_service_list != service_list) {
-        g_hash_table_steal (manager->priv->owner_service_map, owner);
-        /* update the new list on this owner */
-        g_hash_table_insert (manager->priv->owner_service_map, owner, new_service_list);
+        g_hash_table_remove (services, &key);
+        if (g_hash_table_size (services) == 0)
+            g_hash_table_remove (manager->priv->owner_service_map, owner);
     }
 
-    /* remove from the service_id:servcie table */
-    g_hash_table_remove (manager->priv->service_cache, GINT_TO_POINTER(service_id));
+    /* drop it outside the lock, service going down notifies its watchers */
+    _service_id_free (manager->priv, (guint)service_id);
+    _service_table_publish (manager->priv);
+
+    g_rw_lock_writer_unlock (&manager->priv->lock);
+
+    g_object_unref (service);
 
     return TRUE;
 }
@@ -296,20 +630,37 @@ msgport_manager_unregister_services (
     GError            **error)
 {
 
-    GList *service_list = NULL;
+    GHashTable *services = NULL;
+    GPtrArray *removed = NULL;
+    guint i;
 
     msgport_return_val_if_fail_with_error (manager && MSGPORT_IS_MANAGER (manager), FALSE, error);
 
-    /* fetch sevice list owned by the client */
-    service_list = g_hash_table_lookup (manager->priv->owner_service_map, owner);
-    if (!service_list) {
+    g_rw_lock_writer_lock (&manager->priv->lock);
+
+    /* fetch sevices owned by the client */
+    if (manager->priv->owner_service_map)
+        services = g_hash_table_lookup (manager->priv->owner_service_map, owner);
+    if (!services) {
+        g_rw_lock_writer_unlock (&manager->priv->lock);
         DBG("no services found on client '%p'", owner);
         return TRUE;
     }
 
-    /* remove all the service from the list */
-    g_list_foreach (service_list, _manager_unref_dbus_manager_cb, manager);
+    /* remove all the service from the index */
+    removed = g_ptr_array_new_with_free_func (g_object_unref);
+    g_hash_table_foreach (services, _manager_collect_service_cb, removed);
+    for (i = 0; i < removed->len; i++) {
+        _service_id_free (manager->priv,
+                msgport_dbus_service_get_id (g_ptr_array_index (removed, i)));
+    }
     g_hash_table_remove (manager->priv->owner_service_map, owner);
+    _service_table_publish (manager->priv);
+
+    g_rw_lock_writer_unlock (&manager->priv->lock);
+
+    /* services go down outside the lock */
+    g_ptr_array_unref (removed);
 
     return TRUE;
 }
@@ -28,6 +28,7 @@
 
 #include <glib-object.h>
 #include <gio/gio.h>
+#include "outbox.h"
 
 G_BEGIN_DECLS
 
@@ -68,6 +69,7 @@ msgport_manager_register_service (
     MsgPortDbusManager *owner,
     const gchar        *port_name,
     gboolean            is_trusted,
+    MsgPortPriority     priority,
     GError            **error_out);
 
 MsgPortDbusService *
@@ -84,6 +86,9 @@ msgport_manager_get_service_by_id (
     guint           service_id,
     GError        **error_out);
 
+GList *
+msgport_manager_get_services (MsgPortManager *manager);
+
 gboolean
 msgport_manager_unregister_services (
     MsgPortManager     *manager,
@@ -0,0 +1,712 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "outbox.h"
+#include "common/channel.h"
+#include "common/dbus-error.h"
+#include "common/log.h"
+#include "utils.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <gio/gunixfdlist.h>
+
+G_DEFINE_TYPE (MsgPortOutbox, msgport_outbox, G_TYPE_OBJECT)
+
+#define MSGPORT_OUTBOX_GET_PRIV(obj) \
+    G_TYPE_INSTANCE_GET_PRIVATE ((obj), MSGPORT_TYPE_OUTBOX, MsgPortOutboxPrivate)
+
+/*
+ * Messages handed to the connection but not yet written out are counted
+ * per connection. Once the count reaches the high watermark, new messages
+ * wait in their lanes until it drains below the low watermark, and then
+ * go out highest lane first. Each port can have at most high watermark
+ * messages waiting. Can be overridden with MESSAGEPORT_QUEUE_HIGH_WATERMARK
+ * and MESSAGEPORT_QUEUE_LOW_WATERMARK.
+ *
+ * Once the owner opened a data channel, messages are written to it as
+ * frames instead. The socket buffer then takes the place of the messages
+ * in flight, and the outbox stays blocked until the channel is writable.
+ * Messages too big for a packet are passed as sealed memfd on the channel
+ * too, never over dbus, so that they can not overtake the smaller ones.
+ */
+#define MSGPORT_QUEUE_HIGH_WATERMARK 256
+#define MSGPORT_QUEUE_LOW_WATERMARK  64
+
+struct _MsgPortOutboxPrivate {
+    GDBusConnection *connection;
+
+    /* guarded by lock, messages are sent from all worker threads */
+    GMutex           lock;
+    guint            high_watermark;
+    guint            low_watermark;
+    guint            n_in_flight; /* sent, not yet written out */
+    guint            n_flushing;  /* part of n_in_flight covered by the flush in progress */
+    gboolean         is_blocked;  /* reached high watermark, not yet drained to low */
+    GQueue           lanes[MSGPORT_PRIORITY_LAST]; /* QueuedDelivery* */
+    GHashTable      *n_waiting;   /* {port_id:count} */
+    gint             channel_fd;  /* owner data channel, -1 if none */
+    GMainContext    *channel_context;
+    GSource         *channel_watch; /* waits for the full channel to drain */
+};
+
+/*
+ * Message held back while the outbox is blocked
+ */
+typedef struct {
+    GDBusMessage         *message;
+    guint                 port_id;
+    MsgPortOutboxCallback cb;
+    gpointer              userdata;
+} QueuedDelivery;
+
+/*
+ * Result reported to the sender once the outbox lock is dropped
+ */
+typedef struct {
+    MsgPortOutboxCallback cb;
+    gpointer              userdata;
+    GError               *error;
+} DeliveryResult;
+
+static void _on_outbox_flushed (GObject *source, GAsyncResult *result, gpointer userdata);
+
+static void
+_get_watermarks (guint *high, guint *low)
+{
+    static gsize initialized = 0;
+    static guint high_watermark = MSGPORT_QUEUE_HIGH_WATERMARK;
+    static guint low_watermark = MSGPORT_QUEUE_LOW_WATERMARK;
+
+    if (g_once_init_enter (&initialized)) {
+        const gchar *value = NULL;
+
+        if ((value = g_getenv ("MESSAGEPORT_QUEUE_HIGH_WATERMARK")) != NULL)
+            high_watermark = MAX ((guint)g_ascii_strtoull (value, NULL, 10), 1);
+        if ((value = g_getenv ("MESSAGEPORT_QUEUE_LOW_WATERMARK")) != NULL)
+            low_watermark = (guint)g_ascii_strtoull (value, NULL, 10);
+        if (low_watermark >= high_watermark) low_watermark = high_watermark / 2;
+
+        g_once_init_leave (&initialized, 1);
+    }
+
+    *high = high_watermark;
+    *low = low_watermark;
+}
+
+static void
+_queued_delivery_free (QueuedDelivery *queued)
+{
+    g_object_unref (queued->message);
+    g_slice_free (QueuedDelivery, queued);
+}
+
+static void
+_report_results (GQueue *results)
+{
+    DeliveryResult *res = NULL;
+
+    while ((res = g_queue_pop_head (results)) != NULL) {
+        if (res->cb) res->cb (res->error, res->userdata);
+        if (res->error) g_error_free (res->error);
+        g_slice_free (DeliveryResult, res);
+    }
+}
+
+static void
+_push_result (GQueue *results, MsgPortOutboxCallback cb, gpointer userdata, GError *error)
+{
+    DeliveryResult *res = g_slice_new (DeliveryResult);
+
+    res->cb = cb;
+    res->userdata = userdata;
+    res->error = error;
+    g_queue_push_tail (results, res);
+}
+
+static void
+_outbox_unqueue_locked (MsgPortOutbox *outbox, guint port_id)
+{
+    guint n_waiting = GPOINTER_TO_UINT (g_hash_table_lookup (outbox->priv->n_waiting,
+                    GUINT_TO_POINTER (port_id)));
+
+    if (n_waiting > 1)
+        g_hash_table_insert (outbox->priv->n_waiting, GUINT_TO_POINTER (port_id),
+                GUINT_TO_POINTER (n_waiting - 1));
+    else
+        g_hash_table_remove (outbox->priv->n_waiting, GUINT_TO_POINTER (port_id));
+}
+
+/*
+ * Starts writing out the messages sent so far, to learn when they left the
+ * daemon. Done only once there are enough to matter, so that a lightly
+ * loaded connection does not pay a flush for every message.
+ * Expects the caller holds the lock.
+ */
+static void
+_outbox_flush_locked (MsgPortOutbox *outbox)
+{
+    MsgPortOutboxPrivate *priv = outbox->priv;
+
+    if (priv->n_flushing || priv->n_in_flight < MAX (priv->low_watermark, 1))
+        return;
+
+    priv->n_flushing = priv->n_in_flight;
+    g_dbus_connection_flush (priv->connection, NULL, _on_outbox_flushed, g_object_ref (outbox));
+}
+
+/*
+ * Writes the message signal as a channel frame, expects the caller holds
+ * the lock. Fails with MSGPORT_ERROR_WOULD_BLOCK if the channel is full.
+ */
+static gboolean
+_outbox_write_frame_locked (MsgPortOutbox *outbox, GDBusMessage *message, guint port_id, GError **error)
+{
+    GVariant *body = g_dbus_message_get_body (message);
+    const gchar *member = g_dbus_message_get_member (message);
+    const gchar *app_id = NULL, *port = NULL;
+    gboolean is_trusted = FALSE;
+    gboolean res = FALSE;
+
+    if (!g_strcmp0 (member, "onMessage") && body &&
+        g_variant_is_of_type (body, G_VARIANT_TYPE ("(a{sv}ssb)"))) {
+        GVariant *data = NULL;
+
+        gsize frame_size;
+
+        g_variant_get (body, "(@a{sv}&s&sb)", &data, &app_id, &port, &is_trusted);
+        frame_size = sizeof (MsgPortChannelHeader) + strlen (app_id) + 1 + strlen (port) + 1 +
+                     g_variant_get_size (data);
+
+        if (frame_size <= MSGPORT_CHANNEL_MAX_PACKET) {
+            res = msgport_channel_send (outbox->priv->channel_fd, port_id, 0,
+                    is_trusted ? MSGPORT_CHANNEL_FLAG_TRUSTED : MSGPORT_CHANNEL_FLAG_NONE,
+                    app_id, port, g_variant_get_data (data), g_variant_get_size (data), -1, error);
+        }
+        else {
+            /* stays on the channel, going over dbus would let it overtake
+             * the frames still queued for the port */
+            GError *payload_error = NULL;
+            gint fd = msgport_channel_payload_to_memfd (g_variant_get_data (data),
+                    g_variant_get_size (data), &payload_error);
+
+            if (fd >= 0) {
+                res = msgport_channel_send (outbox->priv->channel_fd, port_id, 0,
+                        is_trusted ? MSGPORT_CHANNEL_FLAG_TRUSTED : MSGPORT_CHANNEL_FLAG_NONE,
+                        app_id, port, NULL, 0, fd, error);
+                close (fd);
+            }
+            else {
+                if (error) *error = msgport_error_new (MSGPORT_ERROR_OUT_OF_MEMORY,
+                        "fail to create payload : %s", payload_error->message);
+                g_error_free (payload_error);
+            }
+        }
+        g_variant_unref (data);
+    }
+    else if (!g_strcmp0 (member, "onLargeMessage") && body &&
+             g_variant_is_of_type (body, G_VARIANT_TYPE ("(hssb)")) &&
+             g_dbus_message_get_unix_fd_list (message)) {
+        const gint *fds = NULL;
+        gint handle = -1, n_fds = 0;
+
+        g_variant_get (body, "(h&s&sb)", &handle, &app_id, &port, &is_trusted);
+        fds = g_unix_fd_list_peek_fds (g_dbus_message_get_unix_fd_list (message), &n_fds);
+        if (handle < 0 || handle >= n_fds) {
+            if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "invalid payload handle");
+            return FALSE;
+        }
+        res = msgport_channel_send (outbox->priv->channel_fd, port_id, 0,
+                is_trusted ? MSGPORT_CHANNEL_FLAG_TRUSTED : MSGPORT_CHANNEL_FLAG_NONE,
+                app_id, port, NULL, 0, fds[handle], error);
+    }
+    else if (error) {
+        *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "not a message");
+    }
+
+    return res;
+}
+
+/*
+ * Sends the message and accounts it, expects the caller holds the lock.
+ * Fails with MSGPORT_ERROR_WOULD_BLOCK only if the data channel is full.
+ */
+static gboolean
+_outbox_deliver_locked (MsgPortOutbox *outbox, GDBusMessage *message, guint port_id, GError **error)
+{
+    MsgPortOutboxPrivate *priv = outbox->priv;
+    GError *send_error = NULL;
+
+    if (g_dbus_connection_is_closed (priv->connection)) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_IO_ERROR, "owner connection closed");
+        return FALSE;
+    }
+
+    if (priv->channel_fd >= 0) {
+        if (_outbox_write_frame_locked (outbox, message, port_id, &send_error))
+            return TRUE;
+
+        /* failing the message keeps the order of the others on the channel */
+        if (g_error_matches (send_error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_WOULD_BLOCK) ||
+            g_error_matches (send_error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_OUT_OF_MEMORY)) {
+            g_propagate_error (error, send_error);
+            return FALSE;
+        }
+
+        /* not a message goes over dbus, anything else means the channel is gone */
+        if (!g_error_matches (send_error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_INVALID_PARAMS)) {
+            WARN ("Closing data channel of outbox %p : %s", outbox, send_error->message);
+            close (priv->channel_fd);
+            priv->channel_fd = -1;
+        }
+        g_clear_error (&send_error);
+    }
+
+    if (!g_dbus_connection_send_message (priv->connection, message,
+                G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, &send_error)) {
+        WARN ("failed to deliver message on %p : %s", priv->connection,
+                send_error ? send_error->message : "unknown error");
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_IO_ERROR,
+                send_error ? send_error->message : "failed to deliver message");
+        g_clear_error (&send_error);
+        return FALSE;
+    }
+
+    if (++priv->n_in_flight >= priv->high_watermark && !priv->is_blocked) {
+        DBG ("Outbox %p blocked with %u messages in flight", outbox, priv->n_in_flight);
+        priv->is_blocked = TRUE;
+    }
+    _outbox_flush_locked (outbox);
+
+    return TRUE;
+}
+
+/*
+ * Takes out all the waiting messages, expects the caller holds the lock.
+ */
+static void
+_outbox_fail_waiting_locked (MsgPortOutbox *outbox, const GError *error, GQueue *results)
+{
+    QueuedDelivery *queued = NULL;
+    guint i;
+
+    for (i = MSGPORT_PRIORITY_LAST; i-- > 0; ) {
+        while ((queued = g_queue_pop_head (&outbox->priv->lanes[i])) != NULL) {
+            _push_result (results, queued->cb, queued->userdata, g_error_copy (error));
+            _queued_delivery_free (queued);
+        }
+    }
+    g_hash_table_remove_all (outbox->priv->n_waiting);
+}
+
+static void
+_outbox_enqueue_locked (MsgPortOutbox *outbox, QueuedDelivery *queued, guint lane, gboolean at_head)
+{
+    guint n_waiting = GPOINTER_TO_UINT (g_hash_table_lookup (outbox->priv->n_waiting,
+                    GUINT_TO_POINTER (queued->port_id)));
+
+    g_hash_table_insert (outbox->priv->n_waiting, GUINT_TO_POINTER (queued->port_id),
+            GUINT_TO_POINTER (n_waiting + 1));
+
+    if (at_head) g_queue_push_head (&outbox->priv->lanes[lane], queued);
+    else g_queue_push_tail (&outbox->priv->lanes[lane], queued);
+}
+
+static gboolean _on_channel_writable (gint fd, GIOCondition condition, gpointer userdata);
+
+/*
+ * Blocks the outbox until the full channel drains, expects the caller holds the lock.
+ */
+static void
+_outbox_wait_for_channel_locked (MsgPortOutbox *outbox)
+{
+    MsgPortOutboxPrivate *priv = outbox->priv;
+
+    priv->is_blocked = TRUE;
+    if (priv->channel_watch) return;
+
+    DBG ("Outbox %p blocked on full data channel", outbox);
+    priv->channel_watch = g_unix_fd_source_new (priv->channel_fd, G_IO_OUT | G_IO_HUP | G_IO_ERR);
+    g_source_set_callback (priv->channel_watch, (GSourceFunc)_on_channel_writable,
+            g_object_ref (outbox), g_object_unref);
+    g_source_attach (priv->channel_watch, priv->channel_context);
+}
+
+/*
+ * Sends the waiting messages, higher lanes first, each in order, until
+ * blocked again. Expects the caller holds the lock.
+ */
+static void
+_outbox_drain_locked (MsgPortOutbox *outbox, GQueue *results)
+{
+    MsgPortOutboxPrivate *priv = outbox->priv;
+    QueuedDelivery *queued = NULL;
+    GError *error = NULL;
+    gint i;
+
+    for (i = MSGPORT_PRIORITY_LAST - 1; i >= 0 && !priv->is_blocked; i--) {
+        while (!priv->is_blocked && (queued = g_queue_pop_head (&priv->lanes[i])) != NULL) {
+            _outbox_unqueue_locked (outbox, queued->port_id);
+            if (!_outbox_deliver_locked (outbox, queued->message, queued->port_id, &error) &&
+                g_error_matches (error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_WOULD_BLOCK)) {
+                /* keeps its place until the channel drains */
+                g_clear_error (&error);
+                _outbox_enqueue_locked (outbox, queued, i, TRUE);
+                _outbox_wait_for_channel_locked (outbox);
+                break;
+            }
+            _push_result (results, queued->cb, queued->userdata, error);
+            error = NULL;
+            _queued_delivery_free (queued);
+        }
+    }
+}
+
+static gboolean
+_on_channel_writable (gint fd, GIOCondition condition, gpointer userdata)
+{
+    MsgPortOutbox *outbox = MSGPORT_OUTBOX (userdata);
+    MsgPortOutboxPrivate *priv = outbox->priv;
+    GQueue results = G_QUEUE_INIT;
+
+    g_mutex_lock (&priv->lock);
+
+    /* a new watch is set up if it fills up again */
+    g_source_unref (priv->channel_watch);
+    priv->channel_watch = NULL;
+
+    priv->is_blocked = priv->n_in_flight >= priv->high_watermark;
+    _outbox_drain_locked (outbox, &results);
+
+    g_mutex_unlock (&priv->lock);
+
+    _report_results (&results);
+
+    return FALSE;
+}
+
+static void
+_on_outbox_flushed (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    MsgPortOutbox *outbox = MSGPORT_OUTBOX (userdata);
+    MsgPortOutboxPrivate *priv = outbox->priv;
+    GQueue results = G_QUEUE_INIT;
+    GError *error = NULL;
+
+    if (!g_dbus_connection_flush_finish (G_DBUS_CONNECTION (source), result, &error)) {
+        /* owner is going away, nothing is drained anymore */
+        GError *closed = msgport_error_new (MSGPORT_ERROR_IO_ERROR, "owner connection closed");
+
+        WARN ("Failed to flush messages of outbox %p : %s", outbox, error->message);
+        g_error_free (error);
+
+        g_mutex_lock (&priv->lock);
+        priv->n_flushing = 0;
+        _outbox_fail_waiting_locked (outbox, closed, &results);
+        g_mutex_unlock (&priv->lock);
+
+        _report_results (&results);
+        g_error_free (closed);
+        g_object_unref (outbox);
+        return;
+    }
+
+    g_mutex_lock (&priv->lock);
+
+    priv->n_in_flight -= priv->n_flushing;
+    priv->n_flushing = 0;
+
+    /* a full channel unblocks on its own */
+    if (priv->is_blocked && !priv->channel_watch && priv->n_in_flight <= priv->low_watermark) {
+        DBG ("Outbox %p unblocked", outbox);
+        priv->is_blocked = FALSE;
+        _outbox_drain_locked (outbox, &results);
+    }
+
+    _outbox_flush_locked (outbox);
+
+    g_mutex_unlock (&priv->lock);
+
+    /* report to senders outside the lock */
+    _report_results (&results);
+
+    g_object_unref (outbox);
+}
+
+static void
+_outbox_dispose (GObject *self)
+{
+    MsgPortOutbox *outbox = MSGPORT_OUTBOX (self);
+    GQueue results = G_QUEUE_INIT;
+    GError *error = msgport_error_new (MSGPORT_ERROR_IO_ERROR, "owner connection closed");
+
+    g_mutex_lock (&outbox->priv->lock);
+    _outbox_fail_waiting_locked (outbox, error, &results);
+    g_mutex_unlock (&outbox->priv->lock);
+
+    _report_results (&results);
+    g_error_free (error);
+
+    g_clear_object (&outbox->priv->connection);
+
+    /* no watch is left, it holds a reference */
+    if (outbox->priv->channel_fd >= 0) {
+        close (outbox->priv->channel_fd);
+        outbox->priv->channel_fd = -1;
+    }
+    if (outbox->priv->channel_context) {
+        g_main_context_unref (outbox->priv->channel_context);
+        outbox->priv->channel_context = NULL;
+    }
+
+    G_OBJECT_CLASS (msgport_outbox_parent_class)->dispose (self);
+}
+
+static void
+_outbox_finalize (GObject *self)
+{
+    MsgPortOutbox *outbox = MSGPORT_OUTBOX (self);
+
+    g_hash_table_unref (outbox->priv->n_waiting);
+    g_mutex_clear (&outbox->priv->lock);
+
+    G_OBJECT_CLASS (msgport_outbox_parent_class)->finalize (self);
+}
+
+static void
+msgport_outbox_class_init (MsgPortOutboxClass *klass)
+{
+    GObjectClass *gklass = G_OBJECT_CLASS(klass);
+
+    g_type_class_add_private (klass, sizeof(MsgPortOutboxPrivate));
+
+    gklass->dispose = _outbox_dispose;
+    gklass->finalize = _outbox_finalize;
+}
+
+static void
+msgport_outbox_init (MsgPortOutbox *self)
+{
+    MsgPortOutboxPrivate *priv = MSGPORT_OUTBOX_GET_PRIV (self);
+    guint i;
+
+    priv->connection = NULL;
+    g_mutex_init (&priv->lock);
+    _get_watermarks (&priv->high_watermark, &priv->low_watermark);
+    priv->n_in_flight = 0;
+    priv->n_flushing = 0;
+    priv->is_blocked = FALSE;
+    for (i = 0; i < MSGPORT_PRIORITY_LAST; i++)
+        g_queue_init (&priv->lanes[i]);
+    priv->n_waiting = g_hash_table_new (g_direct_hash, g_direct_equal);
+    priv->channel_fd = -1;
+    priv->channel_context = NULL;
+    priv->channel_watch = NULL;
+
+    self->priv = priv;
+}
+
+MsgPortOutbox *
+msgport_outbox_new (GDBusConnection *connection)
+{
+    MsgPortOutbox *outbox = NULL;
+
+    g_return_val_if_fail (connection && G_IS_DBUS_CONNECTION (connection), NULL);
+
+    outbox = MSGPORT_OUTBOX (g_object_new (MSGPORT_TYPE_OUTBOX, NULL));
+    outbox->priv->connection = g_object_ref (connection);
+
+    return outbox;
+}
+
+/*
+ * Sends the message, unless the connection is blocked by a slow owner. In
+ * that case the message waits in its lane and #cb is called once it is sent,
+ * or right away with MSGPORT_ERROR_WOULD_BLOCK if the port can not hold more.
+ */
+void
+msgport_outbox_send (
+    MsgPortOutbox *outbox,
+    GDBusMessage *message,
+    guint port_id,
+    MsgPortPriority priority,
+    MsgPortOutboxCallback cb,
+    gpointer userdata)
+{
+    MsgPortOutboxPrivate *priv = NULL;
+    QueuedDelivery *queued = NULL;
+    GError *error = NULL;
+    guint n_waiting = 0;
+
+    g_return_if_fail (outbox && MSGPORT_IS_OUTBOX (outbox));
+    g_return_if_fail (message && G_IS_DBUS_MESSAGE (message));
+
+    priv = outbox->priv;
+    if (priority >= MSGPORT_PRIORITY_LAST) priority = MSGPORT_PRIORITY_LAST - 1;
+
+    g_mutex_lock (&priv->lock);
+
+    if (priv->is_blocked) {
+        n_waiting = GPOINTER_TO_UINT (g_hash_table_lookup (priv->n_waiting, GUINT_TO_POINTER (port_id)));
+        if (n_waiting >= priv->high_watermark) {
+            g_mutex_unlock (&priv->lock);
+            error = msgport_error_would_block_new ();
+            if (cb) cb (error, userdata);
+            g_error_free (error);
+            return;
+        }
+        goto queue;
+    }
+
+    if (!_outbox_deliver_locked (outbox, message, port_id, &error) &&
+        g_error_matches (error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_WOULD_BLOCK)) {
+        g_clear_error (&error);
+        _outbox_wait_for_channel_locked (outbox);
+        goto queue;
+    }
+
+    g_mutex_unlock (&priv->lock);
+
+    if (cb) cb (error, userdata);
+    g_clear_error (&error);
+    return;
+
+queue:
+    queued = g_slice_new (QueuedDelivery);
+    queued->message = g_object_ref (message);
+    queued->port_id = port_id;
+    queued->cb = cb;
+    queued->userdata = userdata;
+    _outbox_enqueue_locked (outbox, queued, priority, FALSE);
+
+    g_mutex_unlock (&priv->lock);
+}
+
+/*
+ * Delivers the messages to the owner as frames on its data channel from
+ * now on. The fd is not taken over, the channel is watched on #context.
+ */
+void
+msgport_outbox_set_channel (MsgPortOutbox *outbox, gint fd, GMainContext *context)
+{
+    g_return_if_fail (outbox && MSGPORT_IS_OUTBOX (outbox));
+    g_return_if_fail (fd >= 0);
+
+    g_mutex_lock (&outbox->priv->lock);
+    if (outbox->priv->channel_fd < 0 && !outbox->priv->channel_context) {
+        outbox->priv->channel_fd = dup (fd);
+        outbox->priv->channel_context = context ? g_main_context_ref (context) : g_main_context_ref_thread_default ();
+    }
+    g_mutex_unlock (&outbox->priv->lock);
+}
+
+/*
+ * Stops using the data channel, the waiting messages go over dbus.
+ */
+void
+msgport_outbox_close_channel (MsgPortOutbox *outbox)
+{
+    GSource *watch = NULL;
+    GQueue results = G_QUEUE_INIT;
+
+    g_return_if_fail (outbox && MSGPORT_IS_OUTBOX (outbox));
+
+    g_mutex_lock (&outbox->priv->lock);
+    if (outbox->priv->channel_fd >= 0) {
+        close (outbox->priv->channel_fd);
+        outbox->priv->channel_fd = -1;
+    }
+    if ((watch = outbox->priv->channel_watch) != NULL) {
+        outbox->priv->channel_watch = NULL;
+        outbox->priv->is_blocked = outbox->priv->n_in_flight >= outbox->priv->high_watermark;
+        _outbox_drain_locked (outbox, &results);
+    }
+    g_mutex_unlock (&outbox->priv->lock);
+
+    _report_results (&results);
+
+    /* the watch holds a reference on the outbox, so dropped outside the lock */
+    if (watch) {
+        g_source_destroy (watch);
+        g_source_unref (watch);
+    }
+}
+
+/*
+ * Reports the messages sent but not yet written out, and the ones waiting
+ * in each lane. #n_waiting must hold MSGPORT_PRIORITY_LAST entries.
+ */
+void
+msgport_outbox_get_depth (MsgPortOutbox *outbox, guint *n_in_flight, guint *n_waiting)
+{
+    guint i;
+
+    g_return_if_fail (outbox && MSGPORT_IS_OUTBOX (outbox));
+
+    g_mutex_lock (&outbox->priv->lock);
+    if (n_in_flight) *n_in_flight = outbox->priv->n_in_flight;
+    for (i = 0; n_waiting && i < MSGPORT_PRIORITY_LAST; i++)
+        n_waiting[i] = g_queue_get_length (&outbox->priv->lanes[i]);
+    g_mutex_unlock (&outbox->priv->lock);
+}
+
+/*
+ * Fails the messages still waiting for the given port, used when the port
+ * goes away.
+ */
+void
+msgport_outbox_cancel_port (MsgPortOutbox *outbox, guint port_id, const GError *error)
+{
+    GQueue results = G_QUEUE_INIT;
+    GList *item = NULL, *next = NULL;
+    guint i;
+
+    g_return_if_fail (outbox && MSGPORT_IS_OUTBOX (outbox));
+    g_return_if_fail (error);
+
+    g_mutex_lock (&outbox->priv->lock);
+
+    if (g_hash_table_remove (outbox->priv->n_waiting, GUINT_TO_POINTER (port_id))) {
+        for (i = 0; i < MSGPORT_PRIORITY_LAST; i++) {
+            for (item = outbox->priv->lanes[i].head; item; item = next) {
+                QueuedDelivery *queued = (QueuedDelivery *)item->data;
+
+                next = item->next;
+                if (queued->port_id != port_id) continue;
+
+                g_queue_delete_link (&outbox->priv->lanes[i], item);
+                _push_result (&results, queued->cb, queued->userdata, g_error_copy (error));
+                _queued_delivery_free (queued);
+            }
+        }
+    }
+
+    g_mutex_unlock (&outbox->priv->lock);
+
+    _report_results (&results);
+}
@@ -0,0 +1,108 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __MSGPORT_OUTBOX_H
+#define __MSGPORT_OUTBOX_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define MSGPORT_TYPE_OUTBOX (msgport_outbox_get_type())
+#define MSGPORT_OUTBOX(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), MSGPORT_TYPE_OUTBOX, MsgPortOutbox))
+#define MSGPORT_OUTBOX_CLASS(obj)  (G_TYPE_CHECK_CLASS_CAST((kls), MSGPORT_TYPE_OUTBOX, MsgPortOutboxClass))
+#define MSGPORT_IS_OUTBOX(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), MSGPORT_TYPE_OUTBOX))
+#define MSGPORT_IS_OUTBOX_CLASS(kls) (G_TYPE_CHECK_CLASS_TYPE((kls), MSGPORT_TYPE_OUTBOX))
+
+typedef struct _MsgPortOutbox MsgPortOutbox;
+typedef struct _MsgPortOutboxClass MsgPortOutboxClass;
+typedef struct _MsgPortOutboxPrivate MsgPortOutboxPrivate;
+
+/*
+ * Delivery lanes, messages in a higher lane are written out first.
+ * Values are part of the registerService() D-Bus API.
+ */
+typedef enum {
+    MSGPORT_PRIORITY_NORMAL = 0,
+    MSGPORT_PRIORITY_HIGH,
+
+    MSGPORT_PRIORITY_LAST
+} MsgPortPriority;
+
+struct _MsgPortOutbox
+{
+    GObject parent;
+
+    /* private */
+    MsgPortOutboxPrivate *priv;
+};
+
+struct _MsgPortOutboxClass
+{
+    GObjectClass parenet_class;
+};
+
+/*
+ * Called once the message is handed to the connection, error is NULL on success.
+ * It might be called before the send function returns.
+ */
+typedef void (*MsgPortOutboxCallback) (const GError *error, gpointer userdata);
+
+GType msgport_outbox_get_type (void);
+
+MsgPortOutbox *
+msgport_outbox_new (GDBusConnection *connection);
+
+void
+msgport_outbox_send (MsgPortOutbox *outbox,
+                     GDBusMessage *message,
+                     guint port_id,
+                     MsgPortPriority priority,
+                     MsgPortOutboxCallback cb,
+                     gpointer userdata);
+
+void
+msgport_outbox_set_channel (MsgPortOutbox *outbox,
+                            gint fd,
+                            GMainContext *context);
+
+void
+msgport_outbox_close_channel (MsgPortOutbox *outbox);
+
+void
+msgport_outbox_get_depth (MsgPortOutbox *outbox,
+                          guint *n_in_flight,
+                          guint *n_waiting);
+
+void
+msgport_outbox_cancel_port (MsgPortOutbox *outbox,
+                            guint port_id,
+                            const GError *error);
+
+G_END_DECLS
+
+#endif /* __MSGPORT_OUTBOX_H */
@@ -21,91 +21,1069 @@
  * 02110-1301 USA
  */
 
+#include "config.h"
+
 #include "server-socket.h"
-#include "libwebsockets.h"
-#include "priv-libwebsockets.h"
+#include "common/dbus-error.h"
+#include "common/log.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <glib-unix.h>
+#include <gio/gunixfdlist.h>
+#include <json-glib/json-glib.h>
+#include <libwebsockets.h>
 
 G_DEFINE_TYPE (MsgPortServerSocket, msgport_server_socket, G_TYPE_OBJECT)
 
 #define MSGPORT_SERVER_SOCKET_GET_PRIV(obj) \
     G_TYPE_INSTANCE_GET_PRIVATE ((obj), MSGPORT_TYPE_SERVER_SOCKET, MsgPortServerSocketPrivate)
 
+#define MSGPORT_DBUS_MANAGER_INTERFACE "org.tizen.messageport.Manager"
+#define MSGPORT_DBUS_SERVICE_INTERFACE "org.tizen.messageport.Service"
+
+/* web clients are never taken as tizen applications */
+#define MSGPORT_WEB_APP_ID_PREFIX "web:"
+#define MSGPORT_WEB_ORIGIN_MAX    256
+
+/* a client not reading its events is dropped instead of buffering them forever */
+#define MSGPORT_WEB_MAX_PENDING_FRAMES 4096
+#define MSGPORT_WEB_MAX_REQUEST_SIZE   (4 * 1024 * 1024)
+
+/*
+ * Web clients speak JSON over the "message-port" WebSocket protocol,
+ * one request or event per text frame:
+ *
+ *   {"id": 1, "method": "registerService", "params": {"port": "p", "trusted": false, "priority": 0}}
+ *   {"id": 2, "method": "checkForRemoteService", "params": {"app_id": "a", "port": "p", "trusted": false}}
+ *   {"id": 3, "method": "sendMessage", "params": {"service_id": 7, "data": {...}, "local_service_id": 5}}
+ *   {"id": 4, "method": "unregisterService", "params": {"service_id": 5}}
+ *
+ * are answered with {"id": N, "result": {...}} or
+ * {"id": N, "error": {"name": "...", "message": "..."}}, and events come as
+ *
+ *   {"event": "message", "service_id": 5, "data": {...}, "remote_app_id": "a",
+ *    "remote_port": "p", "remote_trusted": false}
+ *   {"event": "unregistered", "service_id": 5}
+ *   {"event": "remoteServiceUnregistered", "service_id": 7}
+ *   {"event": "deliveryFailed", "service_id": 7, "error": {...}}
+ *
+ * Message data values are strings, arrays of strings or arrays of bytes.
+ *
+ * Each web client is served by its own dbus manager over an in-process
+ * peer to peer connection, so that it shares the port registry, flow
+ * control and statistics with the native clients.
+ *
+ * The app id of a web client is taken from its Origin header, which
+ * only browsers enforce, so connections are accepted only from the
+ * configured origins.
+ */
+
 struct _MsgPortServerSocketPrivate {
-    GMainLoop *ml;
-    struct libwebsocket_context *context;
+    MsgPortDbusServer           *server;
+    GMainContext                *context;  /* libwebsockets is serviced on */
+    struct libwebsocket_context *ws_context;
+    GHashTable                  *watches;  /* {fd:MsgPortFdWatch*} */
+    GSource                     *timeout;  /* libwebsockets housekeeping */
+    gchar                      **allowed_origins;
 };
 
+typedef struct {
+    GSource *source;
+    gint     events;   /* poll events libwebsockets waits for */
+} MsgPortFdWatch;
+
+typedef struct {
+    volatile gint        ref_count;
+    MsgPortServerSocket *socket;      /* not owned */
+    struct libwebsocket *wsi;         /* NULL once closed */
+    gchar               *app_id;
+    GDBusConnection     *connection;  /* our end of the peer connection */
+    guint                filter_id;
+    gboolean             is_closing;
+    GString             *rx;          /* fragmented request */
+    GQueue               tx;          /* GByteArray* frames waiting to be written */
+    GQueue               pending;     /* gchar* requests arrived before connected */
+} MsgPortWebClient;
+
+/* per session data of the message-port protocol */
+typedef struct {
+    MsgPortWebClient *client;
+    gchar             origin[MSGPORT_WEB_ORIGIN_MAX];
+} MsgPortWebSession;
+
+typedef JsonNode * (*MsgPortWebReplyFunc) (GVariant *reply);
+
+typedef struct {
+    MsgPortWebClient    *client;
+    gint64               id;
+    MsgPortWebReplyFunc  reply_func;
+} MsgPortWebRequest;
+
+static void _web_client_handle_request (MsgPortWebClient *client, const gchar *text, gsize len);
+
+static MsgPortWebClient *
+_web_client_ref (MsgPortWebClient *client)
+{
+    g_atomic_int_inc (&client->ref_count);
+
+    return client;
+}
 
 static void
-_server_socket_finalize (GObject *self)
+_web_client_unref (gpointer data)
 {
-    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (self);
+    MsgPortWebClient *client = (MsgPortWebClient *)data;
 
-    if (socket->priv->context) {
-        libwebsocket_context_destroy (socket->priv->context);
-        socket->priv->context = NULL;
+    if (!client || !g_atomic_int_dec_and_test (&client->ref_count)) return;
+
+    g_clear_object (&client->connection);
+    g_free (client->app_id);
+    g_string_free (client->rx, TRUE);
+    g_queue_foreach (&client->tx, (GFunc)g_byte_array_unref, NULL);
+    g_queue_clear (&client->tx);
+    g_queue_foreach (&client->pending, (GFunc)g_free, NULL);
+    g_queue_clear (&client->pending);
+
+    g_slice_free (MsgPortWebClient, client);
+}
+
+static MsgPortWebClient *
+_web_client_new (MsgPortServerSocket *socket, struct libwebsocket *wsi, const gchar *origin)
+{
+    MsgPortWebClient *client = g_slice_new0 (MsgPortWebClient);
+
+    client->ref_count = 1;
+    client->socket = socket;
+    client->wsi = wsi;
+    client->app_id = g_strconcat (MSGPORT_WEB_APP_ID_PREFIX, origin, NULL);
+    client->rx = g_string_new (NULL);
+    g_queue_init (&client->tx);
+    g_queue_init (&client->pending);
+
+    return client;
+}
+
+static void
+_web_client_close (MsgPortWebClient *client)
+{
+    if (!client->wsi || client->is_closing) return;
+
+    /* libwebsockets closes the connection once we refuse to write */
+    client->is_closing = TRUE;
+    libwebsocket_callback_on_writable (client->socket->priv->ws_context, client->wsi);
+}
+
+static void
+_web_client_send (MsgPortWebClient *client, JsonNode *root)
+{
+    JsonGenerator *generator = NULL;
+    GByteArray *frame = NULL;
+    gchar *text = NULL;
+    gsize len = 0;
+
+    if (!client->wsi || client->is_closing) {
+        json_node_free (root);
+        return;
     }
 
-    G_OBJECT_CLASS (msgport_server_socket_parent_class)->finalize (self);
+    if (g_queue_get_length (&client->tx) >= MSGPORT_WEB_MAX_PENDING_FRAMES) {
+        WARN ("Web client '%s' is not reading its events, dropping it", client->app_id);
+        json_node_free (root);
+        _web_client_close (client);
+        return;
+    }
+
+    generator = json_generator_new ();
+    json_generator_set_root (generator, root);
+    text = json_generator_to_data (generator, &len);
+    g_object_unref (generator);
+    json_node_free (root);
+
+    /* libwebsockets needs room around the payload for framing */
+    frame = g_byte_array_sized_new (LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING);
+    g_byte_array_set_size (frame, LWS_SEND_BUFFER_PRE_PADDING);
+    g_byte_array_append (frame, (const guint8 *)text, len);
+    g_byte_array_set_size (frame, LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING);
+    g_free (text);
+
+    g_queue_push_tail (&client->tx, frame);
+    libwebsocket_callback_on_writable (client->socket->priv->ws_context, client->wsi);
+}
+
+static int
+_web_client_write (MsgPortWebClient *client)
+{
+    GByteArray *frame = NULL;
+    gsize len = 0;
+
+    if (client->is_closing) return -1;
+
+    if (!(frame = g_queue_pop_head (&client->tx))) return 0;
+
+    len = frame->len - LWS_SEND_BUFFER_PRE_PADDING - LWS_SEND_BUFFER_POST_PADDING;
+    if (libwebsocket_write (client->wsi, frame->data + LWS_SEND_BUFFER_PRE_PADDING,
+            len, LWS_WRITE_TEXT) < (int)len) {
+        WARN ("Fail to write to web client '%s'", client->app_id);
+        g_byte_array_unref (frame);
+        return -1;
+    }
+    g_byte_array_unref (frame);
+
+    if (!g_queue_is_empty (&client->tx))
+        libwebsocket_callback_on_writable (client->socket->priv->ws_context, client->wsi);
+
+    return 0;
+}
+
+/*
+ * JSON <-> bundle data
+ */
+static JsonNode *
+_data_to_json (GVariant *data)
+{
+    JsonObject *object = json_object_new ();
+    JsonNode *node = NULL;
+    GVariantIter iter;
+    const gchar *key = NULL;
+    GVariant *value = NULL;
+
+    g_variant_iter_init (&iter, data);
+    while (g_variant_iter_loop (&iter, "{&sv}", &key, &value)) {
+        JsonArray *array = NULL;
+        gsize i, n_items = 0;
+
+        if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+            json_object_set_string_member (object, key, g_variant_get_string (value, NULL));
+        }
+        else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY)) {
+            const gchar **strv = g_variant_get_strv (value, &n_items);
+
+            array = json_array_sized_new (n_items);
+            for (i = 0; i < n_items; i++) json_array_add_string_element (array, strv[i]);
+            json_object_set_array_member (object, key, array);
+            g_free (strv);
+        }
+        else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING)) {
+            const guchar *bytes = g_variant_get_fixed_array (value, &n_items, sizeof (guchar));
+
+            array = json_array_sized_new (n_items);
+            for (i = 0; i < n_items; i++) json_array_add_int_element (array, bytes[i]);
+            json_object_set_array_member (object, key, array);
+        }
+        else {
+            WARN ("Skipping value of unsupported type '%s' for key '%s'",
+                    g_variant_get_type_string (value), key);
+        }
+    }
+
+    node = json_node_new (JSON_NODE_OBJECT);
+    json_node_take_object (node, object);
+
+    return node;
+}
+
+static GVariant *
+_value_from_json (JsonNode *node)
+{
+    JsonArray *array = NULL;
+    GVariant *value = NULL;
+    gboolean is_bytes = FALSE;
+    guint i, len;
+
+    if (JSON_NODE_HOLDS_VALUE (node) && json_node_get_value_type (node) == G_TYPE_STRING)
+        return g_variant_new_string (json_node_get_string (node));
+
+    if (!JSON_NODE_HOLDS_ARRAY (node)) return NULL;
+
+    /* element type is decided by the first one, empty ones are string arrays */
+    array = json_node_get_array (node);
+    len = json_array_get_length (array);
+    if (len > 0) {
+        JsonNode *first = json_array_get_element (array, 0);
+        is_bytes = JSON_NODE_HOLDS_VALUE (first) && json_node_get_value_type (first) == G_TYPE_INT64;
+    }
+
+    if (is_bytes) {
+        GByteArray *bytes = g_byte_array_sized_new (len);
+
+        for (i = 0; i < len; i++) {
+            JsonNode *element = json_array_get_element (array, i);
+            gint64 byte;
+            guint8 value8;
+
+            if (!JSON_NODE_HOLDS_VALUE (element) || json_node_get_value_type (element) != G_TYPE_INT64 ||
+                (byte = json_node_get_int (element)) < 0 || byte > G_MAXUINT8) {
+                g_byte_array_unref (bytes);
+                return NULL;
+            }
+            value8 = (guint8) byte;
+            g_byte_array_append (bytes, &value8, 1);
+        }
+        value = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, bytes->data, bytes->len, sizeof (guchar));
+        g_byte_array_unref (bytes);
+    }
+    else {
+        const gchar **strv = g_new0 (const gchar *, len + 1);
+
+        for (i = 0; i < len; i++) {
+            JsonNode *element = json_array_get_element (array, i);
+
+            if (!JSON_NODE_HOLDS_VALUE (element) || json_node_get_value_type (element) != G_TYPE_STRING) {
+                g_free (strv);
+                return NULL;
+            }
+            strv[i] = json_node_get_string (element);
+        }
+        value = g_variant_new_strv (strv, len);
+        g_free (strv);
+    }
+
+    return value;
+}
+
+static GVariant *
+_data_from_json (JsonNode *node, GError **error)
+{
+    GVariantBuilder builder;
+    JsonObject *object = NULL;
+    GList *members = NULL, *member = NULL;
+
+    if (!node || !JSON_NODE_HOLDS_OBJECT (node)) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "message data must be an object");
+        return NULL;
+    }
+
+    object = json_node_get_object (node);
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    members = json_object_get_members (object);
+    for (member = members; member; member = member->next) {
+        const gchar *key = (const gchar *)member->data;
+        GVariant *value = _value_from_json (json_object_get_member (object, key));
+
+        if (!value) {
+            if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS,
+                    "unsupported value for key '%s'", key);
+            g_variant_builder_clear (&builder);
+            g_list_free (members);
+            return NULL;
+        }
+        g_variant_builder_add (&builder, "{sv}", key, value);
+    }
+    g_list_free (members);
+
+    return g_variant_builder_end (&builder);
+}
+
+/*
+ * Replies and events
+ */
+static guint
+_service_id_from_path (const gchar *object_path)
+{
+    /* service objects are exported at "/<id>" */
+    if (!object_path || object_path[0] != '/') return 0;
+
+    return (guint) g_ascii_strtoull (object_path + 1, NULL, 10);
+}
+
+static JsonNode *
+_error_to_json (const GError *error)
+{
+    JsonObject *object = json_object_new ();
+    JsonNode *node = NULL;
+    gchar *name = g_dbus_error_encode_gerror (error);
+    GError *copy = g_error_copy (error);
+
+    g_dbus_error_strip_remote_error (copy);
+    json_object_set_string_member (object, "name", name);
+    json_object_set_string_member (object, "message", copy->message);
+    g_free (name);
+    g_error_free (copy);
+
+    node = json_node_new (JSON_NODE_OBJECT);
+    json_node_take_object (node, object);
+
+    return node;
 }
 
 static void
-_server_socket_dispose (GObject *self)
+_web_client_reply (MsgPortWebClient *client, gint64 id, JsonNode *result, const GError *error)
 {
-    G_OBJECT_CLASS (msgport_server_socket_parent_class)->dispose (self);
+    JsonObject *object = json_object_new ();
+    JsonNode *root = NULL;
+
+    if (id) json_object_set_int_member (object, "id", id);
+    else json_object_set_null_member (object, "id");
+
+    if (error) json_object_set_member (object, "error", _error_to_json (error));
+    else json_object_set_member (object, "result", result ? result : json_node_new (JSON_NODE_OBJECT));
+
+    root = json_node_new (JSON_NODE_OBJECT);
+    json_node_take_object (root, object);
+
+    _web_client_send (client, root);
+}
+
+static JsonNode *
+_service_id_result (guint service_id)
+{
+    JsonObject *object = json_object_new ();
+    JsonNode *node = json_node_new (JSON_NODE_OBJECT);
+
+    json_object_set_int_member (object, "service_id", service_id);
+    json_node_take_object (node, object);
+
+    return node;
+}
+
+static JsonNode *
+_reply_service_path (GVariant *reply)
+{
+    const gchar *object_path = NULL;
+
+    g_variant_get (reply, "(&o)", &object_path);
+
+    return _service_id_result (_service_id_from_path (object_path));
+}
+
+static JsonNode *
+_reply_service_id (GVariant *reply)
+{
+    guint service_id = 0;
+
+    g_variant_get (reply, "(u)", &service_id);
+
+    return _service_id_result (service_id);
 }
 
 static void
-msgport_server_socket_init (MsgPortServerSocket *self)
+_on_request_reply (GObject *source, GAsyncResult *result, gpointer userdata)
 {
-    MsgPortServerSocketPrivate *priv = MSGPORT_SERVER_SOCKET_GET_PRIV (self);
+    MsgPortWebRequest *request = (MsgPortWebRequest *)userdata;
+    GError *error = NULL;
+    GVariant *reply = NULL;
 
-    self->priv = priv;
+    reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+    if (error) {
+        _web_client_reply (request->client, request->id, NULL, error);
+        g_error_free (error);
+    }
+    else {
+        _web_client_reply (request->client, request->id,
+                request->reply_func ? request->reply_func (reply) : NULL, NULL);
+        g_variant_unref (reply);
+    }
+
+    _web_client_unref (request->client);
+    g_slice_free (MsgPortWebRequest, request);
 }
 
 static void
-msgport_server_socket_class_init (MsgPortServerSocketClass *klass)
+_web_client_call (MsgPortWebClient *client,
+                  gint64 id,
+                  const gchar *object_path,
+                  const gchar *interface,
+                  const gchar *method,
+                  GVariant *params,
+                  const gchar *reply_type,
+                  MsgPortWebReplyFunc reply_func)
 {
-    GObjectClass *gklass = G_OBJECT_CLASS(klass);
+    MsgPortWebRequest *request = g_slice_new0 (MsgPortWebRequest);
 
-    g_type_class_add_private (klass, sizeof(MsgPortServerSocketPrivate));
+    request->client = _web_client_ref (client);
+    request->id = id;
+    request->reply_func = reply_func;
 
-    gklass->finalize = _server_socket_finalize;
-    gklass->dispose = _server_socket_dispose;
+    g_dbus_connection_call (client->connection, NULL, object_path, interface, method,
+            params, G_VARIANT_TYPE (reply_type), G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+            _on_request_reply, request);
 }
 
-struct MsgPortCallbackData {
-    MsgPortServerSocket *self;
-    struct libwebsocket_context *wsctx;
-};
+static void
+_web_client_send_event (MsgPortWebClient *client, const gchar *event, guint service_id, JsonObject *object)
+{
+    JsonNode *root = json_node_new (JSON_NODE_OBJECT);
+
+    json_object_set_string_member (object, "event", event);
+    json_object_set_int_member (object, "service_id", service_id);
+    json_node_take_object (root, object);
+
+    _web_client_send (client, root);
+}
 
-static gboolean 
-_fd_event (
-    GIOChannel *source,
-    GIOCondition condition,
-    gpointer data)
+static GVariant *
+_large_message_data (GDBusMessage *message, gint handle)
 {
-    struct pollfd pollfd ;
-    static libwebsocket_context *wsctx = (struct libwebsocket_context *)data;
+    GUnixFDList *fd_list = g_dbus_message_get_unix_fd_list (message);
+    GMappedFile *mapped = NULL;
+    GBytes *bytes = NULL;
+    GVariant *data = NULL;
+    GError *error = NULL;
+    gint fd = -1;
+
+    if (!fd_list || (fd = g_unix_fd_list_get (fd_list, handle, &error)) < 0) {
+        WARN ("Fail to get large message payload : %s", error ? error->message : "no fds");
+        g_clear_error (&error);
+        return NULL;
+    }
+
+    mapped = g_mapped_file_new_from_fd (fd, FALSE, &error);
+    close (fd);
+    if (!mapped) {
+        WARN ("Fail to map large message payload : %s", error->message);
+        g_error_free (error);
+        return NULL;
+    }
+
+    bytes = g_mapped_file_get_bytes (mapped);
+    data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE));
+    g_bytes_unref (bytes);
+    g_mapped_file_unref (mapped);
+
+    return data;
+}
+
+static void
+_web_client_dispatch_signal (MsgPortWebClient *client, GDBusMessage *message)
+{
+    const gchar *member = g_dbus_message_get_member (message);
+    GVariant *body = g_dbus_message_get_body (message);
+    guint service_id = _service_id_from_path (g_dbus_message_get_path (message));
+    JsonObject *object = NULL;
+
+    if (!g_strcmp0 (g_dbus_message_get_interface (message), MSGPORT_DBUS_SERVICE_INTERFACE)) {
+        GVariant *data = NULL;
+        const gchar *app_id = NULL, *port = NULL;
+        gboolean is_trusted = FALSE;
+
+        if (!g_strcmp0 (member, "unregistered")) {
+            _web_client_send_event (client, "unregistered", service_id, json_object_new ());
+            return;
+        }
+
+        if (!g_strcmp0 (member, "onMessage") && body &&
+            g_variant_is_of_type (body, G_VARIANT_TYPE ("(a{sv}ssb)"))) {
+            g_variant_get (body, "(@a{sv}&s&sb)", &data, &app_id, &port, &is_trusted);
+        }
+        else if (!g_strcmp0 (member, "onLargeMessage") && body &&
+                 g_variant_is_of_type (body, G_VARIANT_TYPE ("(hssb)"))) {
+            gint handle = -1;
+
+            g_variant_get (body, "(h&s&sb)", &handle, &app_id, &port, &is_trusted);
+            if (!(data = _large_message_data (message, handle))) return;
+        }
+        else return;
+
+        object = json_object_new ();
+        json_object_set_member (object, "data", _data_to_json (data));
+        json_object_set_string_member (object, "remote_app_id", app_id);
+        json_object_set_string_member (object, "remote_port", port);
+        json_object_set_boolean_member (object, "remote_trusted", is_trusted);
+        g_variant_unref (data);
+
+        _web_client_send_event (client, "message", service_id, object);
+    }
+    else if (!g_strcmp0 (g_dbus_message_get_interface (message), MSGPORT_DBUS_MANAGER_INTERFACE)) {
+        if (!g_strcmp0 (member, "remoteServiceUnregistered") && body &&
+            g_variant_is_of_type (body, G_VARIANT_TYPE ("(u)"))) {
+            g_variant_get (body, "(u)", &service_id);
+            _web_client_send_event (client, "remoteServiceUnregistered", service_id, json_object_new ());
+        }
+        else if (!g_strcmp0 (member, "messageDeliveryFailed") && body &&
+                 g_variant_is_of_type (body, G_VARIANT_TYPE ("(uss)"))) {
+            const gchar *name = NULL, *error_message = NULL;
+            JsonObject *error = json_object_new ();
+
+            g_variant_get (body, "(u&s&s)", &service_id, &name, &error_message);
+            json_object_set_string_member (error, "name", name);
+            json_object_set_string_member (error, "message", error_message);
+
+            object = json_object_new ();
+            json_object_set_object_member (object, "error", error);
+            _web_client_send_event (client, "deliveryFailed", service_id, object);
+        }
+    }
+}
+
+typedef struct {
+    MsgPortWebClient *client;
+    GDBusMessage     *message;
+} MsgPortWebSignal;
+
+static gboolean
+_on_signal_idle (gpointer userdata)
+{
+    MsgPortWebSignal *signal = (MsgPortWebSignal *)userdata;
+
+    _web_client_dispatch_signal (signal->client, signal->message);
+
+    return FALSE;
+}
+
+static void
+_web_signal_free (gpointer userdata)
+{
+    MsgPortWebSignal *signal = (MsgPortWebSignal *)userdata;
+
+    _web_client_unref (signal->client);
+    g_object_unref (signal->message);
+    g_slice_free (MsgPortWebSignal, signal);
+}
+
+/*
+ * Runs on the dbus worker thread, signals are handed over to the
+ * libwebsockets context in their arrival order.
+ */
+static GDBusMessage *
+_signal_filter (GDBusConnection *connection, GDBusMessage *message, gboolean incoming, gpointer userdata)
+{
+    MsgPortWebClient *client = (MsgPortWebClient *)userdata;
+    MsgPortWebSignal *signal = NULL;
+
+    if (!incoming || g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_SIGNAL)
+        return message;
+
+    signal = g_slice_new (MsgPortWebSignal);
+    signal->client = _web_client_ref (client);
+    signal->message = message; /* takes the ownership */
+
+    g_main_context_invoke_full (client->socket->priv->context, G_PRIORITY_DEFAULT,
+            _on_signal_idle, signal, _web_signal_free);
+
+    return NULL;
+}
+
+/*
+ * Peer connection
+ */
+static void
+_on_daemon_side_ready (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    MsgPortWebClient *client = (MsgPortWebClient *)userdata;
+    GDBusConnection *connection = NULL;
+    GError *error = NULL;
+
+    connection = g_dbus_connection_new_finish (result, &error);
+    if (!connection) {
+        WARN ("Fail to setup connection for web client '%s' : %s", client->app_id, error->message);
+        g_error_free (error);
+        _web_client_close (client);
+        _web_client_unref (client);
+        return;
+    }
+
+    /* the dbus manager holds the connection from now on */
+    msgport_dbus_server_start_dbus_manager_for_connection (
+            client->socket->priv->server, connection, client->app_id);
+    g_dbus_connection_start_message_processing (connection);
+    g_object_unref (connection);
+
+    _web_client_unref (client);
+}
+
+static void
+_on_client_side_ready (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    MsgPortWebClient *client = (MsgPortWebClient *)userdata;
+    GDBusConnection *connection = NULL;
+    GError *error = NULL;
+    gchar *text = NULL;
+
+    connection = g_dbus_connection_new_finish (result, &error);
+    if (!connection) {
+        WARN ("Fail to connect web client '%s' : %s", client->app_id, error->message);
+        g_error_free (error);
+        _web_client_close (client);
+        _web_client_unref (client);
+        return;
+    }
+
+    /* web socket closed meanwhile */
+    if (!client->wsi) {
+        g_dbus_connection_close (connection, NULL, NULL, NULL);
+        g_object_unref (connection);
+        _web_client_unref (client);
+        return;
+    }
 
-    pollfd.fd = g_io_channel_get_unix_fd (source);
-    pollfd.events = condition; // FIXME: convert to poll events ??
-    pollfd.revents = ; // FIXME: what it should ?? 
+    client->connection = connection;
+    client->filter_id = g_dbus_connection_add_filter (connection, _signal_filter,
+            _web_client_ref (client), _web_client_unref);
 
-    libwebsocket_service_fd (wsctx, pollfd);
+    while ((text = g_queue_pop_head (&client->pending)) != NULL) {
+        _web_client_handle_request (client, text, strlen (text));
+        g_free (text);
+    }
+
+    _web_client_unref (client);
+}
+
+static gboolean
+_web_client_connect (MsgPortWebClient *client, GError **error)
+{
+    GSocket *sockets[2] = { NULL, NULL };
+    GIOStream *streams[2] = { NULL, NULL };
+    gchar *guid = NULL;
+    int fds[2];
+    int i;
+
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_IO_ERROR,
+                "socketpair failed : %s", g_strerror (errno));
+        return FALSE;
+    }
+
+    if (!(sockets[0] = g_socket_new_from_fd (fds[0], error))) {
+        close (fds[0]);
+        close (fds[1]);
+        return FALSE;
+    }
+    if (!(sockets[1] = g_socket_new_from_fd (fds[1], error))) {
+        g_object_unref (sockets[0]);
+        close (fds[1]);
+        return FALSE;
+    }
+
+    for (i = 0; i < 2; i++) {
+        streams[i] = G_IO_STREAM (g_socket_connection_factory_create_connection (sockets[i]));
+        g_object_unref (sockets[i]);
+    }
+
+    /* both ends authenticate each other concurrently on the dbus worker */
+    guid = g_dbus_generate_guid ();
+    g_dbus_connection_new (streams[0], guid,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER |
+            G_DBUS_CONNECTION_FLAGS_DELAY_MESSAGE_PROCESSING,
+            NULL, NULL, _on_daemon_side_ready, _web_client_ref (client));
+    g_dbus_connection_new (streams[1], NULL,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+            NULL, NULL, _on_client_side_ready, _web_client_ref (client));
+    g_free (guid);
+
+    g_object_unref (streams[0]);
+    g_object_unref (streams[1]);
+
+    return TRUE;
+}
+
+static void
+_web_client_disconnect (MsgPortWebClient *client)
+{
+    client->wsi = NULL;
+
+    if (client->connection) {
+        g_dbus_connection_remove_filter (client->connection, client->filter_id);
+        /* daemon side notices it and releases the ports of the client */
+        g_dbus_connection_close (client->connection, NULL, NULL, NULL);
+    }
+}
+
+/*
+ * Requests
+ */
+static gboolean
+_get_string_param (JsonObject *params, const gchar *name, const gchar **value, GError **error)
+{
+    JsonNode *node = params ? json_object_get_member (params, name) : NULL;
+
+    if (!node || !JSON_NODE_HOLDS_VALUE (node) || json_node_get_value_type (node) != G_TYPE_STRING) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS,
+                "missing string parameter '%s'", name);
+        return FALSE;
+    }
+    *value = json_node_get_string (node);
+
+    return TRUE;
+}
+
+static gboolean
+_get_uint_param (JsonObject *params, const gchar *name, gboolean is_optional, guint *value, GError **error)
+{
+    JsonNode *node = params ? json_object_get_member (params, name) : NULL;
+
+    if (!node && is_optional) return TRUE;
+
+    if (!node || !JSON_NODE_HOLDS_VALUE (node) || json_node_get_value_type (node) != G_TYPE_INT64 ||
+        json_node_get_int (node) < 0 || json_node_get_int (node) > G_MAXUINT) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS,
+                "invalid or missing parameter '%s'", name);
+        return FALSE;
+    }
+    *value = (guint) json_node_get_int (node);
+
+    return TRUE;
+}
+
+static gboolean
+_get_boolean_param (JsonObject *params, const gchar *name, gboolean *value, GError **error)
+{
+    JsonNode *node = params ? json_object_get_member (params, name) : NULL;
+
+    /* optional, defaults to FALSE */
+    if (!node) return TRUE;
+
+    if (!JSON_NODE_HOLDS_VALUE (node) || json_node_get_value_type (node) != G_TYPE_BOOLEAN) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS,
+                "parameter '%s' must be a boolean", name);
+        return FALSE;
+    }
+    *value = json_node_get_boolean (node);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_register_service (MsgPortWebClient *client, gint64 id, JsonObject *params, GError **error)
+{
+    const gchar *port = NULL;
+    gboolean is_trusted = FALSE;
+    guint priority = 0;
+
+    if (!_get_string_param (params, "port", &port, error) ||
+        !_get_boolean_param (params, "trusted", &is_trusted, error) ||
+        !_get_uint_param (params, "priority", TRUE, &priority, error))
+        return FALSE;
+
+    _web_client_call (client, id, "/", MSGPORT_DBUS_MANAGER_INTERFACE, "registerService",
+            g_variant_new ("(sbu)", port, is_trusted, priority), "(o)", _reply_service_path);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_check_for_remote_service (MsgPortWebClient *client, gint64 id, JsonObject *params, GError **error)
+{
+    const gchar *app_id = NULL, *port = NULL;
+    gboolean is_trusted = FALSE;
+
+    if (!_get_string_param (params, "app_id", &app_id, error) ||
+        !_get_string_param (params, "port", &port, error) ||
+        !_get_boolean_param (params, "trusted", &is_trusted, error))
+        return FALSE;
+
+    _web_client_call (client, id, "/", MSGPORT_DBUS_MANAGER_INTERFACE, "checkForRemoteService",
+            g_variant_new ("(ssb)", app_id, port, is_trusted), "(u)", _reply_service_id);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_send_message (MsgPortWebClient *client, gint64 id, JsonObject *params, GError **error)
+{
+    guint service_id = 0, local_service_id = 0;
+    GVariant *data = NULL;
+    gchar *object_path = NULL;
+
+    if (!_get_uint_param (params, "service_id", FALSE, &service_id, error) ||
+        !_get_uint_param (params, "local_service_id", TRUE, &local_service_id, error))
+        return FALSE;
+
+    if (!(data = _data_from_json (json_object_get_member (params, "data"), error)))
+        return FALSE;
+
+    /* replies go to the local port if the message is sent from one */
+    if (local_service_id) {
+        object_path = g_strdup_printf ("/%u", local_service_id);
+        _web_client_call (client, id, object_path, MSGPORT_DBUS_SERVICE_INTERFACE, "sendMessage",
+                g_variant_new ("(u@a{sv})", service_id, data), "()", NULL);
+        g_free (object_path);
+    }
+    else {
+        _web_client_call (client, id, "/", MSGPORT_DBUS_MANAGER_INTERFACE, "sendMessage",
+                g_variant_new ("(u@a{sv})", service_id, data), "()", NULL);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_handle_unregister_service (MsgPortWebClient *client, gint64 id, JsonObject *params, GError **error)
+{
+    guint service_id = 0;
+    gchar *object_path = NULL;
+
+    if (!_get_uint_param (params, "service_id", FALSE, &service_id, error))
+        return FALSE;
+
+    object_path = g_strdup_printf ("/%u", service_id);
+    _web_client_call (client, id, object_path, MSGPORT_DBUS_SERVICE_INTERFACE, "unregister",
+            NULL, "()", NULL);
+    g_free (object_path);
+
+    return TRUE;
+}
+
+static const struct {
+    const gchar *method;
+    gboolean   (*handler) (MsgPortWebClient *client, gint64 id, JsonObject *params, GError **error);
+} _request_handlers[] = {
+    { "registerService",       _handle_register_service },
+    { "checkForRemoteService", _handle_check_for_remote_service },
+    { "sendMessage",           _handle_send_message },
+    { "unregisterService",     _handle_unregister_service },
 };
 
 static void
-_add_fd_to_main_loop (
-    MsgPortServerSocket *socket,
-    int fd,
-    int events)
+_web_client_handle_request (MsgPortWebClient *client, const gchar *text, gsize len)
 {
-    if (socket->priv->ml) {
-        GIOChannel *io = g_io_channel_unix_new (fd);
-        g_io_add_watch (io, events, _fd_event, socket);
+    JsonParser *parser = json_parser_new ();
+    JsonNode *root = NULL;
+    JsonObject *request = NULL;
+    JsonNode *node = NULL;
+    const gchar *method = NULL;
+    gint64 id = 0;
+    GError *error = NULL;
+    guint i;
+
+    if (!json_parser_load_from_data (parser, text, len, &error)) {
+        _web_client_reply (client, 0, NULL, error);
+        goto out;
     }
 
+    root = json_parser_get_root (parser);
+    if (!root || !JSON_NODE_HOLDS_OBJECT (root)) {
+        error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "request must be an object");
+        _web_client_reply (client, 0, NULL, error);
+        goto out;
+    }
+    request = json_node_get_object (root);
+
+    if ((node = json_object_get_member (request, "id")) &&
+        JSON_NODE_HOLDS_VALUE (node) && json_node_get_value_type (node) == G_TYPE_INT64)
+        id = json_node_get_int (node);
+
+    if ((node = json_object_get_member (request, "method")) &&
+        JSON_NODE_HOLDS_VALUE (node) && json_node_get_value_type (node) == G_TYPE_STRING)
+        method = json_node_get_string (node);
+
+    if ((node = json_object_get_member (request, "params")) && !JSON_NODE_HOLDS_OBJECT (node)) {
+        error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "params must be an object");
+        _web_client_reply (client, id, NULL, error);
+        goto out;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (_request_handlers); i++) {
+        if (g_strcmp0 (method, _request_handlers[i].method)) continue;
+
+        if (!_request_handlers[i].handler (client, id,
+                node ? json_node_get_object (node) : NULL, &error))
+            _web_client_reply (client, id, NULL, error);
+        goto out;
+    }
+
+    error = msgport_error_new (MSGPORT_ERROR_INVALID_PARAMS, "unknown method '%s'", method ? method : "");
+    _web_client_reply (client, id, NULL, error);
+
+out:
+    if (error) g_error_free (error);
+    g_object_unref (parser);
+}
+
+static int
+_web_client_receive (MsgPortWebClient *client, struct libwebsocket *wsi, const gchar *in, gsize len)
+{
+    if (client->rx->len + len > MSGPORT_WEB_MAX_REQUEST_SIZE) {
+        WARN ("Too large request from web client '%s'", client->app_id);
+        return -1;
+    }
+    g_string_append_len (client->rx, in, len);
+
+    if (!libwebsocket_is_final_fragment (wsi) || libwebsockets_remaining_packet_payload (wsi))
+        return 0;
+
+    if (!client->connection)
+        g_queue_push_tail (&client->pending, g_strndup (client->rx->str, client->rx->len));
+    else
+        _web_client_handle_request (client, client->rx->str, client->rx->len);
+    g_string_truncate (client->rx, 0);
+
+    return 0;
+}
+
+/*
+ * libwebsockets main loop integration
+ */
+static GIOCondition
+_poll_events_to_condition (gint events)
+{
+    GIOCondition condition = 0;
+
+    if (events & POLLIN) condition |= G_IO_IN;
+    if (events & POLLOUT) condition |= G_IO_OUT;
+
+    return condition | G_IO_HUP | G_IO_ERR;
+}
+
+static gint
+_condition_to_poll_events (GIOCondition condition)
+{
+    gint events = 0;
+
+    if (condition & G_IO_IN) events |= POLLIN;
+    if (condition & G_IO_OUT) events |= POLLOUT;
+    if (condition & G_IO_HUP) events |= POLLHUP;
+    if (condition & G_IO_ERR) events |= POLLERR;
+
+    return events;
+}
+
+static gboolean
+_on_fd_event (gint fd, GIOCondition condition, gpointer userdata)
+{
+    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (userdata);
+    MsgPortFdWatch *watch = g_hash_table_lookup (socket->priv->watches, GINT_TO_POINTER (fd));
+    struct pollfd pollfd;
+
+    if (!watch) return FALSE;
+
+    pollfd.fd = fd;
+    pollfd.events = watch->events;
+    pollfd.revents = _condition_to_poll_events (condition);
+
+    /* might remove this watch through the poll callbacks */
+    libwebsocket_service_fd (socket->priv->ws_context, &pollfd);
+
+    return TRUE;
+}
+
+static void
+_fd_watch_free (gpointer data)
+{
+    MsgPortFdWatch *watch = (MsgPortFdWatch *)data;
+
+    g_source_destroy (watch->source);
+    g_source_unref (watch->source);
+    g_slice_free (MsgPortFdWatch, watch);
+}
+
+static void
+_watch_fd (MsgPortServerSocket *socket, gint fd, gint events)
+{
+    MsgPortFdWatch *watch = g_slice_new0 (MsgPortFdWatch);
+
+    watch->events = events;
+    watch->source = g_unix_fd_source_new (fd, _poll_events_to_condition (events));
+    g_source_set_callback (watch->source, (GSourceFunc)_on_fd_event, socket, NULL);
+    g_source_attach (watch->source, socket->priv->context);
+
+    g_hash_table_replace (socket->priv->watches, GINT_TO_POINTER (fd), watch);
+}
+
+static gboolean
+_on_housekeeping_timeout (gpointer userdata)
+{
+    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (userdata);
+
+    /* expires the stalled handshakes and close waits */
+    libwebsocket_service_fd (socket->priv->ws_context, NULL);
+
+    return TRUE;
+}
 
 static int
 _http_callback (
@@ -113,93 +1091,232 @@ _http_callback (
     struct libwebsocket               *wsi,
     enum libwebsocket_callback_reasons reason,
     void  *user,
-    void  *in, 
+    void  *in,
     size_t len)
 {
+    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (libwebsocket_context_user (context));
+    struct libwebsocket_pollargs *args = (struct libwebsocket_pollargs *)in;
+
     switch (reason) {
+        case LWS_CALLBACK_ADD_POLL_FD:
+        case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+            /* GSource conditions can not be changed, so replaced */
+            _watch_fd (socket, args->fd, args->events);
+            break;
+
+        case LWS_CALLBACK_DEL_POLL_FD:
+            g_hash_table_remove (socket->priv->watches, GINT_TO_POINTER (args->fd));
+            break;
+
         case LWS_CALLBACK_HTTP:
-        /* client connected */
-        break;
+            /* only web socket clients are served */
+            return -1;
 
         default:
-        g_print ("%s reason %d\n", __FUNCTION_NAME__, reason);
+            break;
     }
 
     return 0;
 }
 
+static gboolean
+_is_allowed_origin (MsgPortServerSocket *socket, const gchar *origin)
+{
+    gchar **allowed = NULL;
+
+    if (!origin || !origin[0]) return FALSE;
+
+    for (allowed = socket->priv->allowed_origins; allowed && *allowed; allowed++)
+        if (!g_strcmp0 (*allowed, origin)) return TRUE;
+
+    return FALSE;
+}
+
 static int
 _msgport_callback (
     struct libwebsocket_context       *context,
     struct libwebsocket               *wsi,
     enum libwebsocket_callback_reasons reason,
     void  *user,
-    void  *in, 
+    void  *in,
     size_t len)
 {
+    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (libwebsocket_context_user (context));
+    MsgPortWebSession *session = (MsgPortWebSession *)user;
+    GError *error = NULL;
+
     switch (reason) {
+        case LWS_CALLBACK_FILTER_PROTOCOL_CONNECTION:
+            /* headers are not available once established */
+            if (!session) return -1;
+            session->origin[0] = '\0';
+            if (lws_hdr_copy (wsi, session->origin, sizeof (session->origin), WSI_TOKEN_ORIGIN) < 0)
+                session->origin[0] = '\0';
+            if (!_is_allowed_origin (socket, session->origin)) {
+                WARN ("Refusing web client from origin '%s'", session->origin);
+                return -1;
+            }
+            break;
+
         case LWS_CALLBACK_ESTABLISHED:
-        break;
+            session->client = _web_client_new (socket, wsi, session->origin);
+            DBG ("Web client '%s' connected", session->client->app_id);
+            if (!_web_client_connect (session->client, &error)) {
+                WARN ("Fail to serve web client '%s' : %s", session->client->app_id, error->message);
+                g_error_free (error);
+                _web_client_unref (session->client);
+                session->client = NULL;
+                return -1;
+            }
+            break;
+
+        case LWS_CALLBACK_RECEIVE:
+            if (!session->client) return -1;
+            return _web_client_receive (session->client, wsi, (const gchar *)in, len);
+
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            if (!session->client) return -1;
+            return _web_client_write (session->client);
+
+        case LWS_CALLBACK_CLOSED:
+            if (!session->client) break;
+            DBG ("Web client '%s' disconnected", session->client->app_id);
+            _web_client_disconnect (session->client);
+            _web_client_unref (session->client);
+            session->client = NULL;
+            break;
 
         default:
-        g_print ("%s reason %d\n", __FUNCTION_NAME__, reason);
+            break;
     }
 
     return 0;
 }
 
+static struct libwebsocket_protocols _protocols[] = {
+    /* first protocol must always be HTTP handler */
+    { "http-only",    _http_callback,    0,                          0 },
+    { "message-port", _msgport_callback, sizeof (MsgPortWebSession), 0 },
+    { NULL, NULL, 0, 0 }
+};
 
+static void
+_server_socket_dispose (GObject *self)
+{
+    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (self);
 
-MsgPortServerSocket *
-msgport_server_socket_new (GMainLoop *ml)
+    /* closes the clients, poll callbacks still need the watches */
+    if (socket->priv->ws_context) {
+        libwebsocket_context_destroy (socket->priv->ws_context);
+        socket->priv->ws_context = NULL;
+    }
+
+    if (socket->priv->timeout) {
+        g_source_destroy (socket->priv->timeout);
+        g_source_unref (socket->priv->timeout);
+        socket->priv->timeout = NULL;
+    }
+
+    if (socket->priv->watches) {
+        g_hash_table_unref (socket->priv->watches);
+        socket->priv->watches = NULL;
+    }
+
+    g_clear_object (&socket->priv->server);
+
+    G_OBJECT_CLASS (msgport_server_socket_parent_class)->dispose (self);
+}
+
+static void
+_server_socket_finalize (GObject *self)
 {
-    struct lws_context_creation_info info;
-    static struct libwebsocket_protocols protocols[] = {
-        /* first protocol must always be HTTP handler */
-        { "http-only",   _http_callback,    sizeof (void *), 0, },
-        { "messge-port", _msgport_callback, sizeof (void *), 0, },
-        { NULL, NULL, 0, 0 }
-    };
+    MsgPortServerSocket *socket = MSGPORT_SERVER_SOCKET (self);
 
-    MsgPortServerSocket *socket = NULL;
+    if (socket->priv->context) {
+        g_main_context_unref (socket->priv->context);
+        socket->priv->context = NULL;
+    }
 
-    socket = MSGPORT_SERVER_SOCKET (g_object_new (MSGPORT_TYPE_SERVER_SOCKET, NULL));
-    if (!socket) return NULL;
-
-    info.port = 9000;
-    info.iface = NULL;
-    info.protocols = protocols;
-    info.extensions = libwebsocket_get_internal_extensions();
-    info.ssl_cert_filepath = NULL;
-    info.ssl_private_key_filepath = NULL;
-    info.ssl_cipher_list = NULL;
-    /* FIXME: set socket permessions */
-    info.gid = -1; info.uid = -1;
-    info.options = 0;
-    info.user = socket;
-    info.ka_time = 0;
-    info.ka_probes = 0;
-    info.ka_interval = 0;
+    g_strfreev (socket->priv->allowed_origins);
+    socket->priv->allowed_origins = NULL;
 
-    socket->priv->context = libwebsocket_create_context (&info);
-    socket->priv->ml = g_main_loop_ref (ml);
+    G_OBJECT_CLASS (msgport_server_socket_parent_class)->finalize (self);
 }
 
-gboolean
-msgport_server_socket_start (MsgPortServerSocket *socket)
+static void
+msgport_server_socket_init (MsgPortServerSocket *self)
 {
-    g_return_val_if_fail (socket && MSGPORT_IS_SERVER_SOCKET (socket), FALSE);
+    MsgPortServerSocketPrivate *priv = MSGPORT_SERVER_SOCKET_GET_PRIV (self);
 
-    if (!socket->priv->ml) {
-        /* run libwesocket loop if no super mainloop */
-        while (1) {
-            libwebsocket_service (socket->priv.>context, 50);
-        }
+    priv->server = NULL;
+    priv->context = NULL;
+    priv->ws_context = NULL;
+    priv->watches = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, _fd_watch_free);
+    priv->timeout = NULL;
+    priv->allowed_origins = NULL;
+
+    self->priv = priv;
+}
+
+static void
+msgport_server_socket_class_init (MsgPortServerSocketClass *klass)
+{
+    GObjectClass *gklass = G_OBJECT_CLASS(klass);
+
+    g_type_class_add_private (klass, sizeof(MsgPortServerSocketPrivate));
+
+    gklass->finalize = _server_socket_finalize;
+    gklass->dispose = _server_socket_dispose;
+}
+
+/*
+ * Listens for web clients on the loopback interface, the sockets are
+ * serviced on the thread default main context of the caller. Only the
+ * clients sending one of allowed_origins as Origin are accepted.
+ */
+MsgPortServerSocket *
+msgport_server_socket_new (MsgPortDbusServer *server, guint port, const gchar * const *allowed_origins, GError **error)
+{
+    struct lws_context_creation_info info;
+    MsgPortServerSocket *socket = NULL;
+
+    msgport_return_val_if_fail_with_error (server && MSGPORT_IS_DBUS_SERVER (server), NULL, error);
+    msgport_return_val_if_fail_with_error (port > 0 && port <= G_MAXUINT16, NULL, error);
+    msgport_return_val_if_fail_with_error (allowed_origins && allowed_origins[0], NULL, error);
+
+    socket = MSGPORT_SERVER_SOCKET (g_object_new (MSGPORT_TYPE_SERVER_SOCKET, NULL));
+    if (!socket) {
+        if (error) *error = msgport_error_no_memory_new ();
+        return NULL;
     }
-    else {
-        /* integrate to super mainloop */
+
+    socket->priv->server = g_object_ref (server);
+    socket->priv->allowed_origins = g_strdupv ((gchar **)allowed_origins);
+    /* listening socket is added through the poll callbacks while creating */
+    socket->priv->context = g_main_context_ref_thread_default ();
+
+    memset (&info, 0, sizeof (info));
+    info.port = port;
+    info.iface = "lo";
+    info.protocols = _protocols;
+    info.extensions = libwebsocket_get_internal_extensions ();
+    info.gid = -1;
+    info.uid = -1;
+    info.user = socket;
+
+    socket->priv->ws_context = libwebsocket_create_context (&info);
+    if (!socket->priv->ws_context) {
+        if (error) *error = msgport_error_new (MSGPORT_ERROR_IO_ERROR,
+                "could not listen for web clients on port %u", port);
+        g_object_unref (socket);
+        return NULL;
     }
 
-    return TRUE;
-}
+    socket->priv->timeout = g_timeout_source_new_seconds (1);
+    g_source_set_callback (socket->priv->timeout, _on_housekeeping_timeout, socket, NULL);
+    g_source_attach (socket->priv->timeout, socket->priv->context);
+
+    DBG ("Listening for web clients on port %u", port);
 
+    return socket;
+}
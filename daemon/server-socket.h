@@ -26,6 +26,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include "dbus-server.h"
 
 G_BEGIN_DECLS
 
@@ -55,10 +56,10 @@ struct _MsgPortServerSocketClass
 GType msgport_server_socket_get_type (void);
 
 MsgPortServerSocket *
-msgport_server_socket_new ();
-
-gboolean
-msgport_server_socket_start ();
+msgport_server_socket_new (MsgPortDbusServer *server,
+                           guint port,
+                           const gchar * const *allowed_origins,
+                           GError **error);
 
 G_END_DECLS
 
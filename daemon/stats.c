@@ -0,0 +1,343 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "stats.h"
+#include "cert-cache.h"
+#include "dbus-manager.h"
+#include "dbus-service.h"
+#include "manager.h"
+#include "outbox.h"
+#include "common/dbus-error.h"
+#include "common/log.h"
+#include "utils.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * Counters are only ever incremented on the request paths, with atomic
+ * adds, and gathered when someone asks for them over the Stats interface.
+ */
+
+/* i-th bucket counts latencies below 2^i microseconds, the last one the rest */
+#define MSGPORT_STATS_N_LATENCY_BUCKETS 24
+
+#define MSGPORT_STATS_N_ERRORS (MSGPORT_ERROR_UNKNOWN - MSGPORT_ERROR_IO_ERROR + 1)
+
+static const gchar *__handler_names[MSGPORT_STATS_HANDLER_LAST] = {
+    "registerService",
+    "checkForRemoteService",
+    "sendMessage",
+    "sendLargeMessage",
+    "sendMessages"
+};
+
+static MsgPortCounter __latencies[MSGPORT_STATS_HANDLER_LAST][MSGPORT_STATS_N_LATENCY_BUCKETS];
+static MsgPortCounter __send_errors[MSGPORT_STATS_N_ERRORS];
+
+void
+msgport_stats_record_latency (MsgPortStatsHandler handler, gint64 started)
+{
+    gint64 elapsed = g_get_monotonic_time () - started;
+    guint bucket = 0;
+
+    msgport_return_if_fail (handler < MSGPORT_STATS_HANDLER_LAST);
+
+    while (bucket < MSGPORT_STATS_N_LATENCY_BUCKETS - 1 && elapsed >= ((gint64)1 << bucket))
+        bucket++;
+
+    msgport_counter_add (&__latencies[handler][bucket], 1);
+}
+
+void
+msgport_stats_count_send_error (const GError *error)
+{
+    gint code = MSGPORT_ERROR_UNKNOWN;
+
+    msgport_return_if_fail (error);
+
+    if (error->domain == MSGPORT_ERROR_QUARK &&
+        error->code >= MSGPORT_ERROR_IO_ERROR && error->code <= MSGPORT_ERROR_UNKNOWN)
+        code = error->code;
+
+    msgport_counter_add (&__send_errors[code - MSGPORT_ERROR_IO_ERROR], 1);
+}
+
+/*
+ * Size of the large message payload, 0 if it is not a valid one.
+ */
+gsize
+msgport_stats_get_payload_size (GUnixFDList *fd_list, gint payload)
+{
+    const gint *fds = NULL;
+    gint n_fds = 0;
+    struct stat st;
+
+    if (!fd_list) return 0;
+
+    fds = g_unix_fd_list_peek_fds (fd_list, &n_fds);
+    if (payload < 0 || payload >= n_fds || fstat (fds[payload], &st) < 0)
+        return 0;
+
+    return (gsize)st.st_size;
+}
+
+static gboolean
+_handle_get_services (MsgPortDbusServer *server, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+    MsgPortDbusGlueStats *skeleton = MSGPORT_DBUS_GLUE_STATS (userdata);
+    MsgPortManager *manager = msgport_manager_new ();
+    GVariantBuilder builder;
+    GList *services = NULL;
+    GList *item = NULL;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ussbutt)"));
+
+    services = msgport_manager_get_services (manager);
+    for (item = services; item; item = item->next) {
+        MsgPortDbusService *service = MSGPORT_DBUS_SERVICE (item->data);
+        guint64 messages = 0, bytes = 0;
+
+        msgport_dbus_service_get_traffic (service, &messages, &bytes);
+        g_variant_builder_add (&builder, "(ussbutt)",
+                msgport_dbus_service_get_id (service),
+                msgport_dbus_service_get_app_id (service) ? msgport_dbus_service_get_app_id (service) : "",
+                msgport_dbus_service_get_port_name (service),
+                msgport_dbus_service_get_is_trusted (service),
+                (guint)msgport_dbus_service_get_priority (service),
+                messages, bytes);
+    }
+    g_list_free_full (services, g_object_unref);
+    g_object_unref (manager);
+
+    msgport_dbus_glue_stats_complete_get_services (skeleton, invocation,
+            g_variant_builder_end (&builder));
+
+    return TRUE;
+}
+
+typedef struct {
+    guint64 messages;
+    guint64 bytes;
+} TrafficSum;
+
+static gboolean
+_handle_get_connections (MsgPortDbusServer *server, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+    MsgPortDbusGlueStats *skeleton = MSGPORT_DBUS_GLUE_STATS (userdata);
+    MsgPortManager *manager = msgport_manager_new ();
+    GHashTable *received = NULL; /* {MsgPortDbusManager*:TrafficSum*} of owned services */
+    GVariantBuilder builder;
+    GList *dbus_managers = NULL;
+    GList *services = NULL;
+    GList *item = NULL;
+
+    /* traffic received by a client is the sum of its ports' */
+    received = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    services = msgport_manager_get_services (manager);
+    for (item = services; item; item = item->next) {
+        MsgPortDbusService *service = MSGPORT_DBUS_SERVICE (item->data);
+        MsgPortDbusManager *owner = msgport_dbus_service_get_owner (service);
+        TrafficSum *sum = g_hash_table_lookup (received, owner);
+        guint64 messages = 0, bytes = 0;
+
+        if (!sum) {
+            sum = g_new0 (TrafficSum, 1);
+            g_hash_table_insert (received, owner, sum);
+        }
+        msgport_dbus_service_get_traffic (service, &messages, &bytes);
+        sum->messages += messages;
+        sum->bytes += bytes;
+    }
+    g_list_free_full (services, g_object_unref);
+    g_object_unref (manager);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sttttuau)"));
+
+    dbus_managers = msgport_dbus_server_get_dbus_managers (server);
+    for (item = dbus_managers; item; item = item->next) {
+        MsgPortDbusManager *dbus_manager = MSGPORT_DBUS_MANAGER (item->data);
+        TrafficSum *sum = g_hash_table_lookup (received, dbus_manager);
+        guint64 messages = 0, bytes = 0;
+        guint n_in_flight = 0;
+        guint n_waiting[MSGPORT_PRIORITY_LAST] = { 0 };
+        GVariant *waiting = NULL;
+
+        msgport_dbus_manager_get_traffic (dbus_manager, &messages, &bytes);
+        msgport_outbox_get_depth (msgport_dbus_manager_get_outbox (dbus_manager), &n_in_flight, n_waiting);
+        waiting = g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32, n_waiting,
+                MSGPORT_PRIORITY_LAST, sizeof (guint32));
+
+        g_variant_builder_add (&builder, "(sttttu@au)",
+                msgport_dbus_manager_get_app_id (dbus_manager) ? msgport_dbus_manager_get_app_id (dbus_manager) : "",
+                messages, bytes,
+                sum ? sum->messages : (guint64)0, sum ? sum->bytes : (guint64)0,
+                n_in_flight, waiting);
+    }
+    g_list_free_full (dbus_managers, g_object_unref);
+    g_hash_table_unref (received);
+
+    msgport_dbus_glue_stats_complete_get_connections (skeleton, invocation,
+            g_variant_builder_end (&builder));
+
+    return TRUE;
+}
+
+static gboolean
+_handle_get_send_errors (MsgPortDbusServer *server, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+    MsgPortDbusGlueStats *skeleton = MSGPORT_DBUS_GLUE_STATS (userdata);
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+
+    for (i = 0; i < MSGPORT_STATS_N_ERRORS; i++) {
+        GError error = { MSGPORT_ERROR_QUARK, MSGPORT_ERROR_IO_ERROR + i, (gchar *)"" };
+        gchar *name = g_dbus_error_encode_gerror (&error);
+
+        g_variant_builder_add (&builder, "{st}", name, msgport_counter_get (&__send_errors[i]));
+        g_free (name);
+    }
+
+    msgport_dbus_glue_stats_complete_get_send_errors (skeleton, invocation,
+            g_variant_builder_end (&builder));
+
+    return TRUE;
+}
+
+static gboolean
+_handle_get_cert_cache_stats (MsgPortDbusServer *server, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+    MsgPortDbusGlueStats *skeleton = MSGPORT_DBUS_GLUE_STATS (userdata);
+    MsgPortCertCache *cache = msgport_cert_cache_new ();
+    guint64 n_hits = 0, n_misses = 0;
+
+    msgport_cert_cache_get_stats (cache, &n_hits, &n_misses);
+    g_object_unref (cache);
+
+    msgport_dbus_glue_stats_complete_get_cert_cache_stats (skeleton, invocation, n_hits, n_misses);
+
+    return TRUE;
+}
+
+static gboolean
+_handle_get_handler_latencies (MsgPortDbusServer *server, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+    MsgPortDbusGlueStats *skeleton = MSGPORT_DBUS_GLUE_STATS (userdata);
+    GVariantBuilder builder;
+    guint i, j;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sat}"));
+
+    for (i = 0; i < MSGPORT_STATS_HANDLER_LAST; i++) {
+        guint64 counts[MSGPORT_STATS_N_LATENCY_BUCKETS];
+
+        for (j = 0; j < MSGPORT_STATS_N_LATENCY_BUCKETS; j++)
+            counts[j] = msgport_counter_get (&__latencies[i][j]);
+
+        g_variant_builder_add (&builder, "{s@at}", __handler_names[i],
+                g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64, counts,
+                        MSGPORT_STATS_N_LATENCY_BUCKETS, sizeof (guint64)));
+    }
+
+    msgport_dbus_glue_stats_complete_get_handler_latencies (skeleton, invocation,
+            g_variant_builder_end (&builder));
+
+    return TRUE;
+}
+
+/*
+ * Stats expose the ports, app ids and traffic of every client, only root
+ * and the admin uid given in MESSAGEPORT_STATS_ADMIN_UID may read them.
+ */
+static gboolean
+_is_admin_uid (uid_t uid)
+{
+    static gsize initialized = 0;
+    static gint64 admin_uid = -1;
+
+    if (g_once_init_enter (&initialized)) {
+        const gchar *value = g_getenv ("MESSAGEPORT_STATS_ADMIN_UID");
+
+        if (value && g_ascii_isdigit (value[0]))
+            admin_uid = (gint64)g_ascii_strtoull (value, NULL, 10);
+
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return uid == 0 || (admin_uid >= 0 && (gint64)uid == admin_uid);
+}
+
+static gboolean
+_authorize_method (GDBusInterfaceSkeleton *skeleton, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+    GCredentials *credentials = g_dbus_connection_get_peer_credentials (
+            g_dbus_method_invocation_get_connection (invocation));
+    uid_t uid = credentials ? g_credentials_get_unix_user (credentials, NULL) : (uid_t)-1;
+
+    if (credentials && uid != (uid_t)-1 && _is_admin_uid (uid)) return TRUE;
+
+    WARN ("Denied stats request '%s' from uid %d",
+            g_dbus_method_invocation_get_method_name (invocation), (gint)uid);
+
+    /* handler of a denied call owns replying to it */
+    g_object_ref (invocation);
+    g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+            G_DBUS_ERROR_ACCESS_DENIED, "Statistics are restricted to administrators");
+
+    return FALSE;
+}
+
+/*
+ * Creates the Stats interface for a client connection, it is exported
+ * next to the Manager interface. The server must outlive it.
+ */
+MsgPortDbusGlueStats *
+msgport_stats_skeleton_new (MsgPortDbusServer *server)
+{
+    MsgPortDbusGlueStats *skeleton = NULL;
+
+    msgport_return_val_if_fail (server && MSGPORT_IS_DBUS_SERVER (server), NULL);
+
+    skeleton = msgport_dbus_glue_stats_skeleton_new ();
+
+    g_signal_connect (skeleton, "g-authorize-method", G_CALLBACK (_authorize_method), NULL);
+
+    g_signal_connect_swapped (skeleton, "handle-get-services",
+                G_CALLBACK (_handle_get_services), server);
+    g_signal_connect_swapped (skeleton, "handle-get-connections",
+                G_CALLBACK (_handle_get_connections), server);
+    g_signal_connect_swapped (skeleton, "handle-get-send-errors",
+                G_CALLBACK (_handle_get_send_errors), server);
+    g_signal_connect_swapped (skeleton, "handle-get-cert-cache-stats",
+                G_CALLBACK (_handle_get_cert_cache_stats), server);
+    g_signal_connect_swapped (skeleton, "handle-get-handler-latencies",
+                G_CALLBACK (_handle_get_handler_latencies), server);
+
+    return skeleton;
+}
@@ -0,0 +1,94 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef __MSGPORT_STATS_H
+#define __MSGPORT_STATS_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include "common/dbus-stats-glue.h"
+#include "dbus-server.h"
+
+G_BEGIN_DECLS
+
+/*
+ * 64 bit counters, also on 32 bit targets where gsize would wrap at 4 GiB,
+ * updated atomically from any thread. GLib has no 64 bit atomics.
+ */
+typedef volatile guint64 MsgPortCounter;
+
+#define msgport_counter_add(counter, n) \
+    ((void)__atomic_fetch_add ((counter), (guint64)(n), __ATOMIC_RELAXED))
+#define msgport_counter_get(counter) \
+    ((guint64)__atomic_load_n ((counter), __ATOMIC_RELAXED))
+
+/*
+ * Message and byte counts
+ */
+typedef struct {
+    MsgPortCounter messages;
+    MsgPortCounter bytes;
+} MsgPortTraffic;
+
+#define msgport_traffic_add(traffic, n_bytes) \
+do { \
+    msgport_counter_add (&(traffic)->messages, 1); \
+    msgport_counter_add (&(traffic)->bytes, (n_bytes)); \
+} while (0)
+
+#define msgport_traffic_get_messages(traffic) msgport_counter_get (&(traffic)->messages)
+#define msgport_traffic_get_bytes(traffic)    msgport_counter_get (&(traffic)->bytes)
+
+/*
+ * Client requests whose latencies are recorded
+ */
+typedef enum {
+    MSGPORT_STATS_HANDLER_REGISTER_SERVICE = 0,
+    MSGPORT_STATS_HANDLER_CHECK_FOR_REMOTE_SERVICE,
+    MSGPORT_STATS_HANDLER_SEND_MESSAGE,
+    MSGPORT_STATS_HANDLER_SEND_LARGE_MESSAGE,
+    MSGPORT_STATS_HANDLER_SEND_MESSAGES,
+
+    MSGPORT_STATS_HANDLER_LAST
+} MsgPortStatsHandler;
+
+void
+msgport_stats_record_latency (MsgPortStatsHandler handler,
+                              gint64 started);
+
+void
+msgport_stats_count_send_error (const GError *error);
+
+gsize
+msgport_stats_get_payload_size (GUnixFDList *fd_list,
+                                gint payload);
+
+MsgPortDbusGlueStats *
+msgport_stats_skeleton_new (MsgPortDbusServer *server);
+
+G_END_DECLS
+
+#endif /* __MSGPORT_STATS_H */
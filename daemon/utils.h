@@ -51,4 +51,12 @@ do {\
     }\
 } while (0);
 
+/*
+ * TRUE if the caller of the method does not wait for a reply,
+ * i.e, it's a fire-and-forget call
+ */
+#define msgport_dbus_invocation_no_reply_expected(invocation) \
+    ((g_dbus_message_get_flags (g_dbus_method_invocation_get_message (invocation)) & \
+      G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED) != 0)
+
 #endif /* __MSGPORT_UTILS_H */
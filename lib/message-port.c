@@ -30,7 +30,7 @@
 #include "common/log.h"
 
 static int
-_messageport_register_port (const char *name, gboolean is_trusted, messageport_message_cb cb)
+_messageport_register_port (const char *name, gboolean is_trusted, messageport_priority_e priority, messageport_message_cb cb, messageport_message_view_cb view_cb)
 {
     int port_id = 0; /* id of the port created */
     messageport_error_e res;
@@ -38,7 +38,10 @@ _messageport_register_port (const char *name, gboolean is_trusted, messageport_m
 
     if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
 
-    res = msgport_manager_register_service (manager, name, is_trusted, cb, &port_id);
+    if (priority != MESSAGEPORT_PRIORITY_NORMAL && priority != MESSAGEPORT_PRIORITY_HIGH)
+        return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    res = msgport_manager_register_service (manager, name, is_trusted, priority, cb, view_cb, &port_id);
 
     return port_id > 0 ? port_id : (int)res;
 }
@@ -82,6 +85,52 @@ _messageport_send_bidirectional_message (int id, const gchar *remote_app_id, con
     return msgport_manager_send_bidirectional_message (manager, id, remote_app_id, remote_port, is_trusted, v_data);
 }
 
+static messageport_error_e
+_messageport_send_message_async (int id, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, bundle *message, messageport_send_cb cb, void *user_data)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+
+    GVariant *v_data = bundle_to_variant_map (message);
+
+    return msgport_manager_send_message_async (manager, id, remote_app_id, remote_port, is_trusted, v_data, cb, user_data);
+}
+
+static messageport_error_e
+_messageport_send_messages (const char *app_id, const char *port, gboolean is_trusted, bundle **messages, guint n_messages)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+    GVariant **v_messages = NULL;
+    messageport_error_e res;
+    guint i;
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+    if (!messages || !n_messages) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    v_messages = g_new (GVariant *, n_messages);
+    for (i = 0; i < n_messages; i++)
+        v_messages[i] = bundle_to_variant_map (messages[i]);
+
+    res = msgport_manager_send_messages (manager, app_id, port, is_trusted, v_messages, n_messages);
+
+    g_free (v_messages);
+
+    return res;
+}
+
+static messageport_error_e
+_messageport_post_message (int id, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, bundle *message)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+
+    GVariant *v_data = bundle_to_variant_map (message);
+
+    return msgport_manager_post_message (manager, id, remote_app_id, remote_port, is_trusted, v_data);
+}
+
 /*
  * API
  */
@@ -89,13 +138,37 @@ _messageport_send_bidirectional_message (int id, const gchar *remote_app_id, con
 int
 messageport_register_local_port(const char* local_port, messageport_message_cb callback)
 {
-    return _messageport_register_port (local_port, FALSE, callback);
+    return _messageport_register_port (local_port, FALSE, MESSAGEPORT_PRIORITY_NORMAL, callback, NULL);
 }
 
 messageport_error_e
 messageport_register_trusted_local_port (const char *local_port, messageport_message_cb callback)
 {
-    return _messageport_register_port (local_port, TRUE, callback);
+    return _messageport_register_port (local_port, TRUE, MESSAGEPORT_PRIORITY_NORMAL, callback, NULL);
+}
+
+int
+messageport_register_local_port_with_priority (const char *local_port, messageport_message_cb callback, messageport_priority_e priority)
+{
+    return _messageport_register_port (local_port, FALSE, priority, callback, NULL);
+}
+
+int
+messageport_register_trusted_local_port_with_priority (const char *local_port, messageport_message_cb callback, messageport_priority_e priority)
+{
+    return _messageport_register_port (local_port, TRUE, priority, callback, NULL);
+}
+
+int
+messageport_register_local_port_with_view_cb (const char *local_port, messageport_message_view_cb callback)
+{
+    return _messageport_register_port (local_port, FALSE, MESSAGEPORT_PRIORITY_NORMAL, NULL, callback);
+}
+
+int
+messageport_register_trusted_local_port_with_view_cb (const char *local_port, messageport_message_view_cb callback)
+{
+    return _messageport_register_port (local_port, TRUE, MESSAGEPORT_PRIORITY_NORMAL, NULL, callback);
 }
 
 messageport_error_e
@@ -134,6 +207,153 @@ messageport_send_bidirectional_trusted_message (int id, const char *remote_app_i
     return _messageport_send_bidirectional_message (id, remote_app_id, remote_port, TRUE, data);
 }
 
+messageport_error_e
+messageport_send_message_async (const char *remote_app_id, const char *remote_port, bundle *message, messageport_send_cb cb, void *user_data)
+{
+    return _messageport_send_message_async (0, remote_app_id, remote_port, FALSE, message, cb, user_data);
+}
+
+messageport_error_e
+messageport_send_trusted_message_async (const char *remote_app_id, const char *remote_port, bundle *message, messageport_send_cb cb, void *user_data)
+{
+    return _messageport_send_message_async (0, remote_app_id, remote_port, TRUE, message, cb, user_data);
+}
+
+messageport_error_e
+messageport_send_bidirectional_message_async (int id, const char *remote_app_id, const char *remote_port, bundle *message, messageport_send_cb cb, void *user_data)
+{
+    if (id <= 0) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return _messageport_send_message_async (id, remote_app_id, remote_port, FALSE, message, cb, user_data);
+}
+
+messageport_error_e
+messageport_send_bidirectional_trusted_message_async (int id, const char *remote_app_id, const char *remote_port, bundle *message, messageport_send_cb cb, void *user_data)
+{
+    if (id <= 0) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return _messageport_send_message_async (id, remote_app_id, remote_port, TRUE, message, cb, user_data);
+}
+
+messageport_error_e
+messageport_send_messages (const char *remote_app_id, const char *remote_port, bundle **messages, unsigned int n_messages)
+{
+    return _messageport_send_messages (remote_app_id, remote_port, FALSE, messages, n_messages);
+}
+
+messageport_error_e
+messageport_send_trusted_messages (const char *remote_app_id, const char *remote_port, bundle **messages, unsigned int n_messages)
+{
+    return _messageport_send_messages (remote_app_id, remote_port, TRUE, messages, n_messages);
+}
+
+messageport_error_e
+messageport_post_message (const char *remote_app_id, const char *remote_port, bundle *message)
+{
+    return _messageport_post_message (0, remote_app_id, remote_port, FALSE, message);
+}
+
+messageport_error_e
+messageport_post_trusted_message (const char *remote_app_id, const char *remote_port, bundle *message)
+{
+    return _messageport_post_message (0, remote_app_id, remote_port, TRUE, message);
+}
+
+messageport_message_t *
+messageport_message_create (bundle *message)
+{
+    return msgport_message_new (message);
+}
+
+void
+messageport_message_destroy (messageport_message_t *message)
+{
+    msgport_message_free (message);
+}
+
+messageport_error_e
+messageport_message_set_str (messageport_message_t *message, const char *key, const char *value)
+{
+    if (!message || !key || !value) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    msgport_message_set_value (message, key, g_variant_new_string (value));
+
+    return MESSAGEPORT_ERROR_NONE;
+}
+
+messageport_error_e
+messageport_message_set_byte (messageport_message_t *message, const char *key, const void *value, size_t size)
+{
+    if (!message || !key || (!value && size)) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    msgport_message_set_value (message, key,
+            g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, value, size, sizeof (guchar)));
+
+    return MESSAGEPORT_ERROR_NONE;
+}
+
+/* the manager takes its own reference on the message data, if it keeps it */
+messageport_error_e
+messageport_send_prepared_message (const char *remote_app_id, const char *remote_port, messageport_message_t *message)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+    if (!message) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return msgport_manager_send_message (manager, remote_app_id, remote_port, FALSE, msgport_message_get_data (message));
+}
+
+messageport_error_e
+messageport_send_trusted_prepared_message (const char *remote_app_id, const char *remote_port, messageport_message_t *message)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+    if (!message) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return msgport_manager_send_message (manager, remote_app_id, remote_port, TRUE, msgport_message_get_data (message));
+}
+
+messageport_error_e
+messageport_post_prepared_message (const char *remote_app_id, const char *remote_port, messageport_message_t *message)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+    if (!message) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return msgport_manager_post_message (manager, 0, remote_app_id, remote_port, FALSE, msgport_message_get_data (message));
+}
+
+messageport_error_e
+messageport_post_bidirectional_message (int id, const char *remote_app_id, const char *remote_port, bundle *message)
+{
+    if (id <= 0) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return _messageport_post_message (id, remote_app_id, remote_port, FALSE, message);
+}
+
+messageport_error_e
+messageport_post_bidirectional_trusted_message (int id, const char *remote_app_id, const char *remote_port, bundle *message)
+{
+    if (id <= 0) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    return _messageport_post_message (id, remote_app_id, remote_port, TRUE, message);
+}
+
+messageport_error_e
+messageport_set_delivery_error_cb (messageport_delivery_error_cb cb, void *user_data)
+{
+    MsgPortManager *manager = msgport_factory_get_manager ();
+
+    if (!manager) return MESSAGEPORT_ERROR_IO_ERROR;
+
+    msgport_manager_set_delivery_error_cb (manager, cb, user_data);
+
+    return MESSAGEPORT_ERROR_NONE;
+}
+
 messageport_error_e
 messageport_get_local_port_name(int id, char **name_out)
 {
@@ -154,3 +374,113 @@ messageport_check_trusted_local_port (int id, gboolean *is_trusted_out)
     return msgport_manager_get_service_is_trusted (manager, id, is_trusted_out);
 }
 
+
+/*
+ * Message views
+ */
+static GVariant *
+_message_view_lookup (const messageport_message_view *view, const char *key)
+{
+    if (!view || !view->data || !key) return NULL;
+
+    return g_variant_lookup_value (view->data, key, NULL);
+}
+
+int
+messageport_message_view_get_count (const messageport_message_view *view)
+{
+    g_return_val_if_fail (view && view->data, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    return (int)g_variant_n_children (view->data);
+}
+
+int
+messageport_message_view_get_type (const messageport_message_view *view, const char *key)
+{
+    GVariant *value = _message_view_lookup (view, key);
+    int type;
+
+    if (!value) return -1;
+
+    type = msgport_variant_bundle_type (value);
+    g_variant_unref (value);
+
+    return type;
+}
+
+/*
+ * Values point into the serialized message, which outlives the child
+ * variants looked up from it, see msgport_message_view_init().
+ */
+const char *
+messageport_message_view_get_str (const messageport_message_view *view, const char *key)
+{
+    GVariant *value = _message_view_lookup (view, key);
+    const char *str = NULL;
+
+    if (!value) return NULL;
+
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+        str = g_variant_get_string (value, NULL);
+    g_variant_unref (value);
+
+    return str;
+}
+
+const void *
+messageport_message_view_get_byte (const messageport_message_view *view, const char *key, size_t *size)
+{
+    GVariant *value = _message_view_lookup (view, key);
+    gconstpointer bytes = NULL;
+    gsize len = 0;
+
+    if (value && g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING))
+        bytes = g_variant_get_fixed_array (value, &len, sizeof (guchar));
+    if (value) g_variant_unref (value);
+
+    if (size) *size = len;
+
+    return bytes;
+}
+
+const char **
+messageport_message_view_get_str_array (const messageport_message_view *view, const char *key, int *len)
+{
+    GVariant *value = _message_view_lookup (view, key);
+    const gchar **strv = NULL;
+    gsize n = 0;
+
+    if (value && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY))
+        strv = g_variant_get_strv (value, &n);
+    if (value) g_variant_unref (value);
+
+    if (len) *len = (int)n;
+
+    return strv;
+}
+
+void
+messageport_message_view_foreach (const messageport_message_view *view, messageport_message_view_iterator_cb callback, void *user_data)
+{
+    GVariantIter iter;
+    const gchar *key = NULL;
+    GVariant *value = NULL;
+
+    g_return_if_fail (view && view->data && callback);
+
+    g_variant_iter_init (&iter, view->data);
+    while (g_variant_iter_next (&iter, "{&sv}", &key, &value)) {
+        int type = msgport_variant_bundle_type (value);
+
+        if (type >= 0) callback (key, type, user_data);
+        g_variant_unref (value);
+    }
+}
+
+bundle *
+messageport_message_view_to_bundle (const messageport_message_view *view)
+{
+    g_return_val_if_fail (view && view->data, NULL);
+
+    return bundle_from_variant_map (view->data);
+}
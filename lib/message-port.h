@@ -52,6 +52,7 @@ G_BEGIN_DECLS
  * @MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND: The message port of the remote application is not found
  * @MESSAGEPORT_ERROR_CERTIFICATE_NOT_MATCH: The remote application is not signed with the same certificate
  * @MESSAGEPORT_ERROR_MAX_EXCEEDED: The size of message has exceeded the maximum limit
+ * @MESSAGEPORT_ERROR_WOULD_BLOCK: The remote port is not keeping up with the messages, try again later
  * 
  * Enumerations of error code, that return by messeage port API.
  * 
@@ -65,8 +66,22 @@ typedef enum _messageport_error_e
     MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND = -4,
     MESSAGEPORT_ERROR_CERTIFICATE_NOT_MATCH = -5,
     MESSAGEPORT_ERROR_MAX_EXCEEDED = -6,
+    MESSAGEPORT_ERROR_WOULD_BLOCK = -7,
 } messageport_error_e;
 
+/**
+ * messageport_priority_e:
+ * @MESSAGEPORT_PRIORITY_NORMAL: Messages are delivered in the order they were sent
+ * @MESSAGEPORT_PRIORITY_HIGH: Messages are delivered ahead of the ones waiting for normal priority ports
+ *
+ * Enumerations of message port delivery priorities.
+ */
+typedef enum _messageport_priority_e
+{
+    MESSAGEPORT_PRIORITY_NORMAL = 0,
+    MESSAGEPORT_PRIORITY_HIGH = 1,
+} messageport_priority_e;
+
 /**
  * messageport_message_cb:
  * @id: The ID of the local message port to which the message was sent.
@@ -78,10 +93,74 @@ typedef enum _messageport_error_e
  * This is the function type of the callback used for #messageport_register_local_port or #messageport_register_trusted_local_port.
  * This is called when a message is received from the remote application, #remote_app_id and #remtoe_port will be set
  * if the remote application sends a bidirectional message, otherwise they are NULL.
+ * It is called in the thread-default main context of the thread that registered the port.
  *
  */
 typedef void (*messageport_message_cb)(int id, const char* remote_app_id, const char* remote_port, bool trusted_message, bundle* message);
 
+/**
+ * messageport_message_t:
+ *
+ * Prepared message, see #messageport_message_create.
+ */
+typedef struct _messageport_message messageport_message_t;
+
+/**
+ * messageport_message_view:
+ *
+ * Read-only view over a received message, see #messageport_message_view_cb.
+ * Values are read in place from the received data, nothing is copied until asked for.
+ */
+typedef struct _messageport_message_view messageport_message_view;
+
+/**
+ * messageport_message_view_cb:
+ * @id: The ID of the local message port to which the message was sent.
+ * @remote_app_id: The ID of the remote application which has sent this message, or NULL
+ * @remote_port: The name of the remote message port, or NULL
+ * @trusted_message: TRUE if the remote message port is trusted port.
+ * @message: View over the message received, valid only until the callback returns.
+ *
+ * Same as #messageport_message_cb, but the message is not converted to a #bundle. Use it for
+ * ports that read only a few keys of the messages, see #messageport_register_local_port_with_view_cb.
+ * Use #messageport_message_view_to_bundle to keep the message beyond the callback.
+ */
+typedef void (*messageport_message_view_cb)(int id, const char* remote_app_id, const char* remote_port, bool trusted_message, const messageport_message_view* message);
+
+/**
+ * messageport_message_view_iterator_cb:
+ * @key: The key of the message value
+ * @type: The #bundle_type_t of the value
+ * @user_data: The user data passed to #messageport_message_view_foreach.
+ *
+ * This is the function type of the callback used for #messageport_message_view_foreach.
+ */
+typedef void (*messageport_message_view_iterator_cb)(const char *key, int type, void *user_data);
+
+/**
+ * messageport_send_cb:
+ * @result: #MESSAGEPORT_ERROR_NONE if the message was accepted by the remote port, otherwise a negative error value.
+ * @user_data: The user data passed to the asynchronous send function.
+ *
+ * This is the function type of the callback used for #messageport_send_message_async and its variants.
+ * It is called in the thread-default main context of the thread that started the send, so that thread
+ * must be running a main loop for the callback to be dispatched.
+ */
+typedef void (*messageport_send_cb)(messageport_error_e result, void *user_data);
+
+/**
+ * messageport_delivery_error_cb:
+ * @error: The reason why the message could not be delivered.
+ * @remote_app_id: The ID of the remote application the message was posted to, or NULL if not known
+ * @remote_port: The name of the remote message port the message was posted to, or NULL if not known
+ * @trusted_port: TRUE if the message was posted to a trusted port.
+ * @user_data: The user data passed to #messageport_set_delivery_error_cb.
+ *
+ * This is the function type of the callback used for #messageport_set_delivery_error_cb.
+ * It is called when a message posted with #messageport_post_message or its variants could not be delivered.
+ */
+typedef void (*messageport_delivery_error_cb)(messageport_error_e error, const char *remote_app_id, const char *remote_port, bool trusted_port, void *user_data);
+
 /**
  * messageport_register_local_port:
  * @local_port: local_port the name of the local message port
@@ -116,6 +195,143 @@ messageport_register_local_port(const char* local_port, messageport_message_cb c
 EXPORT_API int
 messageport_register_trusted_local_port(const char* local_port, messageport_message_cb callback);
 
+/**
+ * messageport_register_local_port_with_priority:
+ * @local_port: local_port the name of the local message port
+ * @callback: callback The callback function to be called when a message is received at this port
+ * @priority: The delivery priority of the port
+ *
+ * Same as #messageport_register_local_port, but messages sent to a #MESSAGEPORT_PRIORITY_HIGH port are
+ * delivered ahead of the messages waiting for the application's normal priority ports, so that
+ * bulk traffic on those does not delay them. If the message port is already registered, its
+ * priority is not changed.
+ *
+ * Returns: A message port id on success, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_INVALID_PARAMETER If either #local_port, #callback or #priority is missing or invalid.
+ *          #MESSAGEPORT_ERROR_OUT_OF_MEMORY Memory error occured
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ */
+EXPORT_API int
+messageport_register_local_port_with_priority(const char* local_port, messageport_message_cb callback, messageport_priority_e priority);
+
+/**
+ * messageport_register_trusted_local_port_with_priority:
+ * @local_port: local_port the name of the local message port
+ * @callback: callback The callback function to be called when a message is received at this port
+ * @priority: The delivery priority of the port
+ *
+ * Trusted port variant of #messageport_register_local_port_with_priority.
+ *
+ * Returns: A message port id on success, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_INVALID_PARAMETER If either #local_port, #callback or #priority is missing or invalid.
+ *          #MESSAGEPORT_ERROR_OUT_OF_MEMORY Memory error occured
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ */
+EXPORT_API int
+messageport_register_trusted_local_port_with_priority(const char* local_port, messageport_message_cb callback, messageport_priority_e priority);
+
+/**
+ * messageport_register_local_port_with_view_cb:
+ * @local_port: local_port the name of the local message port
+ * @callback: callback The callback function to be called when a message is received at this port
+ *
+ * Same as #messageport_register_local_port, but the messages are handed to #callback as
+ * #messageport_message_view, so that the receiver pays only for the values it reads.
+ *
+ * Returns: A message port id on success, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_INVALID_PARAMETER If either #local_port or #callback is missing or invalid.
+ *          #MESSAGEPORT_ERROR_OUT_OF_MEMORY Memory error occured
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ */
+EXPORT_API int
+messageport_register_local_port_with_view_cb(const char* local_port, messageport_message_view_cb callback);
+
+/**
+ * messageport_register_trusted_local_port_with_view_cb:
+ * @local_port: local_port the name of the local message port
+ * @callback: callback The callback function to be called when a message is received at this port
+ *
+ * Trusted port variant of #messageport_register_local_port_with_view_cb.
+ *
+ * Returns: A message port id on success, otherwise a negative error value, see #messageport_register_local_port_with_view_cb.
+ */
+EXPORT_API int
+messageport_register_trusted_local_port_with_view_cb(const char* local_port, messageport_message_view_cb callback);
+
+/**
+ * messageport_message_view_get_count:
+ * @view: The message view
+ *
+ * Returns: The number of values in the message, or a negative error value.
+ */
+EXPORT_API int
+messageport_message_view_get_count(const messageport_message_view* view);
+
+/**
+ * messageport_message_view_get_type:
+ * @view: The message view
+ * @key: The key to look up
+ *
+ * Returns: The #bundle_type_t of the value of #key, or -1 if there is no such key.
+ */
+EXPORT_API int
+messageport_message_view_get_type(const messageport_message_view* view, const char* key);
+
+/**
+ * messageport_message_view_get_str:
+ * @view: The message view
+ * @key: The key to look up
+ *
+ * Returns: The string value of #key, valid as long as #view, or NULL if there is no such string value.
+ */
+EXPORT_API const char*
+messageport_message_view_get_str(const messageport_message_view* view, const char* key);
+
+/**
+ * messageport_message_view_get_byte:
+ * @view: The message view
+ * @key: The key to look up
+ * @size: Return location for the size of the value, or NULL.
+ *
+ * Returns: The binary value of #key, valid as long as #view, or NULL if there is no such binary value.
+ */
+EXPORT_API const void*
+messageport_message_view_get_byte(const messageport_message_view* view, const char* key, size_t* size);
+
+/**
+ * messageport_message_view_get_str_array:
+ * @view: The message view
+ * @key: The key to look up
+ * @len: Return location for the number of strings, or NULL.
+ *
+ * Returns: NULL terminated array of the strings of #key, or NULL if there is no such string array value.
+ *          The strings are valid as long as #view, only the array has to be freed with g_free().
+ */
+EXPORT_API const char**
+messageport_message_view_get_str_array(const messageport_message_view* view, const char* key, int* len);
+
+/**
+ * messageport_message_view_foreach:
+ * @view: The message view
+ * @callback: The function to call for each value of the message
+ * @user_data: User data to pass to #callback
+ *
+ * Calls #callback with the key and type of each value of the message, in the order they were sent.
+ */
+EXPORT_API void
+messageport_message_view_foreach(const messageport_message_view* view, messageport_message_view_iterator_cb callback, void* user_data);
+
+/**
+ * messageport_message_view_to_bundle:
+ * @view: The message view
+ *
+ * Copies the message to a new #bundle, to keep it beyond the #messageport_message_view_cb call.
+ *
+ * Returns: A new #bundle to be freed with bundle_free(), or NULL on error.
+ */
+EXPORT_API bundle*
+messageport_message_view_to_bundle(const messageport_message_view* view);
+
 /**
  * messageport_check_remote_port:
  * @remote_app_id: The ID of the remote application
@@ -162,6 +378,7 @@ messageport_check_trusted_remote_port(const char* remote_app_id, const char *rem
  *         #MESSAGEPORT_ERROR_OUT_OF_MEMORY Memory error occured
  *         #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND The message port of the remote application is not found
  *         #MESSAGEPORT_ERROR_MAX_EXCEEDED The size of message has exceeded the maximum limit
+ *         #MESSAGEPORT_ERROR_WOULD_BLOCK The remote message port is not keeping up, try again later
  *         #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
  *
  * @code
@@ -194,6 +411,7 @@ messageport_send_message(const char* remote_app_id, const char* remote_port, bun
  *         #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND The message port of the remote application is not found
  *         #MESSAGEPORT_ERROR_CERTIFICATE_NOT_MATCH The remote application is not signed with the same certificate
  *         #MESSAGEPORT_ERROR_MAX_EXCEEDED The size of message has exceeded the maximum limit
+ *         #MESSAGEPORT_ERROR_WOULD_BLOCK The remote message port is not keeping up, try again later
  *         #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
  */
 EXPORT_API messageport_error_e
@@ -215,6 +433,7 @@ messageport_send_trusted_message(const char* remote_app_id, const char* remote_p
  *          #MESSAGEPORT_ERROR_OUT_OF_MEMORY Memeory error occured
  *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND The message port of the remote application is not found
  *          #MESSAGEPORT_ERROR_MAX_EXCEEDED The size of message has exceeded the maximum limit
+ *          #MESSAGEPORT_ERROR_WOULD_BLOCK The remote message port is not keeping up, try again later
  *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
  *
  * @code
@@ -258,11 +477,298 @@ messageport_send_bidirectional_message(int id, const char* remote_app_id, const
  *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND The message port of the remote application is not found
  *          #MESSAGEPORT_ERROR_CERTIFICATE_NOT_MATCH The remote application is not signed with the same certificate
  *          #MESSAGEPORT_ERROR_MAX_EXCEEDED The size of message has exceeded the maximum limit
+ *          #MESSAGEPORT_ERROR_WOULD_BLOCK The remote message port is not keeping up, try again later
  *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
  */
 EXPORT_API messageport_error_e
 messageport_send_bidirectional_trusted_message(int id, const char* remote_app_id, const char* remote_port, bundle* message);
 
+/**
+ * messageport_send_message_async:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ * @callback: The callback to be called once the send is completed, or NULL
+ * @user_data: User data to pass to #callback
+ *
+ * Asynchronous version of #messageport_send_message. The call returns without waiting for
+ * the daemon reply, so that the caller can keep many messages in flight. The result of the
+ * send is reported through #callback. The #message can be freed once this call returns.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the send was started, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_INVALID_PARAMETER Invalid parameter passed
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ *          Errors that occur later on are reported through #callback only.
+ *
+ * @code
+ * #include <message-port.h>
+ *
+ * static void
+ * OnMessageSent(messageport_error_e result, void *user_data)
+ * {
+ * }
+ *
+ * bundle *b = bundle_create();
+ * bundle_add(b, "key1", "value1");
+ *
+ * int ret = messageport_send_message_async("0123456789.BasicApp", "BasicAppPort", b, OnMessageSent, NULL);
+ *
+ * bundle_free(b);
+ * @endcode
+ */
+EXPORT_API messageport_error_e
+messageport_send_message_async(const char* remote_app_id, const char* remote_port, bundle* message, messageport_send_cb callback, void *user_data);
+
+/**
+ * messageport_send_trusted_message_async:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ * @callback: The callback to be called once the send is completed, or NULL
+ * @user_data: User data to pass to #callback
+ *
+ * Asynchronous version of #messageport_send_trusted_message, see #messageport_send_message_async.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the send was started, otherwise a negative error value.
+ */
+EXPORT_API messageport_error_e
+messageport_send_trusted_message_async(const char* remote_app_id, const char* remote_port, bundle* message, messageport_send_cb callback, void *user_data);
+
+/**
+ * messageport_send_bidirectional_message_async:
+ * @id: The message port id returned by messageport_register_local_port() or messageport_register_trusted_local_port()
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ * @callback: The callback to be called once the send is completed, or NULL
+ * @user_data: User data to pass to #callback
+ *
+ * Asynchronous version of #messageport_send_bidirectional_message, see #messageport_send_message_async.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the send was started, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND No local message port found for #id
+ */
+EXPORT_API messageport_error_e
+messageport_send_bidirectional_message_async(int id, const char* remote_app_id, const char* remote_port, bundle* message, messageport_send_cb callback, void *user_data);
+
+/**
+ * messageport_send_bidirectional_trusted_message_async:
+ * @id: The message port id returned by messageport_register_local_port() or messageport_register_trusted_local_port()
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ * @callback: The callback to be called once the send is completed, or NULL
+ * @user_data: User data to pass to #callback
+ *
+ * Asynchronous version of #messageport_send_bidirectional_trusted_message, see #messageport_send_message_async.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the send was started, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND No local message port found for #id
+ */
+EXPORT_API messageport_error_e
+messageport_send_bidirectional_trusted_message_async(int id, const char* remote_app_id, const char* remote_port, bundle* message, messageport_send_cb callback, void *user_data);
+
+/**
+ * messageport_send_messages:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @messages: Array of messages to be passed to the remote application
+ * @n_messages: Number of messages in #messages
+ *
+ * Sends a batch of messages to the message port of a remote application in a single
+ * request to the daemon. The messages are delivered in the order they appear in #messages.
+ * Use this when sending bursts of small messages, it avoids the per message IPC overhead.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if all the messages were sent, otherwise the error of the first
+ *          message that could not be sent:
+ *          #MESSAGEPORT_ERROR_INVALID_PARAMETER Invalid parameter passed
+ *          #MESSAGEPORT_ERROR_OUT_OF_MEMORY Memory error occured
+ *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND The message port of the remote application is not found
+ *          #MESSAGEPORT_ERROR_MAX_EXCEEDED The size of message has exceeded the maximum limit
+ *          #MESSAGEPORT_ERROR_WOULD_BLOCK The remote message port is not keeping up, try again later
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ */
+EXPORT_API messageport_error_e
+messageport_send_messages(const char* remote_app_id, const char* remote_port, bundle** messages, unsigned int n_messages);
+
+/**
+ * messageport_send_trusted_messages:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @messages: Array of messages to be passed to the remote application
+ * @n_messages: Number of messages in #messages
+ *
+ * Trusted version of #messageport_send_messages.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if all the messages were sent, otherwise the error of the first
+ *          message that could not be sent, see #messageport_send_trusted_message.
+ */
+EXPORT_API messageport_error_e
+messageport_send_trusted_messages(const char* remote_app_id, const char* remote_port, bundle** messages, unsigned int n_messages);
+
+/**
+ * messageport_post_message:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ *
+ * Sends a message to the message port of a remote application without waiting for, or even
+ * asking for, a reply from the daemon (fire-and-forget). Delivery errors are reported out-of-band
+ * through the callback set with #messageport_set_delivery_error_cb.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the message was queued, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_INVALID_PARAMETER Invalid parameter passed
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ */
+EXPORT_API messageport_error_e
+messageport_post_message(const char* remote_app_id, const char* remote_port, bundle* message);
+
+/**
+ * messageport_post_trusted_message:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ *
+ * Fire-and-forget version of #messageport_send_trusted_message, see #messageport_post_message.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the message was queued, otherwise a negative error value.
+ */
+EXPORT_API messageport_error_e
+messageport_post_trusted_message(const char* remote_app_id, const char* remote_port, bundle* message);
+
+/**
+ * messageport_message_create:
+ * @message: The bundle to prepare the message from, or NULL for an empty message
+ *
+ * Prepares a message that can be sent repeatedly. The message is serialized once, changing
+ * a value with #messageport_message_set_str or #messageport_message_set_byte re-serializes
+ * only that value. Use it when sending the same message shape over and over with only a few
+ * values changing. A prepared message must not be used from several threads at once.
+ *
+ * Returns: A new message to be freed with #messageport_message_destroy, or NULL on error.
+ */
+EXPORT_API messageport_message_t*
+messageport_message_create(bundle* message);
+
+/**
+ * messageport_message_destroy:
+ * @message: The message returned by #messageport_message_create
+ *
+ * Frees the prepared message.
+ */
+EXPORT_API void
+messageport_message_destroy(messageport_message_t* message);
+
+/**
+ * messageport_message_set_str:
+ * @message: The message returned by #messageport_message_create
+ * @key: The key of the value
+ * @value: The new string value
+ *
+ * Sets the string value of #key, it is added to the message if not found.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE on success, or #MESSAGEPORT_ERROR_INVALID_PARAMETER.
+ */
+EXPORT_API messageport_error_e
+messageport_message_set_str(messageport_message_t* message, const char* key, const char* value);
+
+/**
+ * messageport_message_set_byte:
+ * @message: The message returned by #messageport_message_create
+ * @key: The key of the value
+ * @value: The new binary value
+ * @size: The size of #value
+ *
+ * Sets the binary value of #key, it is added to the message if not found.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE on success, or #MESSAGEPORT_ERROR_INVALID_PARAMETER.
+ */
+EXPORT_API messageport_error_e
+messageport_message_set_byte(messageport_message_t* message, const char* key, const void* value, size_t size);
+
+/**
+ * messageport_send_prepared_message:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: The message returned by #messageport_message_create
+ *
+ * Same as #messageport_send_message, for prepared messages.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE on success, otherwise a negative error value, see #messageport_send_message.
+ */
+EXPORT_API messageport_error_e
+messageport_send_prepared_message(const char* remote_app_id, const char* remote_port, messageport_message_t* message);
+
+/**
+ * messageport_send_trusted_prepared_message:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: The message returned by #messageport_message_create
+ *
+ * Same as #messageport_send_trusted_message, for prepared messages.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE on success, otherwise a negative error value, see #messageport_send_trusted_message.
+ */
+EXPORT_API messageport_error_e
+messageport_send_trusted_prepared_message(const char* remote_app_id, const char* remote_port, messageport_message_t* message);
+
+/**
+ * messageport_post_prepared_message:
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: The message returned by #messageport_message_create
+ *
+ * Same as #messageport_post_message, for prepared messages.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the message was queued, otherwise a negative error value.
+ */
+EXPORT_API messageport_error_e
+messageport_post_prepared_message(const char* remote_app_id, const char* remote_port, messageport_message_t* message);
+
+/**
+ * messageport_post_bidirectional_message:
+ * @id: The message port id returned by messageport_register_local_port() or messageport_register_trusted_local_port()
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ *
+ * Fire-and-forget version of #messageport_send_bidirectional_message, see #messageport_post_message.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the message was queued, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND No local message port found for #id
+ */
+EXPORT_API messageport_error_e
+messageport_post_bidirectional_message(int id, const char* remote_app_id, const char* remote_port, bundle* message);
+
+/**
+ * messageport_post_bidirectional_trusted_message:
+ * @id: The message port id returned by messageport_register_local_port() or messageport_register_trusted_local_port()
+ * @remote_app_id: The ID of the remote application
+ * @remote_port: The name of the remote message port
+ * @message: Message to be passed to the remote application, the recommended message size is under 4KB
+ *
+ * Fire-and-forget version of #messageport_send_bidirectional_trusted_message, see #messageport_post_message.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE if the message was queued, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND No local message port found for #id
+ */
+EXPORT_API messageport_error_e
+messageport_post_bidirectional_trusted_message(int id, const char* remote_app_id, const char* remote_port, bundle* message);
+
+/**
+ * messageport_set_delivery_error_cb:
+ * @callback: The callback to be called when a posted message could not be delivered, or NULL to unset
+ * @user_data: User data to pass to #callback
+ *
+ * Sets the callback that receives delivery errors of messages sent with #messageport_post_message
+ * and its variants. There is one callback per process, it is called in the global default main context.
+ *
+ * Returns: #MESSAGEPORT_ERROR_NONE on success, otherwise a negative error value.
+ *          #MESSAGEPORT_ERROR_IO_ERROR Internal I/O error
+ */
+EXPORT_API messageport_error_e
+messageport_set_delivery_error_cb(messageport_delivery_error_cb callback, void *user_data);
+
 /**
  * messageport_get_local_port_name:
  * @id: The message port id returned by messageport_register_local_port() or messageport_register_trusted_local_port()
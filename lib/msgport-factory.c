@@ -28,52 +28,30 @@
 #include "common/log.h"
 #include <glib.h>
 
-GHashTable *__managers = NULL; /* GThread:MsgPortManager */
-G_LOCK_DEFINE(managers);
-
-static 
-void msgport_factory_init ()
-{
-    G_LOCK(managers);
-
-    if (!__managers)
-        __managers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-                              NULL, (GDestroyNotify)g_object_unref);
-
-    G_UNLOCK(managers);
-}
+/* one manager, and so one daemon connection, shared by all the threads of the process */
+static MsgPortManager *__manager = NULL;
+G_LOCK_DEFINE_STATIC(manager);
 
 void msgport_factory_uninit ()
 {
-    G_LOCK(managers);
+    G_LOCK(manager);
 
-    if (__managers) {
-        g_hash_table_destroy (__managers);
-        __managers = NULL;
-    }
+    g_clear_object (&__manager);
 
-    G_UNLOCK(managers);
+    G_UNLOCK(manager);
 }
 
 MsgPortManager * msgport_factory_get_manager () 
 {
     MsgPortManager *manager = NULL;
-    GThread *self_thread = g_thread_self ();
-
-    if (!__managers) msgport_factory_init ();
-
-    G_LOCK(managers);
 
-    manager = MSGPORT_MANAGER (g_hash_table_lookup (__managers, self_thread));
+    G_LOCK(manager);
 
-    if (!manager) {
-        manager = msgport_manager_new ();
+    if (!__manager) __manager = msgport_manager_new ();
 
-        if (manager) 
-            g_hash_table_insert (__managers, (gpointer)self_thread, manager);
-    }
+    manager = __manager;
 
-    G_UNLOCK(managers);
+    G_UNLOCK(manager);
 
     return manager;
 }
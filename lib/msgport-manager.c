@@ -28,25 +28,81 @@
 #include "msgport-service.h"
 #include "msgport-utils.h" /* msgport_daemon_error_to_error */
 #include "message-port.h" /* messageport_error_e */
+#include "common/channel.h"
 #include "common/dbus-manager-glue.h"
+#include "common/dbus-error.h"
 #ifdef  USE_SESSION_BUS
 #include "common/dbus-server-glue.h"
 #endif
 #include "common/log.h"
+#include <unistd.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <glib-unix.h>
 
 struct _MsgPortManager
 {
     GObject parent;
 
     MsgPortDbusGlueManager *proxy;
+    GMutex      lock; /* protects the tables below, manager is shared by all threads */
     GHashTable *services; /* {gchar*:MsgPortService*} */
     GHashTable *local_services; /* {gint: gchar *} */ 
     GHashTable *remote_services; /* {gint: gchar *} */
+    GHashTable *remote_service_cache; /* {RemoteServiceKey*: guint} */
+    GHashTable *remote_codecs; /* {guint: guint} codecs the remote service owner decodes */
+    gboolean    codecs_negotiated; /* daemon tracks codecs, remote ones can be queried */
+    messageport_delivery_error_cb delivery_error_cb;
+    gpointer                      delivery_error_data;
+    gint        channel_fd; /* data channel to the daemon, -1 if not opened */
+    GSource    *channel_watch;
+    guint8     *channel_buffer;
 };
 
+/*
+ * Key for resolved remote services,
+ * (app_id, port_name, is_trusted) -> remote service id
+ */
+typedef struct {
+    gchar   *app_id;
+    gchar   *port_name;
+    gboolean is_trusted;
+} RemoteServiceKey;
+
+static guint
+_remote_service_key_hash (gconstpointer key)
+{
+    const RemoteServiceKey *k = (const RemoteServiceKey *)key;
+
+    return (g_str_hash (k->app_id) * 31 + g_str_hash (k->port_name)) ^ (guint)(k->is_trusted != FALSE);
+}
+
+static gboolean
+_remote_service_key_equal (gconstpointer a, gconstpointer b)
+{
+    const RemoteServiceKey *k1 = (const RemoteServiceKey *)a;
+    const RemoteServiceKey *k2 = (const RemoteServiceKey *)b;
+
+    return (k1->is_trusted != FALSE) == (k2->is_trusted != FALSE) &&
+           !g_strcmp0 (k1->port_name, k2->port_name) &&
+           !g_strcmp0 (k1->app_id, k2->app_id);
+}
+
+static void
+_remote_service_key_free (gpointer key)
+{
+    RemoteServiceKey *k = (RemoteServiceKey *)key;
+
+    g_free (k->app_id);
+    g_free (k->port_name);
+    g_slice_free (RemoteServiceKey, k);
+}
+
 G_DEFINE_TYPE (MsgPortManager, msgport_manager, G_TYPE_OBJECT)
 
+#define MSGPORT_MANAGER_LOCK(manager)   g_mutex_lock (&(manager)->lock)
+#define MSGPORT_MANAGER_UNLOCK(manager) g_mutex_unlock (&(manager)->lock)
+
 static void
 _unregister_service_cb (int service_id, const gchar *object_path, MsgPortManager *manager)
 {
@@ -70,6 +126,18 @@ _finalize (GObject *self)
         manager->remote_services = NULL;
     }
 
+    if (manager->remote_service_cache) {
+        g_hash_table_unref (manager->remote_service_cache);
+        manager->remote_service_cache = NULL;
+    }
+
+    if (manager->remote_codecs) {
+        g_hash_table_unref (manager->remote_codecs);
+        manager->remote_codecs = NULL;
+    }
+
+    g_mutex_clear (&manager->lock);
+
     G_OBJECT_CLASS (msgport_manager_parent_class)->finalize (self);
 }
 
@@ -85,6 +153,20 @@ _dispose (GObject *self)
         manager->services = NULL;
     }
 
+    if (manager->channel_watch) {
+        g_source_destroy (manager->channel_watch);
+        g_source_unref (manager->channel_watch);
+        manager->channel_watch = NULL;
+    }
+
+    if (manager->channel_fd >= 0) {
+        close (manager->channel_fd);
+        manager->channel_fd = -1;
+    }
+
+    g_free (manager->channel_buffer);
+    manager->channel_buffer = NULL;
+
     g_clear_object (&manager->proxy);
 
     G_OBJECT_CLASS (msgport_manager_parent_class)->dispose (self);
@@ -99,16 +181,253 @@ msgport_manager_class_init (MsgPortManagerClass *klass)
     g_klass->dispose = _dispose;
 }
 
+static gboolean
+_match_remote_service_id (gpointer key, gpointer value, gpointer userdata)
+{
+    return GPOINTER_TO_UINT (value) == GPOINTER_TO_UINT (userdata);
+}
+
 static void
-msgport_manager_init (MsgPortManager *manager)
+_invalidate_remote_service (MsgPortManager *manager, guint service_id)
+{
+    MSGPORT_MANAGER_LOCK (manager);
+    g_hash_table_foreach_remove (manager->remote_service_cache,
+            _match_remote_service_id, GUINT_TO_POINTER (service_id));
+    g_hash_table_remove (manager->remote_codecs, GUINT_TO_POINTER (service_id));
+    MSGPORT_MANAGER_UNLOCK (manager);
+}
+
+static void
+_on_remote_service_unregistered (MsgPortManager *manager, guint service_id, gpointer userdata)
+{
+    DBG ("Remote service %d unregistered, dropping from cache", service_id);
+
+    _invalidate_remote_service (manager, service_id);
+}
+
+static void
+_on_message_delivery_failed (MsgPortManager *manager, guint service_id, const gchar *error_name, const gchar *error_message, gpointer userdata)
+{
+    GError *error = g_dbus_error_new_for_dbus_error (error_name, error_message);
+    messageport_error_e err = msgport_daemon_error_to_error (error);
+    RemoteServiceKey *key = NULL;
+    messageport_delivery_error_cb cb = NULL;
+    gpointer cb_data = NULL;
+    gchar *app_id = NULL, *port_name = NULL;
+    gboolean is_trusted = FALSE;
+
+    WARN ("Failed to deliver message to service %d : %s", service_id, error->message);
+    g_error_free (error);
+
+    MSGPORT_MANAGER_LOCK (manager);
+    key = (RemoteServiceKey *)g_hash_table_find (manager->remote_service_cache,
+            _match_remote_service_id, GUINT_TO_POINTER (service_id));
+    if (key) {
+        app_id = g_strdup (key->app_id);
+        port_name = g_strdup (key->port_name);
+        is_trusted = key->is_trusted;
+    }
+    cb = manager->delivery_error_cb;
+    cb_data = manager->delivery_error_data;
+    MSGPORT_MANAGER_UNLOCK (manager);
+
+    if (cb) cb (err, app_id, port_name, is_trusted, cb_data);
+
+    g_free (app_id);
+    g_free (port_name);
+
+    if (err == MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND)
+        _invalidate_remote_service (manager, service_id);
+}
+
+static MsgPortService * _get_local_port (MsgPortManager *manager, int service_id);
+
+static gboolean
+_on_channel_readable (gint fd, GIOCondition condition, gpointer userdata)
+{
+    MsgPortManager *manager = MSGPORT_MANAGER (userdata);
+    MsgPortChannelFrame frame;
+    GError *error = NULL;
+
+    while (msgport_channel_receive (fd, manager->channel_buffer,
+                MSGPORT_CHANNEL_MAX_PACKET, &frame, &error)) {
+        MsgPortService *service = _get_local_port (manager, frame.header.service_id);
+        GVariant *data = NULL;
+
+        if (frame.payload_fd >= 0) {
+            data = msgport_payload_from_fd (frame.payload_fd);
+        }
+        else {
+            /* frame points into the receive buffer, which is reused */
+            GBytes *bytes = g_bytes_new (frame.payload, frame.payload_size);
+            data = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE));
+            g_bytes_unref (bytes);
+        }
+
+        if (!service) {
+            DBG ("Dropping message for unknown local service %d", frame.header.service_id);
+        }
+        else if (data) {
+            msgport_service_deliver_message (service, data, frame.app_id, frame.port,
+                    (frame.header.flags & MSGPORT_CHANNEL_FLAG_TRUSTED) != 0);
+        }
+
+        if (data) g_variant_unref (data);
+        if (service) g_object_unref (service);
+    }
+
+    if (g_error_matches (error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_WOULD_BLOCK)) {
+        g_error_free (error);
+        return TRUE;
+    }
+
+    /* daemon is gone or broke the framing, no more messages on this channel */
+    WARN ("Data channel closed : %s", error->message);
+    g_error_free (error);
+
+    g_source_unref (manager->channel_watch);
+    manager->channel_watch = NULL;
+    /* senders use the fd under the lock, it must not be reused under them */
+    MSGPORT_MANAGER_LOCK (manager);
+    manager->channel_fd = -1;
+    close (fd);
+    MSGPORT_MANAGER_UNLOCK (manager);
+
+    return FALSE;
+}
+
+/*
+ * Negotiates the data channel with the daemon, used for posted messages
+ * and for the messages delivered to this client. Stays on D-Bus
+ * if the daemon does not support it, or MESSAGEPORT_TRANSPORT=dbus.
+ */
+static void
+_open_channel (MsgPortManager *manager)
+{
+    GUnixFDList *fd_list = NULL;
+    GError *error = NULL;
+    gint handle = 0, fd = -1;
+
+    if (!g_strcmp0 (g_getenv ("MESSAGEPORT_TRANSPORT"), "dbus")) return;
+
+    if (!msgport_dbus_glue_manager_call_open_channel_sync (manager->proxy,
+                NULL, &handle, &fd_list, NULL, &error)) {
+        DBG ("Data channel not available, using dbus : %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    fd = g_unix_fd_list_get (fd_list, handle, &error);
+    g_object_unref (fd_list);
+    if (fd < 0) {
+        WARN ("Fail to get data channel : %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    manager->channel_fd = fd;
+    manager->channel_buffer = g_malloc (MSGPORT_CHANNEL_MAX_PACKET);
+    manager->channel_watch = g_unix_fd_source_new (fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
+    g_source_set_callback (manager->channel_watch, (GSourceFunc)_on_channel_readable, manager, NULL);
+    g_source_attach (manager->channel_watch, NULL);
+}
+
+/*
+ * Tells the daemon which codecs this client decodes, so that the peers
+ * can compress the messages they send here.
+ */
+static void
+_set_codecs (MsgPortManager *manager)
+{
+    GError *error = NULL;
+    guint codecs = msgport_codecs_supported ();
+
+    if (!codecs) return;
+
+    if (!msgport_dbus_glue_manager_call_set_codecs_sync (manager->proxy, codecs, NULL, &error)) {
+        DBG ("Payload compression not available : %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    manager->codecs_negotiated = TRUE;
+}
+
+/*
+ * Connects to the daemon, the connection and the manager proxy dispatch
+ * their signals in the thread default context of the calling thread.
+ */
+static void
+_connect (MsgPortManager *manager, const gchar *bus_address)
 {
     GError          *error = NULL;
     GDBusConnection *connection = NULL;
+
+    connection = g_dbus_connection_new_for_address_sync (bus_address,
+            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL, &error);
+    if (error) {
+        WARN ("Fail to connect messageport server at address %s: %s", bus_address, error->message);
+        g_error_free (error);
+        return;
+    }
+
+    manager->proxy = msgport_dbus_glue_manager_proxy_new_sync (
+        connection, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL, "/", NULL, &error);
+    if (error) {
+        WARN ("Fail to get manager proxy : %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    /* large messages are delivered as memfd, map them before they reach service proxies */
+    msgport_dbus_add_large_message_filter (connection);
+    g_signal_connect_swapped (manager->proxy, "remote-service-unregistered",
+            G_CALLBACK (_on_remote_service_unregistered), manager);
+    g_signal_connect_swapped (manager->proxy, "message-delivery-failed",
+            G_CALLBACK (_on_message_delivery_failed), manager);
+    _open_channel (manager);
+    _set_codecs (manager);
+}
+
+typedef struct {
+    MsgPortManager *manager;
+    const gchar    *bus_address;
+} ConnectData;
+
+static gpointer
+_connect_thread (gpointer userdata)
+{
+    ConnectData *data = (ConnectData *)userdata;
+
+    _connect (data->manager, data->bus_address);
+
+    return NULL;
+}
+
+static void
+msgport_manager_init (MsgPortManager *manager)
+{
+    GError          *error = NULL;
+    GMainContext    *context = NULL;
     gchar           *bus_address = NULL;
 
     manager->services = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
     manager->local_services = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
     manager->remote_services = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, NULL);
+    manager->remote_service_cache = g_hash_table_new_full (_remote_service_key_hash,
+            _remote_service_key_equal, _remote_service_key_free, NULL);
+    manager->remote_codecs = g_hash_table_new (g_direct_hash, g_direct_equal);
+    manager->codecs_negotiated = FALSE;
+    manager->delivery_error_cb = NULL;
+    manager->delivery_error_data = NULL;
+    manager->channel_fd = -1;
+    manager->channel_watch = NULL;
+    manager->channel_buffer = NULL;
+    g_mutex_init (&manager->lock);
+
+    /* register daemon error domain, so that remote errors map back to MsgPortError,
+     * the stale service id retries rely on NotFound being told apart */
+    msgport_error_quark ();
 
 #ifdef USE_SESSION_BUS
     MsgPortDbusGlueServer *server = NULL;
@@ -143,20 +462,20 @@ msgport_manager_init (MsgPortManager *manager)
     if (!bus_address)
         bus_address = g_strdup_printf ("unix:path=%s/.message-port", g_get_user_runtime_dir());
 
-    connection = g_dbus_connection_new_for_address_sync (bus_address,
-            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, NULL, NULL, &error);
-    if (error) {
-        WARN ("Fail to connect messageport server at address %s: %s", bus_address, error->message);
-        g_error_free (error);
-    }
-    else {
-        manager->proxy = msgport_dbus_glue_manager_proxy_new_sync (
-            connection, G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES, NULL, "/", NULL, &error);
-        if (error) {
-            WARN ("Fail to get manager proxy : %s", error->message);
-            g_error_free (error);
-        }
+    /* manager is shared by all the threads, so its signals are dispatched
+     * in the global default main context, where the application main loop runs.
+     * Service proxies are created by the registering thread, and their
+     * messages are dispatched in that thread's default context.
+     * The global default context can not be pushed here, the application
+     * main loop might be running it on another thread; if the calling
+     * thread has a context of its own, connect from a thread which has none. */
+    context = g_main_context_get_thread_default ();
+    if (context && context != g_main_context_default ()) {
+        ConnectData data = { manager, bus_address };
+        g_thread_join (g_thread_new ("msgport-connect", _connect_thread, &data));
     }
+    else
+        _connect (manager, bus_address);
 
     g_free (bus_address);
 }
@@ -167,12 +486,12 @@ MsgPortManager * msgport_manager_new ()
 }
 
 static messageport_error_e
-_create_and_cache_service (MsgPortManager *manager, gchar *object_path, messageport_message_cb cb, int *service_id)
+_create_and_cache_service (MsgPortManager *manager, gchar *object_path, messageport_message_cb cb, messageport_message_view_cb view_cb, int *service_id)
 {
     int id;
     MsgPortService *service = msgport_service_new (
             g_dbus_proxy_get_connection (G_DBUS_PROXY(manager->proxy)),
-            object_path, cb);
+            object_path, cb, view_cb);
     if (!service) {
         g_free (object_path);
         return MESSAGEPORT_ERROR_OUT_OF_MEMORY;
@@ -180,8 +499,10 @@ _create_and_cache_service (MsgPortManager *manager, gchar *object_path, messagep
 
     id = msgport_service_id (service);
 
+    MSGPORT_MANAGER_LOCK (manager);
     g_hash_table_insert (manager->services, object_path, service);
     g_hash_table_insert (manager->local_services, GINT_TO_POINTER (id), object_path);
+    MSGPORT_MANAGER_UNLOCK (manager);
 
     if (service_id) *service_id = id;
 
@@ -205,7 +526,7 @@ _find_service (gpointer key, gpointer value, gpointer data)
     
 
 messageport_error_e
-msgport_manager_register_service (MsgPortManager *manager, const gchar *port_name, gboolean is_trusted, messageport_message_cb message_cb, int *service_id)
+msgport_manager_register_service (MsgPortManager *manager, const gchar *port_name, gboolean is_trusted, messageport_priority_e priority, messageport_message_cb message_cb, messageport_message_view_cb view_cb, int *service_id)
 {
     GError *error = NULL;
     gchar *object_path = NULL;
@@ -214,11 +535,12 @@ msgport_manager_register_service (MsgPortManager *manager, const gchar *port_nam
 
     g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
     g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
-    g_return_val_if_fail (service_id && port_name && message_cb, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+    g_return_val_if_fail (service_id && port_name && (message_cb || view_cb), MESSAGEPORT_ERROR_INVALID_PARAMETER);
 
     /* first check in cached services if found any */
     service_data.name = port_name;
     service_data.is_trusted = is_trusted;
+    MSGPORT_MANAGER_LOCK (manager);
     service = g_hash_table_find (manager->services, _find_service, &service_data);
 
     if (service) {
@@ -226,14 +548,16 @@ msgport_manager_register_service (MsgPortManager *manager, const gchar *port_nam
         DBG ("Cached local port found for name '%s:%d' with ID : %d", port_name, is_trusted, id);
 
         /* update message handler */
-        msgport_service_set_message_handler (service, message_cb);
+        msgport_service_set_message_handler (service, message_cb, view_cb);
+        MSGPORT_MANAGER_UNLOCK (manager);
         *service_id = id;
 
         return MESSAGEPORT_ERROR_NONE;
     }
+    MSGPORT_MANAGER_UNLOCK (manager);
 
     msgport_dbus_glue_manager_call_register_service_sync (manager->proxy,
-            port_name, is_trusted, &object_path, NULL, &error);
+            port_name, is_trusted, (guint)priority, &object_path, NULL, &error);
 
     if (error) {
         messageport_error_e err = msgport_daemon_error_to_error (error);
@@ -242,24 +566,29 @@ msgport_manager_register_service (MsgPortManager *manager, const gchar *port_nam
         return err; 
     }
 
-    return _create_and_cache_service (manager, object_path, message_cb, service_id);
+    return _create_and_cache_service (manager, object_path, message_cb, view_cb, service_id);
 }
 
+/*
+ * Returns a reference to the local service with given id, or NULL.
+ */
 static MsgPortService *
 _get_local_port (MsgPortManager *manager, int service_id)
 {
     const gchar *object_path = NULL;
     MsgPortService *service = NULL;
 
-    object_path = g_hash_table_lookup (manager->local_services, GINT_TO_POINTER(service_id));
-    if (!object_path) return NULL;
+    MSGPORT_MANAGER_LOCK (manager);
 
-    service = MSGPORT_SERVICE (g_hash_table_lookup (manager->services, object_path));
-    if (!service) {
-        g_hash_table_remove (manager->local_services, GINT_TO_POINTER (service_id));
-        return NULL;
+    object_path = g_hash_table_lookup (manager->local_services, GINT_TO_POINTER(service_id));
+    if (object_path) {
+        service = MSGPORT_SERVICE (g_hash_table_lookup (manager->services, object_path));
+        if (service) g_object_ref (service);
+        else g_hash_table_remove (manager->local_services, GINT_TO_POINTER (service_id));
     }
 
+    MSGPORT_MANAGER_UNLOCK (manager);
+
     return service;
 }
 
@@ -277,30 +606,69 @@ msgport_manager_unregister_servcie (MsgPortManager *manager, int service_id)
         return MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND;
     }
 
-    if (!msgport_service_unregister (service)) 
+    if (!msgport_service_unregister (service)) {
+        g_object_unref (service);
         return MESSAGEPORT_ERROR_IO_ERROR;
+    }
+    g_object_unref (service);
 
+    MSGPORT_MANAGER_LOCK (manager);
     object_path = (const gchar *)g_hash_table_lookup (manager->local_services,
                                                       GINT_TO_POINTER(service_id));
-    g_hash_table_remove (manager->local_services, GINT_TO_POINTER(service_id));
-    g_hash_table_remove (manager->services, object_path);
+    if (object_path) {
+        g_hash_table_remove (manager->local_services, GINT_TO_POINTER(service_id));
+        g_hash_table_remove (manager->services, object_path);
+    }
+    MSGPORT_MANAGER_UNLOCK (manager);
 
     return MESSAGEPORT_ERROR_NONE;
 }
 
-messageport_error_e 
-msgport_manager_check_remote_service (MsgPortManager *manager, const gchar *app_id, const gchar *port, gboolean is_trusted, guint *service_id_out)
+static guint
+_lookup_remote_service (MsgPortManager *manager, const gchar *app_id, const gchar *port, gboolean is_trusted)
+{
+    RemoteServiceKey key = { (gchar *)app_id, (gchar *)port, is_trusted };
+    guint service_id = 0;
+
+    MSGPORT_MANAGER_LOCK (manager);
+    service_id = GPOINTER_TO_UINT (g_hash_table_lookup (manager->remote_service_cache, &key));
+    MSGPORT_MANAGER_UNLOCK (manager);
+
+    return service_id;
+}
+
+static void
+_cache_remote_service (MsgPortManager *manager, const gchar *app_id, const gchar *port, gboolean is_trusted, guint service_id)
+{
+    RemoteServiceKey *key = g_slice_new (RemoteServiceKey);
+
+    key->app_id = g_strdup (app_id);
+    key->port_name = g_strdup (port);
+    key->is_trusted = is_trusted;
+
+    MSGPORT_MANAGER_LOCK (manager);
+    g_hash_table_replace (manager->remote_service_cache, key, GUINT_TO_POINTER (service_id));
+    MSGPORT_MANAGER_UNLOCK (manager);
+}
+
+/*
+ * Resolves remote service id, either from the cache or by asking the daemon.
+ * #from_cache is set to TRUE if the id was served from the cache.
+ */
+static messageport_error_e
+_resolve_remote_service (MsgPortManager *manager, const gchar *app_id, const gchar *port, gboolean is_trusted, guint *service_id_out, gboolean *from_cache)
 {
     GError *error = NULL;
     guint remote_service_id = 0;
 
-    if (service_id_out) *service_id_out = 0;
+    if (from_cache) *from_cache = FALSE;
 
-    g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
-    g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
-    g_return_val_if_fail (app_id && port, MESSAGEPORT_ERROR_INVALID_PARAMETER);
-
-    if (!app_id || !port) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+    remote_service_id = _lookup_remote_service (manager, app_id, port, is_trusted);
+    if (remote_service_id) {
+        if (from_cache) *from_cache = TRUE;
+        *service_id_out = remote_service_id;
+        return MESSAGEPORT_ERROR_NONE;
+    }
 
     msgport_dbus_glue_manager_call_check_for_remote_service_sync (manager->proxy,
             app_id, port, is_trusted, &remote_service_id, NULL, &error);
@@ -312,14 +680,37 @@ msgport_manager_check_remote_service (MsgPortManager *manager, const gchar *app_
         g_error_free (error);
         return err;
     }
-    else {
-        DBG ("Got service id %d for %s, %s", remote_service_id, app_id, port);
-        if (service_id_out)  *service_id_out = remote_service_id;
-    }
+
+    DBG ("Got service id %d for %s, %s", remote_service_id, app_id, port);
+
+    _cache_remote_service (manager, app_id, port, is_trusted, remote_service_id);
+
+    *service_id_out = remote_service_id;
 
     return MESSAGEPORT_ERROR_NONE;
 }
 
+messageport_error_e 
+msgport_manager_check_remote_service (MsgPortManager *manager, const gchar *app_id, const gchar *port, gboolean is_trusted, guint *service_id_out)
+{
+    guint remote_service_id = 0;
+    messageport_error_e res;
+
+    if (service_id_out) *service_id_out = 0;
+
+    g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (app_id && port, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    if (!app_id || !port) return MESSAGEPORT_ERROR_INVALID_PARAMETER;
+
+    res = _resolve_remote_service (manager, app_id, port, is_trusted, &remote_service_id, NULL);
+
+    if (res == MESSAGEPORT_ERROR_NONE && service_id_out) *service_id_out = remote_service_id;
+
+    return res;
+}
+
 messageport_error_e
 msgport_manager_get_service_name (MsgPortManager *manager, int service_id, gchar **name_out)
 {
@@ -332,6 +723,7 @@ msgport_manager_get_service_name (MsgPortManager *manager, int service_id, gchar
     if (!service) return MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND;
 
     *name_out = g_strdup (msgport_service_name (service));
+    g_object_unref (service);
 
     return MESSAGEPORT_ERROR_NONE;
 }
@@ -348,34 +740,222 @@ msgport_manager_get_service_is_trusted (MsgPortManager *manager, int service_id,
     if (!service) return MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND;
 
     *is_trusted_out = msgport_service_is_trusted (service);
+    g_object_unref (service);
 
     return MESSAGEPORT_ERROR_NONE;
 }
 
+/*
+ * Codecs the owner of the remote service decodes, queried once per
+ * service and dropped with the service.
+ */
+static gboolean
+_lookup_remote_codecs (MsgPortManager *manager, guint service_id, guint *codecs_out)
+{
+    gpointer codecs = NULL;
+    gboolean found;
+
+    MSGPORT_MANAGER_LOCK (manager);
+    found = g_hash_table_lookup_extended (manager->remote_codecs, GUINT_TO_POINTER (service_id), NULL, &codecs);
+    MSGPORT_MANAGER_UNLOCK (manager);
+
+    if (found && codecs_out) *codecs_out = GPOINTER_TO_UINT (codecs);
+
+    return found;
+}
+
+static void
+_cache_remote_codecs (MsgPortManager *manager, guint service_id, guint codecs)
+{
+    MSGPORT_MANAGER_LOCK (manager);
+    g_hash_table_insert (manager->remote_codecs, GUINT_TO_POINTER (service_id), GUINT_TO_POINTER (codecs));
+    MSGPORT_MANAGER_UNLOCK (manager);
+}
+
+static gboolean
+_is_compressible (MsgPortManager *manager, GVariant *data)
+{
+    return manager->codecs_negotiated && g_variant_get_size (data) >= MSGPORT_COMPRESSION_THRESHOLD;
+}
+
+/*
+ * Returns the message to send to the service, compressed if worth it
+ * and the receiver can decode it, otherwise a new reference to data.
+ * Codecs not known yet are queried only if may_block is set, the
+ * asynchronous paths query them beforehand.
+ */
+static GVariant *
+_compress_for_service (MsgPortManager *manager, guint service_id, GVariant *data, gboolean may_block)
+{
+    GVariant *compressed = NULL;
+    GError *error = NULL;
+    guint codecs = 0;
+
+    if (!_is_compressible (manager, data)) return g_variant_ref (data);
+
+    if (!_lookup_remote_codecs (manager, service_id, &codecs) && may_block) {
+        if (msgport_dbus_glue_manager_call_get_service_codecs_sync (manager->proxy,
+                    service_id, &codecs, NULL, &error)) {
+            _cache_remote_codecs (manager, service_id, codecs);
+        }
+        else {
+            DBG ("Fail to get codecs of service %d : %s", service_id, error->message);
+            g_error_free (error);
+            codecs = 0;
+        }
+    }
+
+    if (codecs) compressed = msgport_payload_compress (data, codecs);
+
+    return compressed ? compressed : g_variant_ref (data);
+}
+
+/*
+ * Sends the message to remote service either inline or, for the big ones,
+ * as sealed memfd payload. Bidirectional messages are sent on local_service.
+ */
+static messageport_error_e
+_send_message_to_service (MsgPortManager *manager, MsgPortService *local_service, guint service_id, GVariant *message)
+{
+    GUnixFDList *fd_list = NULL;
+    GError *error = NULL;
+    GVariant *data = NULL;
+    messageport_error_e err = MESSAGEPORT_ERROR_NONE;
+    gint fd = -1;
+
+    data = _compress_for_service (manager, service_id, message, TRUE);
+
+    if (g_variant_get_size (data) >= MSGPORT_LARGE_MESSAGE_THRESHOLD)
+        fd = msgport_payload_to_memfd (data);
+
+    if (local_service) {
+        err = fd >= 0 ? msgport_service_send_large_message (local_service, service_id, fd)
+                      : msgport_service_send_message (local_service, service_id, data);
+        g_variant_unref (data);
+        return err;
+    }
+
+    if (fd >= 0) {
+        fd_list = g_unix_fd_list_new_from_array (&fd, 1);
+        msgport_dbus_glue_manager_call_send_large_message_sync (manager->proxy,
+                service_id, 0, fd_list, NULL, NULL, &error);
+        g_object_unref (fd_list);
+    }
+    else
+        msgport_dbus_glue_manager_call_send_message_sync (manager->proxy, service_id, data, NULL, &error);
+
+    g_variant_unref (data);
+
+    if (error) {
+        err = msgport_daemon_error_to_error (error);
+        WARN ("Failed to send message to service %d : %s", service_id, error->message);
+        g_error_free (error);
+    }
+
+    return err;
+}
+
 messageport_error_e
 msgport_manager_send_message (MsgPortManager *manager, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, GVariant *data)
 {
     guint service_id = 0;
-    GError *error = NULL;
+    gboolean from_cache = FALSE;
     messageport_error_e err;
 
     g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
     g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
     g_return_val_if_fail (remote_app_id && remote_port, MESSAGEPORT_ERROR_INVALID_PARAMETER);
 
-    err = msgport_manager_check_remote_service (manager, remote_app_id, remote_port, is_trusted, &service_id);
-    if (service_id == 0) return err;
+    g_variant_ref_sink (data);
+
+    err = _resolve_remote_service (manager, remote_app_id, remote_port, is_trusted, &service_id, &from_cache);
+    if (err != MESSAGEPORT_ERROR_NONE) goto out;
+
+    err = _send_message_to_service (manager, NULL, service_id, data);
+
+    if (err == MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND && from_cache) {
+        /* cached id went stale before the daemon notification reached us,
+         * resolve it once again and retry */
+        DBG ("Cached service id %d for %s:%s is stale, retrying", service_id, remote_app_id, remote_port);
+        _invalidate_remote_service (manager, service_id);
+
+        err = _resolve_remote_service (manager, remote_app_id, remote_port, is_trusted, &service_id, NULL);
+        if (err == MESSAGEPORT_ERROR_NONE)
+            err = _send_message_to_service (manager, NULL, service_id, data);
+    }
+
+out:
+    g_variant_unref (data);
+
+    return err;
+}
 
-    msgport_dbus_glue_manager_call_send_message_sync (manager->proxy, service_id, data, NULL, &error);
+static messageport_error_e
+_send_messages_to_service (MsgPortManager *manager, guint service_id, GVariant **messages, guint n_messages)
+{
+    GVariantBuilder builder;
+    GVariant *results = NULL;
+    GVariantIter iter;
+    GError *error = NULL;
+    guint i, code;
+    messageport_error_e res = MESSAGEPORT_ERROR_NONE;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ua{sv})"));
+    for (i = 0; i < n_messages; i++)
+        g_variant_builder_add (&builder, "(u@a{sv})", service_id, messages[i]);
+
+    msgport_dbus_glue_manager_call_send_messages_sync (manager->proxy,
+            g_variant_builder_end (&builder), &results, NULL, &error);
 
     if (error) {
-        err = msgport_daemon_error_to_error (error);
-        WARN ("Failed to send message to (%s:%s) : %s", remote_app_id, remote_port, error->message);
+        res = msgport_daemon_error_to_error (error);
+        WARN ("Failed to send messages to service %d : %s", service_id, error->message);
         g_error_free (error);
-        return err;
+        return res;
     }
 
-    return MESSAGEPORT_ERROR_NONE;
+    /* report the first failure if any */
+    g_variant_iter_init (&iter, results);
+    while (res == MESSAGEPORT_ERROR_NONE && g_variant_iter_next (&iter, "u", &code))
+        res = msgport_daemon_error_code_to_error (code);
+
+    g_variant_unref (results);
+
+    return res;
+}
+
+messageport_error_e
+msgport_manager_send_messages (MsgPortManager *manager, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, GVariant **messages, guint n_messages)
+{
+    guint service_id = 0;
+    gboolean from_cache = FALSE;
+    messageport_error_e err;
+    guint i;
+
+    g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (remote_app_id && remote_port, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+    g_return_val_if_fail (messages && n_messages, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    for (i = 0; i < n_messages; i++) g_variant_ref_sink (messages[i]);
+
+    err = _resolve_remote_service (manager, remote_app_id, remote_port, is_trusted, &service_id, &from_cache);
+    if (err != MESSAGEPORT_ERROR_NONE) goto out;
+
+    err = _send_messages_to_service (manager, service_id, messages, n_messages);
+
+    if (err == MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND && from_cache) {
+        /* stale cached id, resolve again and retry once */
+        _invalidate_remote_service (manager, service_id);
+        err = _resolve_remote_service (manager, remote_app_id, remote_port, is_trusted, &service_id, NULL);
+        if (err == MESSAGEPORT_ERROR_NONE)
+            err = _send_messages_to_service (manager, service_id, messages, n_messages);
+    }
+
+out:
+    for (i = 0; i < n_messages; i++) g_variant_unref (messages[i]);
+
+    return err;
 }
 
 messageport_error_e
@@ -383,6 +963,7 @@ msgport_manager_send_bidirectional_message (MsgPortManager *manager, int local_p
 {
     MsgPortService *service = NULL;
     guint remote_service_id = 0;
+    gboolean from_cache = FALSE;
     messageport_error_e res = 0;
 
     g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
@@ -395,12 +976,322 @@ msgport_manager_send_bidirectional_message (MsgPortManager *manager, int local_p
         return MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND;
     }
 
-    if ((res = msgport_manager_check_remote_service (manager, remote_app_id, remote_port, is_trusted, &remote_service_id) != MESSAGEPORT_ERROR_NONE)) {
+    if ((res = _resolve_remote_service (manager, remote_app_id, remote_port, is_trusted, &remote_service_id, &from_cache)) != MESSAGEPORT_ERROR_NONE) {
         WARN ("No remote %sport informatuon for %s:%s, error : %d", is_trusted ? "trusted " : "", remote_app_id, remote_port, res);
+        g_object_unref (service);
         return MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND;
     }
 
+    g_variant_ref_sink (data);
+
     DBG ("Sending message from local service '%p' to remote sercie id '%d'", service, remote_service_id);
-    return msgport_service_send_message (service, remote_service_id, data);
+    res = _send_message_to_service (manager, service, remote_service_id, data);
+
+    if (res == MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND && from_cache) {
+        /* stale cached id, resolve again and retry once */
+        _invalidate_remote_service (manager, remote_service_id);
+        res = _resolve_remote_service (manager, remote_app_id, remote_port, is_trusted, &remote_service_id, NULL);
+        if (res == MESSAGEPORT_ERROR_NONE)
+            res = _send_message_to_service (manager, service, remote_service_id, data);
+    }
+
+    g_variant_unref (data);
+    g_object_unref (service);
+
+    return res;
 }
 
+/*
+ * Asynchronous send: resolves the remote service (from cache or with an
+ * async checkForRemoteService call) and then issues an async sendMessage,
+ * so that the caller never blocks on the daemon.
+ */
+typedef struct {
+    MsgPortManager     *manager;
+    MsgPortService     *service; /* local service for bidirectional messages, or NULL */
+    gchar              *app_id;
+    gchar              *port_name;
+    gboolean            is_trusted;
+    GVariant           *data;
+    guint               service_id;
+    gboolean            from_cache;
+    gboolean            no_reply; /* fire-and-forget */
+    gboolean            codecs_queried; /* for service_id */
+    messageport_send_cb cb;
+    gpointer            userdata;
+} AsyncSendData;
+
+static void
+_async_send_data_free (AsyncSendData *send_data)
+{
+    g_object_unref (send_data->manager);
+    if (send_data->service) g_object_unref (send_data->service);
+    g_free (send_data->app_id);
+    g_free (send_data->port_name);
+    g_variant_unref (send_data->data);
+
+    g_slice_free (AsyncSendData, send_data);
+}
+
+static void
+_async_send_complete (AsyncSendData *send_data, messageport_error_e result)
+{
+    if (send_data->cb) send_data->cb (result, send_data->userdata);
+
+    _async_send_data_free (send_data);
+}
+
+static void _async_send_resolve (AsyncSendData *send_data);
+
+static void
+_on_async_send_done (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    AsyncSendData *send_data = (AsyncSendData *)userdata;
+    messageport_error_e err = MESSAGEPORT_ERROR_NONE;
+    GError *error = NULL;
+
+    if (send_data->service) {
+        err = msgport_service_send_message_finish (send_data->service, result);
+    }
+    else if (!msgport_dbus_glue_manager_call_send_message_finish (
+                MSGPORT_DBUS_GLUE_MANAGER (source), result, &error)) {
+        err = msgport_daemon_error_to_error (error);
+        WARN ("Failed to send message to (%s:%s) : %s", send_data->app_id, send_data->port_name, error->message);
+        g_error_free (error);
+    }
+
+    if (err == MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND && send_data->from_cache) {
+        /* stale cached id, resolve again and retry once */
+        _invalidate_remote_service (send_data->manager, send_data->service_id);
+        send_data->from_cache = FALSE;
+        send_data->codecs_queried = FALSE;
+        send_data->service_id = 0;
+        _async_send_resolve (send_data);
+        return;
+    }
+
+    _async_send_complete (send_data, err);
+}
+
+/*
+ * Posts the message on the data channel, returns FALSE if it has to go
+ * over dbus instead : no channel, or message does not fit in a frame.
+ */
+static gboolean
+_channel_post_message (MsgPortManager *manager, MsgPortService *service, guint service_id, GVariant *data, messageport_error_e *res)
+{
+    GError *error = NULL;
+    gint payload_fd = -1;
+    gboolean has_channel, sent = FALSE;
+
+    MSGPORT_MANAGER_LOCK (manager);
+    has_channel = manager->channel_fd >= 0;
+    MSGPORT_MANAGER_UNLOCK (manager);
+
+    if (!has_channel) return FALSE;
+
+    if (g_variant_get_size (data) >= MSGPORT_LARGE_MESSAGE_THRESHOLD) {
+        payload_fd = msgport_payload_to_memfd (data);
+        if (payload_fd < 0) return FALSE;
+    }
+
+    /* the channel can be closed by the reader meanwhile, send under the lock */
+    MSGPORT_MANAGER_LOCK (manager);
+    if (manager->channel_fd >= 0) {
+        sent = msgport_channel_send (manager->channel_fd, service_id, service ? msgport_service_id (service) : 0,
+                payload_fd >= 0 ? MSGPORT_CHANNEL_FLAG_LARGE : MSGPORT_CHANNEL_FLAG_NONE, "", "",
+                payload_fd >= 0 ? NULL : g_variant_get_data (data),
+                payload_fd >= 0 ? 0 : g_variant_get_size (data),
+                payload_fd, &error);
+    }
+    else {
+        g_set_error (&error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_INVALID_PARAMS, "Data channel closed");
+    }
+    MSGPORT_MANAGER_UNLOCK (manager);
+    if (payload_fd >= 0) close (payload_fd);
+
+    if (!sent) {
+        gboolean fallback = g_error_matches (error, MSGPORT_ERROR_QUARK, MSGPORT_ERROR_INVALID_PARAMS);
+        if (!fallback) {
+            WARN ("Fail to post message to service %d : %s", service_id, error->message);
+            *res = msgport_daemon_error_to_error (error);
+        }
+        g_error_free (error);
+        return !fallback;
+    }
+
+    *res = MESSAGEPORT_ERROR_NONE;
+
+    return TRUE;
+}
+
+static void _async_send_do (AsyncSendData *send_data);
+
+static void
+_on_async_get_codecs_done (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    AsyncSendData *send_data = (AsyncSendData *)userdata;
+    GError *error = NULL;
+    guint codecs = 0;
+
+    if (msgport_dbus_glue_manager_call_get_service_codecs_finish (
+                MSGPORT_DBUS_GLUE_MANAGER (source), &codecs, result, &error)) {
+        _cache_remote_codecs (send_data->manager, send_data->service_id, codecs);
+    }
+    else {
+        /* sent uncompressed */
+        DBG ("Fail to get codecs of service %d : %s", send_data->service_id, error->message);
+        g_error_free (error);
+    }
+
+    _async_send_do (send_data);
+}
+
+static void
+_async_send_do (AsyncSendData *send_data)
+{
+    GVariant *data = NULL;
+
+    if (!send_data->codecs_queried && _is_compressible (send_data->manager, send_data->data) &&
+        !_lookup_remote_codecs (send_data->manager, send_data->service_id, NULL)) {
+        send_data->codecs_queried = TRUE;
+        msgport_dbus_glue_manager_call_get_service_codecs (send_data->manager->proxy,
+                send_data->service_id, NULL, _on_async_get_codecs_done, send_data);
+        return;
+    }
+
+    /* compressed for this very service id, the original is kept for retries */
+    data = _compress_for_service (send_data->manager, send_data->service_id, send_data->data, FALSE);
+
+    if (send_data->no_reply) {
+        messageport_error_e res;
+
+        if (!_channel_post_message (send_data->manager, send_data->service,
+                    send_data->service_id, data, &res)) {
+            if (send_data->service)
+                res = msgport_service_post_message (send_data->service, send_data->service_id, data);
+            else
+                res = msgport_dbus_post_message (g_dbus_proxy_get_connection (G_DBUS_PROXY (send_data->manager->proxy)),
+                        g_dbus_proxy_get_object_path (G_DBUS_PROXY (send_data->manager->proxy)),
+                        g_dbus_proxy_get_interface_name (G_DBUS_PROXY (send_data->manager->proxy)),
+                        send_data->service_id, data);
+        }
+
+        g_variant_unref (data);
+        _async_send_complete (send_data, res);
+        return;
+    }
+
+    if (send_data->service) {
+        msgport_service_send_message_async (send_data->service, send_data->service_id,
+                data, _on_async_send_done, send_data);
+    }
+    else {
+        msgport_dbus_glue_manager_call_send_message (send_data->manager->proxy, send_data->service_id,
+                data, NULL, _on_async_send_done, send_data);
+    }
+    g_variant_unref (data);
+}
+
+static void
+_on_async_check_remote_service_done (GObject *source, GAsyncResult *result, gpointer userdata)
+{
+    AsyncSendData *send_data = (AsyncSendData *)userdata;
+    GError *error = NULL;
+    guint service_id = 0;
+
+    if (!msgport_dbus_glue_manager_call_check_for_remote_service_finish (
+                MSGPORT_DBUS_GLUE_MANAGER (source), &service_id, result, &error)) {
+        messageport_error_e err = msgport_daemon_error_to_error (error);
+        WARN ("No %sservice found for app_id %s, port name %s: %s", send_data->is_trusted ? "trusted " : "",
+                send_data->app_id, send_data->port_name, error->message);
+        g_error_free (error);
+        _async_send_complete (send_data, err);
+        return;
+    }
+
+    _cache_remote_service (send_data->manager, send_data->app_id, send_data->port_name,
+            send_data->is_trusted, service_id);
+    send_data->service_id = service_id;
+
+    _async_send_do (send_data);
+}
+
+static void
+_async_send_resolve (AsyncSendData *send_data)
+{
+    send_data->service_id = _lookup_remote_service (send_data->manager,
+            send_data->app_id, send_data->port_name, send_data->is_trusted);
+
+    if (send_data->service_id) {
+        send_data->from_cache = TRUE;
+        _async_send_do (send_data);
+        return;
+    }
+
+    msgport_dbus_glue_manager_call_check_for_remote_service (send_data->manager->proxy,
+            send_data->app_id, send_data->port_name, send_data->is_trusted, NULL,
+            _on_async_check_remote_service_done, send_data);
+}
+
+static messageport_error_e
+_async_send_start (MsgPortManager *manager, int local_port_id, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, GVariant *data, gboolean no_reply, messageport_send_cb cb, gpointer userdata)
+{
+    MsgPortService *service = NULL;
+    AsyncSendData *send_data = NULL;
+
+    if (local_port_id > 0) {
+        service = _get_local_port (manager, local_port_id);
+        if (!service) {
+            WARN ("No local service found for service id '%d'", local_port_id);
+            g_variant_unref (g_variant_ref_sink (data));
+            return MESSAGEPORT_ERROR_MESSAGEPORT_NOT_FOUND;
+        }
+    }
+
+    send_data = g_slice_new0 (AsyncSendData);
+    send_data->manager = g_object_ref (manager);
+    send_data->service = service; /* reference taken by _get_local_port */
+    send_data->app_id = g_strdup (remote_app_id);
+    send_data->port_name = g_strdup (remote_port);
+    send_data->is_trusted = is_trusted;
+    send_data->data = g_variant_ref_sink (data);
+    send_data->no_reply = no_reply;
+    send_data->cb = cb;
+    send_data->userdata = userdata;
+
+    _async_send_resolve (send_data);
+
+    return MESSAGEPORT_ERROR_NONE;
+}
+
+messageport_error_e
+msgport_manager_send_message_async (MsgPortManager *manager, int local_port_id, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, GVariant *data, messageport_send_cb cb, gpointer userdata)
+{
+    g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (remote_app_id && remote_port && data, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    return _async_send_start (manager, local_port_id, remote_app_id, remote_port, is_trusted, data, FALSE, cb, userdata);
+}
+
+messageport_error_e
+msgport_manager_post_message (MsgPortManager *manager, int local_port_id, const gchar *remote_app_id, const gchar *remote_port, gboolean is_trusted, GVariant *data)
+{
+    g_return_val_if_fail (manager && MSGPORT_IS_MANAGER (manager), MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (manager->proxy, MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (remote_app_id && remote_port && data, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    return _async_send_start (manager, local_port_id, remote_app_id, remote_port, is_trusted, data, TRUE, NULL, NULL);
+}
+
+void
+msgport_manager_set_delivery_error_cb (MsgPortManager *manager, messageport_delivery_error_cb cb, gpointer userdata)
+{
+    g_return_if_fail (manager && MSGPORT_IS_MANAGER (manager));
+
+    MSGPORT_MANAGER_LOCK (manager);
+    manager->delivery_error_cb = cb;
+    manager->delivery_error_data = userdata;
+    MSGPORT_MANAGER_UNLOCK (manager);
+}
@@ -53,7 +53,7 @@ MsgPortManager *
 msgport_manager_new ();
 
 messageport_error_e
-msgport_manager_register_service (MsgPortManager *manager, const gchar *port_name, gboolean is_trusted, messageport_message_cb cb, int *service_id_out);
+msgport_manager_register_service (MsgPortManager *manager, const gchar *port_name, gboolean is_trusted, messageport_priority_e priority, messageport_message_cb cb, messageport_message_view_cb view_cb, int *service_id_out);
 
 messageport_error_e
 msgport_manager_check_remote_service (MsgPortManager *manager, const gchar *remote_app_id, const gchar *port_name, gboolean is_trusted, guint *service_id_out);
@@ -73,6 +73,18 @@ msgport_manager_send_message (MsgPortManager *manager, const gchar *remote_app_i
 messageport_error_e
 msgport_manager_send_bidirectional_message (MsgPortManager *manager, int from_id, const gchar *remote_app_id, const gchar *port_name, gboolean is_trusted, GVariant *data);
 
+messageport_error_e
+msgport_manager_send_messages (MsgPortManager *manager, const gchar *remote_app_id, const gchar *port_name, gboolean is_trusted, GVariant **messages, guint n_messages);
+
+messageport_error_e
+msgport_manager_post_message (MsgPortManager *manager, int from_id, const gchar *remote_app_id, const gchar *port_name, gboolean is_trusted, GVariant *data);
+
+void
+msgport_manager_set_delivery_error_cb (MsgPortManager *manager, messageport_delivery_error_cb cb, gpointer userdata);
+
+messageport_error_e
+msgport_manager_send_message_async (MsgPortManager *manager, int from_id, const gchar *remote_app_id, const gchar *port_name, gboolean is_trusted, GVariant *data, messageport_send_cb cb, gpointer userdata);
+
 G_END_DECLS
 
 #endif /* __MSGPORT_MANAGER_PROXY_H */
@@ -28,6 +28,8 @@
 #include "common/dbus-service-glue.h"
 #include "common/log.h"
 #include <bundle.h>
+#include <unistd.h>
+#include <gio/gunixfdlist.h>
 
 
 struct _MsgPortService
@@ -37,6 +39,8 @@ struct _MsgPortService
     MsgPortDbusGlueService *proxy;
     guint                   on_messge_signal_id;
     messageport_message_cb  client_cb;
+    messageport_message_view_cb view_cb; /* used instead of client_cb if set */
+    GMainContext           *context; /* where the messages are dispatched */
 };
 
 G_DEFINE_TYPE(MsgPortService, msgport_service, G_TYPE_OBJECT)
@@ -48,6 +52,11 @@ _service_dispose (GObject *self)
 
     g_clear_object (&service->proxy);
 
+    if (service->context) {
+        g_main_context_unref (service->context);
+        service->context = NULL;
+    }
+
     G_OBJECT_CLASS(msgport_service_parent_class)->dispose (self);
 }
 
@@ -64,19 +73,29 @@ msgport_service_init (MsgPortService *service)
 {
     service->proxy = NULL;
     service->client_cb = NULL;
+    service->view_cb = NULL;
     service->on_messge_signal_id = 0;
+    service->context = NULL;
 }
 
 static void
-_on_got_message (MsgPortService *service, GVariant *data, const gchar *remote_app_id, const gchar *remote_port, gboolean remote_is_trusted, gpointer userdata)
+_on_got_message (MsgPortService *service, GVariant *message, const gchar *remote_app_id, const gchar *remote_port, gboolean remote_is_trusted, gpointer userdata)
 {
+    /* compressed by the sender if we announced the codec */
+    GVariant *data = msgport_payload_decompress (message);
+
+    if (!data) {
+        WARN ("Dropping undecodable message from '%s':'%s'", remote_app_id, remote_port);
+        return;
+    }
+
 #ifdef ENABLE_DEBUG
     gchar *str_data = g_variant_print (data, TRUE);
     DBG ("Message received : '%s' from '%s':'%s':%d",
             str_data, remote_app_id, remote_port, remote_is_trusted);
     g_free (str_data);
 #endif
-    bundle *b = bundle_from_variant_map (data);
+    bundle *b = NULL;
 
     /*
      * NOTE: wrt plugin cannot handle empty strings for port_id and app_id.
@@ -86,11 +105,23 @@ _on_got_message (MsgPortService *service, GVariant *data, const gchar *remote_ap
     if (remote_app_id && !remote_app_id[0]) remote_app_id = NULL;
     if (remote_port   && !remote_port[0])   remote_port = NULL;
 
+    if (service->view_cb) {
+        /* no copy, the receiver reads only the values it needs */
+        messageport_message_view view;
+
+        msgport_message_view_init (&view, data);
+        service->view_cb (msgport_dbus_glue_service_get_id (service->proxy), remote_app_id, remote_port, remote_is_trusted, &view);
+        g_variant_unref (data);
+        return;
+    }
+
+    b = bundle_from_variant_map (data);
+    g_variant_unref (data);
     service->client_cb (msgport_dbus_glue_service_get_id (service->proxy), remote_app_id, remote_port, remote_is_trusted, b);
 }
 
 MsgPortService *
-msgport_service_new (GDBusConnection *connection, const gchar *path, messageport_message_cb message_cb)
+msgport_service_new (GDBusConnection *connection, const gchar *path, messageport_message_cb message_cb, messageport_message_view_cb view_cb)
 {
     GError *error = NULL;
 
@@ -109,6 +140,8 @@ msgport_service_new (GDBusConnection *connection, const gchar *path, messageport
     }
 
     service->client_cb = message_cb;
+    service->view_cb = view_cb;
+    service->context = g_main_context_ref_thread_default ();
     service->on_messge_signal_id = g_signal_connect_swapped (service->proxy, "on-message", G_CALLBACK (_on_got_message), service);
 
     return service;
@@ -142,11 +175,12 @@ msgport_service_is_trusted (MsgPortService *service)
 }
 
 void
-msgport_service_set_message_handler (MsgPortService *service, messageport_message_cb handler)
+msgport_service_set_message_handler (MsgPortService *service, messageport_message_cb handler, messageport_message_view_cb view_handler)
 {
     g_return_if_fail (service && MSGPORT_IS_SERVICE (service));
 
     service->client_cb = handler;
+    service->view_cb = view_handler;
 }
 
 gboolean
@@ -178,3 +212,129 @@ msgport_service_send_message (MsgPortService *service, guint remote_service_id,
 
     return MESSAGEPORT_ERROR_NONE;
 }
+
+/*
+ * Sends message payload passed as sealed memfd, takes the ownership of payload_fd.
+ */
+messageport_error_e
+msgport_service_send_large_message (MsgPortService *service, guint remote_service_id, gint payload_fd)
+{
+    GUnixFDList *fd_list = NULL;
+    GError *error = NULL;
+
+    if (!service || !MSGPORT_IS_SERVICE (service) || !service->proxy) {
+        close (payload_fd);
+        g_return_val_if_reached (MESSAGEPORT_ERROR_IO_ERROR);
+    }
+
+    fd_list = g_unix_fd_list_new_from_array (&payload_fd, 1);
+    msgport_dbus_glue_service_call_send_large_message_sync (service->proxy,
+            remote_service_id, 0, fd_list, NULL, NULL, &error);
+    g_object_unref (fd_list);
+
+    if (error) {
+        messageport_error_e err = msgport_daemon_error_to_error (error);
+        WARN ("Fail to send large message on service %p to %d : %s", service, remote_service_id, error->message);
+        g_error_free (error);
+        return err;
+    }
+
+    return MESSAGEPORT_ERROR_NONE;
+}
+
+void
+msgport_service_send_message_async (MsgPortService *service, guint remote_service_id, GVariant *message, GAsyncReadyCallback cb, gpointer userdata)
+{
+    g_return_if_fail (service && MSGPORT_IS_SERVICE (service));
+    g_return_if_fail (service->proxy);
+    g_return_if_fail (message);
+
+    msgport_dbus_glue_service_call_send_message (service->proxy, remote_service_id, message, NULL, cb, userdata);
+}
+
+messageport_error_e
+msgport_service_send_message_finish (MsgPortService *service, GAsyncResult *result)
+{
+    GError *error = NULL;
+    g_return_val_if_fail (service && MSGPORT_IS_SERVICE (service), MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (service->proxy, MESSAGEPORT_ERROR_IO_ERROR);
+
+    if (!msgport_dbus_glue_service_call_send_message_finish (service->proxy, result, &error)) {
+        messageport_error_e err = msgport_daemon_error_to_error (error);
+        WARN ("Fail to send message on service %p : %s", service, error->message);
+        g_error_free (error);
+        return err;
+    }
+
+    return MESSAGEPORT_ERROR_NONE;
+}
+
+messageport_error_e
+msgport_service_post_message (MsgPortService *service, guint remote_service_id, GVariant *message)
+{
+    g_return_val_if_fail (service && MSGPORT_IS_SERVICE (service), MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (service->proxy, MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (message, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    return msgport_dbus_post_message (g_dbus_proxy_get_connection (G_DBUS_PROXY (service->proxy)),
+            g_dbus_proxy_get_object_path (G_DBUS_PROXY (service->proxy)),
+            g_dbus_proxy_get_interface_name (G_DBUS_PROXY (service->proxy)),
+            remote_service_id, message);
+}
+
+typedef struct {
+    MsgPortService *service;
+    GVariant       *data;
+    gchar          *app_id;
+    gchar          *port_name;
+    gboolean        is_trusted;
+} ChannelDelivery;
+
+static void
+_channel_delivery_free (gpointer userdata)
+{
+    ChannelDelivery *delivery = (ChannelDelivery *)userdata;
+
+    g_object_unref (delivery->service);
+    g_variant_unref (delivery->data);
+    g_free (delivery->app_id);
+    g_free (delivery->port_name);
+    g_slice_free (ChannelDelivery, delivery);
+}
+
+static gboolean
+_channel_delivery_dispatch (gpointer userdata)
+{
+    ChannelDelivery *delivery = (ChannelDelivery *)userdata;
+
+    /* service unregistered meanwhile */
+    if (!delivery->service->proxy) return FALSE;
+
+    _on_got_message (delivery->service, delivery->data,
+            delivery->app_id, delivery->port_name, delivery->is_trusted, NULL);
+
+    return FALSE;
+}
+
+/*
+ * Delivers a message received on the data channel, in the same context
+ * the messages from the service proxy would have been dispatched.
+ */
+void
+msgport_service_deliver_message (MsgPortService *service, GVariant *data, const gchar *remote_app_id, const gchar *remote_port, gboolean remote_is_trusted)
+{
+    ChannelDelivery *delivery = NULL;
+
+    g_return_if_fail (service && MSGPORT_IS_SERVICE (service));
+    g_return_if_fail (data);
+
+    delivery = g_slice_new (ChannelDelivery);
+    delivery->service = g_object_ref (service);
+    delivery->data = g_variant_ref (data);
+    delivery->app_id = g_strdup (remote_app_id);
+    delivery->port_name = g_strdup (remote_port);
+    delivery->is_trusted = remote_is_trusted;
+
+    g_main_context_invoke_full (service->context, G_PRIORITY_DEFAULT,
+            _channel_delivery_dispatch, delivery, _channel_delivery_free);
+}
@@ -50,7 +50,7 @@ struct _MsgPortServiceClass
 GType msgport_service_get_type(void);
 
 MsgPortService *
-msgport_service_new (GDBusConnection *connection, const gchar *path, messageport_message_cb message_cb);
+msgport_service_new (GDBusConnection *connection, const gchar *path, messageport_message_cb message_cb, messageport_message_view_cb view_cb);
 
 const gchar *
 msgport_service_name (MsgPortService *service);
@@ -62,7 +62,7 @@ guint
 msgport_service_id (MsgPortService *service);
 
 void
-msgport_service_set_message_handler (MsgPortService *service, messageport_message_cb handler);
+msgport_service_set_message_handler (MsgPortService *service, messageport_message_cb handler, messageport_message_view_cb view_handler);
 
 gboolean
 msgport_service_unregister (MsgPortService *service);
@@ -70,6 +70,21 @@ msgport_service_unregister (MsgPortService *service);
 messageport_error_e
 msgport_service_send_message (MsgPortService *service, guint remote_service_id, GVariant *message);
 
+messageport_error_e
+msgport_service_send_large_message (MsgPortService *service, guint remote_service_id, gint payload_fd);
+
+void
+msgport_service_send_message_async (MsgPortService *service, guint remote_service_id, GVariant *message, GAsyncReadyCallback cb, gpointer userdata);
+
+messageport_error_e
+msgport_service_send_message_finish (MsgPortService *service, GAsyncResult *result);
+
+messageport_error_e
+msgport_service_post_message (MsgPortService *service, guint remote_service_id, GVariant *message);
+
+void
+msgport_service_deliver_message (MsgPortService *service, GVariant *data, const gchar *remote_app_id, const gchar *remote_port, gboolean remote_is_trusted);
+
 G_END_DECLS
 
 #endif /* __MSGPORT_SERVICE_H */
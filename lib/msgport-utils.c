@@ -23,25 +23,74 @@
  * 02110-1301 USA
  */
 
+#include "config.h"
+
 #include "msgport-utils.h"
+#include "common/channel.h" /* msgport_channel_payload_to_memfd */
 #include "common/dbus-error.h" /* MsgPortError */
 #include "common/log.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gio/gunixfdlist.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define MSGPORT_DBUS_SERVICE_INTERFACE "org.tizen.messageport.Service"
+
+static GVariant *
+_bundle_keyval_to_variant (const char *key, const int type, const bundle_keyval_t *kv)
+{
+    GVariant *value = NULL;
+    void *val = NULL;
+    size_t size = 0;
+
+    switch (bundle_keyval_get_type ((bundle_keyval_t*)kv)) {
+        case BUNDLE_TYPE_STR:
+            bundle_keyval_get_basic_val ((bundle_keyval_t*)kv, &val, &size);
+            value = g_variant_new_string ((const gchar *)val);
+            break;
+        case BUNDLE_TYPE_BYTE:
+            /* binary values are carried as is, no need of string encoding */
+            bundle_keyval_get_basic_val ((bundle_keyval_t*)kv, &val, &size);
+            value = g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE, val, size, sizeof (guchar));
+            break;
+        case BUNDLE_TYPE_STR_ARRAY: {
+            GVariantBuilder builder;
+            void **array = NULL;
+            unsigned int len = 0, i;
+            size_t *element_sizes = NULL;
+
+            bundle_keyval_get_array_val ((bundle_keyval_t*)kv, &array, &len, &element_sizes);
+            /* elements never set, e.g. bundle_add_str_array (b, key, NULL, len), are sent empty */
+            g_variant_builder_init (&builder, G_VARIANT_TYPE_STRING_ARRAY);
+            for (i = 0; i < len; i++)
+                g_variant_builder_add (&builder, "s", array && array[i] ? (const gchar *)array[i] : "");
+            value = g_variant_builder_end (&builder);
+            break;
+        }
+        default:
+            WARN ("unsupported bundle value type %d for key '%s', ignoring", type, key);
+            return NULL;
+    }
+
+    return value;
+}
+
 static void
 _bundle_iter_cb (const char *key, const int type, const bundle_keyval_t *kv, void *user_data)
 {
     GVariantBuilder *builder = (GVariantBuilder *)user_data;
-    void *val;
-    size_t size;
-
-    /* NOTE: we support only string values as 
-     * MessagePort API support key,value strings 
-     */
-    if (bundle_keyval_get_type ((bundle_keyval_t*)kv) != BUNDLE_TYPE_STR) return;
-
-    bundle_keyval_get_basic_val ((bundle_keyval_t*)kv, &val, &size);
+    GVariant *value = _bundle_keyval_to_variant (key, type, kv);
 
-    g_variant_builder_add (builder, "{sv}", key, g_variant_new_string ((const gchar *)val));
+    if (value) g_variant_builder_add (builder, "{sv}", key, value);
 }
 
 GVariant * bundle_to_variant_map (bundle *b)
@@ -69,7 +118,26 @@ bundle * bundle_from_variant_map (GVariant *v_data)
     b = bundle_create ();
 
     while (g_variant_iter_next (&iter, "{sv}", &key, &value)) {
-        bundle_add (b, key, g_variant_get_string (value, NULL));
+        if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+            bundle_add (b, key, g_variant_get_string (value, NULL));
+        }
+        else if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING)) {
+            /* points into the serialized message, bundle takes its own copy */
+            gsize size = 0;
+            gconstpointer bytes = g_variant_get_fixed_array (value, &size, sizeof (guchar));
+            bundle_add_byte (b, key, bytes, size);
+        }
+        else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY)) {
+            /* container only, strings are not duplicated */
+            gsize len = 0;
+            const gchar **strv = g_variant_get_strv (value, &len);
+            bundle_add_str_array (b, key, strv, (int)len);
+            g_free (strv);
+        }
+        else {
+            WARN ("unsupported value type '%s' for key '%s', ignoring",
+                    g_variant_get_type_string (value), key);
+        }
         g_free (key);
         g_variant_unref (value);
     }
@@ -77,12 +145,137 @@ bundle * bundle_from_variant_map (GVariant *v_data)
     return b;
 }
 
-messageport_error_e
-msgport_daemon_error_to_error (const GError *error)
+/*
+ * Prepared messages keep one serialized {sv} entry per key, so that
+ * changing a value re-serializes only that entry, and the message is
+ * assembled from the serialized entries by a plain copy. Unchanged
+ * messages are sent as is.
+ */
+struct _messageport_message {
+    GPtrArray  *entries; /* {sv} GVariant*, in bundle order */
+    GHashTable *index;   /* {gchar*:guint} key to entries index */
+    GVariant   *data;    /* a{sv} built from entries, NULL if outdated */
+};
+
+static void
+_message_add_entry_cb (const char *key, const int type, const bundle_keyval_t *kv, void *user_data)
 {
-    if (!error) return MESSAGEPORT_ERROR_NONE;
+    GVariant *value = _bundle_keyval_to_variant (key, type, kv);
+
+    if (value) msgport_message_set_value ((messageport_message_t *)user_data, key, value);
+}
+
+messageport_message_t *
+msgport_message_new (bundle *b)
+{
+    messageport_message_t *message = g_slice_new0 (messageport_message_t);
 
-    switch (error->code) {
+    message->entries = g_ptr_array_new_with_free_func ((GDestroyNotify)g_variant_unref);
+    message->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    message->data = NULL;
+
+    if (b) bundle_foreach (b, _message_add_entry_cb, message);
+
+    return message;
+}
+
+void
+msgport_message_free (messageport_message_t *message)
+{
+    if (!message) return;
+
+    g_ptr_array_unref (message->entries);
+    g_hash_table_unref (message->index);
+    if (message->data) g_variant_unref (message->data);
+
+    g_slice_free (messageport_message_t, message);
+}
+
+/*
+ * Replaces the value of key, or appends it if not found,
+ * sinks the value if it is floating.
+ */
+void
+msgport_message_set_value (messageport_message_t *message, const gchar *key, GVariant *value)
+{
+    GVariant *entry = NULL;
+    gpointer index = NULL;
+
+    g_return_if_fail (message && key && value);
+
+    entry = g_variant_ref_sink (g_variant_new_dict_entry (
+                g_variant_new_string (key), g_variant_new_variant (value)));
+    /* serialize now, the message is assembled from the serialized entries */
+    g_variant_get_data (entry);
+
+    if (g_hash_table_lookup_extended (message->index, key, NULL, &index)) {
+        guint i = GPOINTER_TO_UINT (index);
+        g_variant_unref (g_ptr_array_index (message->entries, i));
+        g_ptr_array_index (message->entries, i) = entry;
+    }
+    else {
+        g_hash_table_insert (message->index, g_strdup (key), GUINT_TO_POINTER (message->entries->len));
+        g_ptr_array_add (message->entries, entry);
+    }
+
+    if (message->data) {
+        g_variant_unref (message->data);
+        message->data = NULL;
+    }
+}
+
+/*
+ * Returns the message as a{sv}, owned by message and valid until
+ * it is changed. Callers that keep it must take their own reference.
+ */
+GVariant *
+msgport_message_get_data (messageport_message_t *message)
+{
+    g_return_val_if_fail (message, NULL);
+
+    if (!message->data) {
+        message->data = g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("{sv}"),
+                    (GVariant * const *)message->entries->pdata, message->entries->len));
+        g_variant_get_data (message->data);
+    }
+
+    return message->data;
+}
+
+/*
+ * Views look up values as children of the serialized message, so that
+ * the strings and byte arrays handed out stay valid after the child
+ * variant is dropped. Messages from the wire are serialized already.
+ */
+void
+msgport_message_view_init (messageport_message_view *view, GVariant *data)
+{
+    g_return_if_fail (view && data);
+
+    g_variant_get_data (data);
+    view->data = data;
+}
+
+/*
+ * Returns the bundle_type_t the value would be added to a bundle with,
+ * or -1 if it is not supported.
+ */
+int
+msgport_variant_bundle_type (GVariant *value)
+{
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) return BUNDLE_TYPE_STR;
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_BYTESTRING)) return BUNDLE_TYPE_BYTE;
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING_ARRAY)) return BUNDLE_TYPE_STR_ARRAY;
+
+    return -1;
+}
+
+messageport_error_e
+msgport_daemon_error_code_to_error (guint code)
+{
+    switch (code) {
+        case 0:
+            return MESSAGEPORT_ERROR_NONE;
         case MSGPORT_ERROR_OUT_OF_MEMORY:
             return MESSAGEPORT_ERROR_OUT_OF_MEMORY;
         case MSGPORT_ERROR_NOT_FOUND:
@@ -91,6 +284,8 @@ msgport_daemon_error_to_error (const GError *error)
             return MESSAGEPORT_ERROR_INVALID_PARAMETER;
         case MSGPORT_ERROR_CERTIFICATE_MISMATCH:
             return MESSAGEPORT_ERROR_CERTIFICATE_NOT_MATCH;
+        case MSGPORT_ERROR_WOULD_BLOCK:
+            return MESSAGEPORT_ERROR_WOULD_BLOCK;
         case MSGPORT_ERROR_UNKNOWN:
         case MSGPORT_ERROR_IO_ERROR:
             return MESSAGEPORT_ERROR_IO_ERROR;
@@ -98,3 +293,338 @@ msgport_daemon_error_to_error (const GError *error)
 
     return MESSAGEPORT_ERROR_IO_ERROR;
 }
+
+messageport_error_e
+msgport_daemon_error_to_error (const GError *error)
+{
+    if (!error) return MESSAGEPORT_ERROR_NONE;
+
+    if (error->domain != MSGPORT_ERROR_QUARK) return MESSAGEPORT_ERROR_IO_ERROR;
+
+    return msgport_daemon_error_code_to_error (error->code);
+}
+
+/*
+ * Sends 'sendMessage' method call on given interface without expecting
+ * any reply from the daemon, errors if any are reported by the daemon
+ * with Manager.messageDeliveryFailed signal.
+ */
+messageport_error_e
+msgport_dbus_post_message (
+    GDBusConnection *connection,
+    const gchar     *object_path,
+    const gchar     *interface_name,
+    guint            service_id,
+    GVariant        *data)
+{
+    GDBusMessage *msg = NULL;
+    GError *error = NULL;
+    messageport_error_e res = MESSAGEPORT_ERROR_NONE;
+
+    g_return_val_if_fail (connection && object_path && interface_name, MESSAGEPORT_ERROR_IO_ERROR);
+    g_return_val_if_fail (data, MESSAGEPORT_ERROR_INVALID_PARAMETER);
+
+    msg = g_dbus_message_new_method_call (NULL, object_path, interface_name, "sendMessage");
+    g_dbus_message_set_body (msg, g_variant_new ("(u@a{sv})", service_id, data));
+    g_dbus_message_set_flags (msg, G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+
+    if (!g_dbus_connection_send_message (connection, msg, G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, &error)) {
+        WARN ("Fail to post message to service %d : %s", service_id, error->message);
+        g_error_free (error);
+        res = MESSAGEPORT_ERROR_IO_ERROR;
+    }
+
+    g_object_unref (msg);
+
+    return res;
+}
+
+/* upper bound of a decompressed message, anything bigger is treated as corrupted */
+#define MSGPORT_MAX_DECOMPRESSED_SIZE (64 * 1024 * 1024)
+
+guint
+msgport_codecs_supported (void)
+{
+    guint codecs = MSGPORT_CODEC_NONE;
+
+#ifdef HAVE_LZ4
+    codecs |= MSGPORT_CODEC_LZ4;
+#endif
+#ifdef HAVE_ZSTD
+    codecs |= MSGPORT_CODEC_ZSTD;
+#endif
+
+    return codecs;
+}
+
+/*
+ * Compresses the message with the best of the given codecs.
+ * Returns the compressed message, or NULL if the message is below
+ * the threshold, no codec is usable, or it did not compress well.
+ */
+GVariant *
+msgport_payload_compress (GVariant *data, guint codecs)
+{
+    GVariantBuilder builder;
+    GVariant *payload = NULL;
+    gconstpointer src = NULL;
+    gpointer dst = NULL;
+    gsize size, dst_size = 0;
+    guint codec = MSGPORT_CODEC_NONE;
+
+    g_return_val_if_fail (data, NULL);
+
+    codecs &= msgport_codecs_supported ();
+    size = g_variant_get_size (data);
+    if (!codecs || size < MSGPORT_COMPRESSION_THRESHOLD || size > MSGPORT_MAX_DECOMPRESSED_SIZE)
+        return NULL;
+
+    src = g_variant_get_data (data);
+
+#ifdef HAVE_ZSTD
+    if (codecs & MSGPORT_CODEC_ZSTD) {
+        gsize bound = ZSTD_compressBound (size);
+
+        dst = g_malloc (bound);
+        dst_size = ZSTD_compress (dst, bound, src, size, 1);
+        if (ZSTD_isError (dst_size)) {
+            WARN ("Fail to compress payload : %s", ZSTD_getErrorName (dst_size));
+            g_free (dst);
+            dst = NULL;
+        }
+        else codec = MSGPORT_CODEC_ZSTD;
+    }
+#endif
+#ifdef HAVE_LZ4
+    if (!codec && (codecs & MSGPORT_CODEC_LZ4)) {
+        gint bound = LZ4_compressBound ((gint)size);
+        gint len;
+
+        dst = g_malloc (bound);
+        len = LZ4_compress_default ((const char *)src, (char *)dst, (gint)size, bound);
+        if (len <= 0) {
+            WARN ("Fail to compress payload");
+            g_free (dst);
+            dst = NULL;
+        }
+        else {
+            dst_size = len;
+            codec = MSGPORT_CODEC_LZ4;
+        }
+    }
+#endif
+
+    if (!codec) return NULL;
+
+    /* not worth the receiver's time */
+    if (dst_size >= size - size / 8) {
+        g_free (dst);
+        return NULL;
+    }
+
+    payload = g_variant_new_from_data (G_VARIANT_TYPE_BYTESTRING, dst, dst_size, TRUE, g_free, dst);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&builder, "{sv}", MSGPORT_COMPRESSED_KEY,
+            g_variant_new ("(uu@ay)", codec, (guint32)size, payload));
+
+    return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+/*
+ * Returns the original message if data was compressed by
+ * msgport_payload_compress(), otherwise a new reference to data.
+ * Returns NULL if it could not be decompressed.
+ */
+GVariant *
+msgport_payload_decompress (GVariant *data)
+{
+    GVariant *entry = NULL, *payload = NULL, *result = NULL;
+    gconstpointer src = NULL;
+    gpointer dst = NULL;
+    gsize src_size = 0;
+    guint32 codec = 0, size = 0;
+    gboolean ok = FALSE;
+
+    g_return_val_if_fail (data, NULL);
+
+    if (g_variant_n_children (data) != 1 ||
+        !(entry = g_variant_lookup_value (data, MSGPORT_COMPRESSED_KEY, G_VARIANT_TYPE ("(uuay)"))))
+        return g_variant_ref (data);
+
+    g_variant_get (entry, "(uu@ay)", &codec, &size, &payload);
+    g_variant_unref (entry);
+    src = g_variant_get_fixed_array (payload, &src_size, sizeof (guchar));
+
+    if (size == 0 || size > MSGPORT_MAX_DECOMPRESSED_SIZE) {
+        WARN ("Invalid compressed payload size %u", size);
+        g_variant_unref (payload);
+        return NULL;
+    }
+
+    dst = g_malloc (size);
+
+    switch (codec) {
+#ifdef HAVE_ZSTD
+        case MSGPORT_CODEC_ZSTD: {
+            gsize len = ZSTD_decompress (dst, size, src, src_size);
+            ok = !ZSTD_isError (len) && len == size;
+            break;
+        }
+#endif
+#ifdef HAVE_LZ4
+        case MSGPORT_CODEC_LZ4:
+            ok = LZ4_decompress_safe ((const char *)src, (char *)dst, (gint)src_size, (gint)size) == (gint)size;
+            break;
+#endif
+        default:
+            WARN ("Unsupported payload codec %u", codec);
+            break;
+    }
+    g_variant_unref (payload);
+
+    if (!ok) {
+        WARN ("Fail to decompress payload");
+        g_free (dst);
+        return NULL;
+    }
+
+    result = g_variant_new_from_data (G_VARIANT_TYPE_VARDICT, dst, size, FALSE, g_free, dst);
+
+    return g_variant_ref_sink (result);
+}
+
+/*
+ * Writes the serialized message data to a new memfd and seals it,
+ * so that it can be passed as is to the receiver.
+ * Returns the fd, or -1 if the payload could not be created.
+ */
+gint
+msgport_payload_to_memfd (GVariant *data)
+{
+    GError *error = NULL;
+    gint fd;
+
+    g_return_val_if_fail (data, -1);
+
+    fd = msgport_channel_payload_to_memfd (g_variant_get_data (data), g_variant_get_size (data), &error);
+    if (fd < 0) {
+        WARN ("Fail to create payload : %s", error->message);
+        g_error_free (error);
+    }
+
+    return fd;
+}
+
+typedef struct {
+    gpointer addr;
+    gsize    size;
+} PayloadMapping;
+
+static void
+_payload_mapping_free (gpointer userdata)
+{
+    PayloadMapping *mapping = (PayloadMapping *)userdata;
+
+    munmap (mapping->addr, mapping->size);
+    g_slice_free (PayloadMapping, mapping);
+}
+
+/*
+ * Maps the payload written by msgport_payload_to_memfd() as a{sv} variant,
+ * data is not copied but read directly from the mapping.
+ * Takes the ownership of the fd.
+ */
+GVariant *
+msgport_payload_from_fd (gint fd)
+{
+    struct stat st;
+    PayloadMapping *mapping = NULL;
+    gpointer addr = NULL;
+
+    g_return_val_if_fail (fd >= 0, NULL);
+
+    if (fstat (fd, &st) < 0) {
+        WARN ("Fail to stat payload : %s", g_strerror (errno));
+        close (fd);
+        return NULL;
+    }
+
+    if (st.st_size == 0) {
+        close (fd);
+        return g_variant_ref_sink (g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0));
+    }
+
+    addr = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (addr == MAP_FAILED) {
+        WARN ("Fail to map payload : %s", g_strerror (errno));
+        return NULL;
+    }
+
+    mapping = g_slice_new (PayloadMapping);
+    mapping->addr = addr;
+    mapping->size = st.st_size;
+
+    return g_variant_ref_sink (g_variant_new_from_data (G_VARIANT_TYPE_VARDICT,
+                addr, st.st_size, FALSE, _payload_mapping_free, mapping));
+}
+
+/*
+ * Turns Service.onLargeMessage signal to Service.onMessage, by mapping
+ * the payload, so that the service proxies need not know about it.
+ */
+static GDBusMessage *
+_large_message_filter (GDBusConnection *connection, GDBusMessage *message, gboolean incoming, gpointer userdata)
+{
+    GDBusMessage *rewritten = NULL;
+    GVariant *body = NULL;
+    GVariant *data = NULL;
+    GError *error = NULL;
+    const gchar *app_id = NULL, *port = NULL;
+    gboolean is_trusted = FALSE;
+    gint handle = -1, fd = -1;
+
+    if (!incoming ||
+        g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_SIGNAL ||
+        g_strcmp0 (g_dbus_message_get_member (message), "onLargeMessage") ||
+        g_strcmp0 (g_dbus_message_get_interface (message), MSGPORT_DBUS_SERVICE_INTERFACE))
+        return message;
+
+    body = g_dbus_message_get_body (message);
+    if (!body || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(hssb)")) ||
+        !g_dbus_message_get_unix_fd_list (message)) {
+        WARN ("Ignoring malformed large message");
+        goto drop;
+    }
+
+    g_variant_get (body, "(h&s&sb)", &handle, &app_id, &port, &is_trusted);
+
+    fd = g_unix_fd_list_get (g_dbus_message_get_unix_fd_list (message), handle, &error);
+    if (fd < 0) {
+        WARN ("Fail to get large message payload : %s", error->message);
+        g_error_free (error);
+        goto drop;
+    }
+
+    if (!(data = msgport_payload_from_fd (fd))) goto drop;
+
+    rewritten = g_dbus_message_new_signal (g_dbus_message_get_path (message),
+            MSGPORT_DBUS_SERVICE_INTERFACE, "onMessage");
+    g_dbus_message_set_sender (rewritten, g_dbus_message_get_sender (message));
+    g_dbus_message_set_body (rewritten, g_variant_new ("(@a{sv}ssb)", data, app_id, port, is_trusted));
+    g_variant_unref (data);
+
+drop:
+    g_object_unref (message);
+
+    return rewritten;
+}
+
+guint
+msgport_dbus_add_large_message_filter (GDBusConnection *connection)
+{
+    g_return_val_if_fail (connection && G_IS_DBUS_CONNECTION (connection), 0);
+
+    return g_dbus_connection_add_filter (connection, _large_message_filter, NULL, NULL);
+}
@@ -28,11 +28,63 @@
 
 #include <bundle.h>
 #include <glib.h>
+#include <gio/gio.h>
 #include <message-port.h>
 
 GVariant *bundle_to_variant_map (bundle *b);
 bundle   *bundle_from_variant_map (GVariant *v);
 
+/*
+ * Read-only view over a received a{sv} message, lives only
+ * for the duration of the messageport_message_view_cb call.
+ */
+struct _messageport_message_view {
+    GVariant *data;
+};
+
+messageport_message_t *msgport_message_new (bundle *b);
+void       msgport_message_free (messageport_message_t *message);
+void       msgport_message_set_value (messageport_message_t *message, const gchar *key, GVariant *value);
+GVariant  *msgport_message_get_data (messageport_message_t *message);
+
+void msgport_message_view_init (messageport_message_view *view, GVariant *data);
+int  msgport_variant_bundle_type (GVariant *value);
+
 messageport_error_e msgport_daemon_error_to_error (const GError *error);
+messageport_error_e msgport_daemon_error_code_to_error (guint code);
+
+messageport_error_e
+msgport_dbus_post_message (GDBusConnection *connection, const gchar *object_path, const gchar *interface_name, guint service_id, GVariant *data);
+
+/*
+ * Messages with serialized size at or above this are passed
+ * as sealed memfd, instead of inlining them in the D-Bus message.
+ */
+#define MSGPORT_LARGE_MESSAGE_THRESHOLD (64 * 1024)
+
+/*
+ * Payload codecs, messages at or above the threshold are compressed
+ * if the receiver decodes any codec known to the sender. Compressed
+ * messages are a{sv} with the single MSGPORT_COMPRESSED_KEY entry
+ * (uuay): codec, original size and the compressed serialized a{sv}.
+ */
+typedef enum {
+    MSGPORT_CODEC_NONE = 0,
+    MSGPORT_CODEC_LZ4  = 1 << 0,
+    MSGPORT_CODEC_ZSTD = 1 << 1,
+} MsgPortCodec;
+
+#define MSGPORT_COMPRESSION_THRESHOLD (4 * 1024)
+#define MSGPORT_COMPRESSED_KEY "__msgport_compressed"
+
+guint     msgport_codecs_supported (void);
+GVariant *msgport_payload_compress (GVariant *data, guint codecs);
+GVariant *msgport_payload_decompress (GVariant *data);
+
+gint      msgport_payload_to_memfd (GVariant *data);
+GVariant *msgport_payload_from_fd (gint fd);
+
+guint
+msgport_dbus_add_large_message_filter (GDBusConnection *connection);
 
 #endif /* __MSGPORT_UTILS_H */
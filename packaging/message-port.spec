@@ -1,6 +1,7 @@
 
 %define build_tests 1
 %define use_session_bus 0
+%define use_websocket 0
 %define systemddir /lib/systemd
 
 Name: message-port
@@ -16,9 +17,14 @@ BuildRequires: pkgconfig(aul)
 BuildRequires: pkgconfig(dlog)
 BuildRequires: pkgconfig(gio-2.0)
 BuildRequires: pkgconfig(gio-unix-2.0)
-BuildRequires: pkgconfig(glib-2.0) >= 2.30
+BuildRequires: pkgconfig(glib-2.0) >= 2.36
 BuildRequires: pkgconfig(gobject-2.0)
+BuildRequires: pkgconfig(pkgmgr)
 BuildRequires: pkgconfig(pkgmgr-info)
+%if %{use_websocket} == 1
+BuildRequires: pkgconfig(libwebsockets)
+BuildRequires: pkgconfig(json-glib-1.0)
+%endif
 
 %description
 This daemon allows the webapplications to communicates using 
@@ -32,6 +38,8 @@ Requires(post):   /sbin/ldconfig
 Requires(postun): /sbin/ldconfig
 Requires: %{name} = %{version}-%{release} 
 BuildRequires: pkgconfig(bundle)
+BuildRequires: pkgconfig(liblz4)
+BuildRequires: pkgconfig(libzstd)
 
 %description -n lib%{name}
 Client library that porvies C APIs to work with message port.
@@ -73,6 +81,9 @@ autoreconf -f -i
 %if %{use_session_bus} == 1
     --enable-sessionbus \
 %endif
+%if %{use_websocket} == 1
+    --enable-websocket \
+%endif
 
 make %{?_smp_mflags}
 
@@ -82,6 +93,7 @@ make %{?_smp_mflags}
 
 mkdir -p ${RPM_BUILD_ROOT}%{systemddir}/system
 cp messageportd.service $RPM_BUILD_ROOT%{systemddir}/system
+mkdir -p ${RPM_BUILD_ROOT}%{_localstatedir}/lib/message-port
 
 %post
 /bin/systemctl enable messageportd.service
@@ -105,6 +117,7 @@ cp messageportd.service $RPM_BUILD_ROOT%{systemddir}/system
 %manifest %{name}.manifest
 %endif
 %{systemddir}/system/messageportd.service
+%dir %{_localstatedir}/lib/message-port
 
 # libmessage-port
 %files -n lib%{name}
@@ -128,4 +141,5 @@ cp messageportd.service $RPM_BUILD_ROOT%{systemddir}/system
 %manifest %{name}.manifest
 %{_bindir}/msgport-test-app
 %{_bindir}/msgport-test-app-cpp
+%{_bindir}/bench-messageport
 %endif
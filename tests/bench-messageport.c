@@ -0,0 +1,576 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Throughput and latency benchmark: runs a private message port daemon,
+ * N sender and M receiver processes, and reports the results as JSON
+ * (or key=value text) on stdout, e.g:
+ *
+ *   bench-messageport --senders 4 --receivers 2 --messages 10000 --payload-size 1024
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <message-port.h>
+#include <bundle.h>
+
+#ifndef BENCH_DAEMON_PATH
+#define BENCH_DAEMON_PATH "messageportd"
+#endif
+
+#define BENCH_PORT_PREFIX   "bench_port_"
+#define BENCH_SENDER_PREFIX "bench_sender_"
+
+static gint     __n_senders = 1;
+static gint     __n_receivers = 1;
+static gint     __n_messages = 10000; /* per sender */
+static gint     __payload_size = 0;
+static gint     __n_keys = 1;
+static gboolean __trusted = FALSE;
+static gboolean __bidirectional = FALSE;
+static gboolean __post = FALSE;
+static gint     __idle_timeout = 5; /* seconds */
+static gchar   *__daemon_path = NULL;
+static gchar   *__format = NULL;
+
+static GOptionEntry __options[] = {
+    { "senders", 's', 0, G_OPTION_ARG_INT, &__n_senders, "Number of sender processes", "N" },
+    { "receivers", 'r', 0, G_OPTION_ARG_INT, &__n_receivers, "Number of receiver processes", "M" },
+    { "messages", 'n', 0, G_OPTION_ARG_INT, &__n_messages, "Messages sent by each sender", "K" },
+    { "payload-size", 'p', 0, G_OPTION_ARG_INT, &__payload_size, "Size of binary payload in bytes", "BYTES" },
+    { "keys", 'k', 0, G_OPTION_ARG_INT, &__n_keys, "Number of bundle keys, including the timestamp", "COUNT" },
+    { "trusted", 't', 0, G_OPTION_ARG_NONE, &__trusted, "Use trusted ports", NULL },
+    { "bidirectional", 'b', 0, G_OPTION_ARG_NONE, &__bidirectional, "Send bidirectional messages", NULL },
+    { "post", 0, 0, G_OPTION_ARG_NONE, &__post, "Post messages without waiting for delivery", NULL },
+    { "idle-timeout", 0, 0, G_OPTION_ARG_INT, &__idle_timeout, "Receivers give up after this many idle seconds", "SECONDS" },
+    { "daemon", 'd', 0, G_OPTION_ARG_FILENAME, &__daemon_path, "Path of the message port daemon", "PATH" },
+    { "format", 'f', 0, G_OPTION_ARG_STRING, &__format, "Output format : json (default) or text", "FORMAT" },
+    { NULL }
+};
+
+/*
+ * Sender i sends its k-th message to receiver (i + k) % receivers
+ */
+static gint
+_expected_messages (gint receiver)
+{
+    gint sender, k, count = 0;
+
+    for (sender = 0; sender < __n_senders; sender++)
+        for (k = 0; k < __n_messages; k++)
+            if ((sender + k) % __n_receivers == receiver) count++;
+
+    return count;
+}
+
+static gboolean
+_write_all (int fd, const void *data, gsize size)
+{
+    const gchar *ptr = (const gchar *)data;
+
+    while (size > 0) {
+        ssize_t n = write (fd, ptr, size);
+        if (n <= 0) return FALSE;
+        ptr += n; size -= n;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+_read_all (int fd, void *data, gsize size)
+{
+    gchar *ptr = (gchar *)data;
+
+    while (size > 0) {
+        ssize_t n = read (fd, ptr, size);
+        if (n <= 0) return FALSE;
+        ptr += n; size -= n;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Receiver process
+ */
+typedef struct {
+    GMainLoop *loop;
+    GArray    *latencies; /* gint64, microseconds */
+    gint       expected;
+    gint64     last_received;
+} ReceiverData;
+
+static ReceiverData __receiver;
+
+static void
+_on_bench_message (int id, const char *remote_app_id, const char *remote_port, bool trusted, bundle *message)
+{
+    gint64 now = g_get_monotonic_time ();
+    const char *ts = bundle_get_val (message, "ts");
+
+    if (ts) {
+        gint64 latency = now - g_ascii_strtoll (ts, NULL, 10);
+        g_array_append_val (__receiver.latencies, latency);
+    }
+    __receiver.last_received = now;
+
+    if ((gint)__receiver.latencies->len >= __receiver.expected)
+        g_main_loop_quit (__receiver.loop);
+}
+
+static gboolean
+_on_receiver_idle_check (gpointer userdata)
+{
+    gint64 idle = g_get_monotonic_time () - __receiver.last_received;
+
+    if (idle >= (gint64)__idle_timeout * G_USEC_PER_SEC) {
+        g_printerr ("receiver %d: gave up after %u of %d messages\n",
+                getpid (), __receiver.latencies->len, __receiver.expected);
+        g_main_loop_quit (__receiver.loop);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int
+_run_receiver (gint index, int ready_fd, int result_fd)
+{
+    gchar *port_name = g_strdup_printf (BENCH_PORT_PREFIX"%d", index);
+    guint32 count = 0;
+    int port_id;
+
+    __receiver.loop = g_main_loop_new (NULL, FALSE);
+    __receiver.latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    __receiver.expected = _expected_messages (index);
+
+    port_id = __trusted ? messageport_register_trusted_local_port (port_name, _on_bench_message)
+                        : messageport_register_local_port (port_name, _on_bench_message);
+    g_free (port_name);
+    if (port_id < 0) {
+        g_printerr ("receiver %d: failed to register port : %d\n", index, port_id);
+        return 1;
+    }
+
+    _write_all (ready_fd, "R", 1);
+
+    if (__receiver.expected > 0) {
+        __receiver.last_received = g_get_monotonic_time ();
+        g_timeout_add (100, _on_receiver_idle_check, NULL);
+        g_main_loop_run (__receiver.loop);
+    }
+
+    /* (count, last received, latencies) */
+    count = __receiver.latencies->len;
+    _write_all (result_fd, &count, sizeof (count));
+    _write_all (result_fd, &__receiver.last_received, sizeof (gint64));
+    _write_all (result_fd, __receiver.latencies->data, count * sizeof (gint64));
+
+    g_array_free (__receiver.latencies, TRUE);
+    g_main_loop_unref (__receiver.loop);
+
+    return 0;
+}
+
+/*
+ * Sender process
+ */
+static messageport_error_e
+_send_one (int local_id, const char *app_id, const char *port, bundle *b)
+{
+    if (__post) {
+        if (__bidirectional)
+            return __trusted ? messageport_post_bidirectional_trusted_message (local_id, app_id, port, b)
+                             : messageport_post_bidirectional_message (local_id, app_id, port, b);
+        return __trusted ? messageport_post_trusted_message (app_id, port, b)
+                         : messageport_post_message (app_id, port, b);
+    }
+
+    if (__bidirectional)
+        return __trusted ? messageport_send_bidirectional_trusted_message (local_id, app_id, port, b)
+                         : messageport_send_bidirectional_message (local_id, app_id, port, b);
+    return __trusted ? messageport_send_trusted_message (app_id, port, b)
+                     : messageport_send_message (app_id, port, b);
+}
+
+static void
+_on_bench_reply (int id, const char *remote_app_id, const char *remote_port, bool trusted, bundle *message)
+{
+    /* receivers never reply */
+}
+
+static int
+_run_sender (gint index, const pid_t *receivers, int ready_fd, int start_fd, int result_fd)
+{
+    gchar **app_ids = g_new0 (gchar *, __n_receivers + 1);
+    gchar **ports = g_new0 (gchar *, __n_receivers + 1);
+    guchar *payload = NULL;
+    bundle *b = bundle_create ();
+    guint32 n_sent = 0, n_errors = 0;
+    int local_id = 0;
+    gint i, k;
+    gchar start;
+
+    for (i = 0; i < __n_receivers; i++) {
+        bool exists = FALSE;
+
+        app_ids[i] = g_strdup_printf ("%d", receivers[i]);
+        ports[i] = g_strdup_printf (BENCH_PORT_PREFIX"%d", i);
+
+        /* also warms up the connection and the remote port cache */
+        if (__trusted) messageport_check_trusted_remote_port (app_ids[i], ports[i], &exists);
+        else messageport_check_remote_port (app_ids[i], ports[i], &exists);
+        if (!exists) g_printerr ("sender %d: remote port %s:%s not found\n", index, app_ids[i], ports[i]);
+    }
+
+    if (__bidirectional) {
+        gchar *name = g_strdup_printf (BENCH_SENDER_PREFIX"%d", index);
+        local_id = __trusted ? messageport_register_trusted_local_port (name, _on_bench_reply)
+                             : messageport_register_local_port (name, _on_bench_reply);
+        g_free (name);
+    }
+
+    for (i = 1; i < __n_keys; i++) {
+        gchar *key = g_strdup_printf ("key%d", i);
+        gchar *value = g_strdup_printf ("value%d", i);
+        bundle_add (b, key, value);
+        g_free (key);
+        g_free (value);
+    }
+    if (__payload_size > 0) {
+        payload = g_malloc (__payload_size);
+        memset (payload, 0xa5, __payload_size);
+        bundle_add_byte (b, "payload", payload, __payload_size);
+    }
+
+    _write_all (ready_fd, "S", 1);
+    _read_all (start_fd, &start, 1);
+
+    for (k = 0; k < __n_messages; k++) {
+        gint receiver = (index + k) % __n_receivers;
+        gchar ts[32];
+
+        g_snprintf (ts, sizeof (ts), "%" G_GINT64_FORMAT, g_get_monotonic_time ());
+        bundle_del (b, "ts");
+        bundle_add (b, "ts", ts);
+
+        if (_send_one (local_id, app_ids[receiver], ports[receiver], b) == MESSAGEPORT_ERROR_NONE) n_sent++;
+        else n_errors++;
+    }
+
+    /* posted messages are written in order, a round trip makes sure they left */
+    if (__post) {
+        bool exists = FALSE;
+        messageport_check_remote_port (app_ids[0], ports[0], &exists);
+    }
+
+    _write_all (result_fd, &n_sent, sizeof (n_sent));
+    _write_all (result_fd, &n_errors, sizeof (n_errors));
+
+    bundle_free (b);
+    g_free (payload);
+    g_strfreev (app_ids);
+    g_strfreev (ports);
+
+    return 0;
+}
+
+/*
+ * Controller
+ */
+static gdouble
+_get_process_cpu_time (pid_t pid)
+{
+    gchar *path = g_strdup_printf ("/proc/%d/stat", pid);
+    gchar *contents = NULL;
+    gchar **fields = NULL;
+    gchar *fields_start = NULL;
+    gdouble res = 0;
+
+    /* utime and stime are 14th and 15th fields, counted after the command name */
+    if (g_file_get_contents (path, &contents, NULL, NULL) &&
+        (fields_start = strrchr (contents, ')')) != NULL) {
+        fields = g_strsplit (fields_start + 2, " ", 0);
+        if (g_strv_length (fields) > 12)
+            res = (gdouble)(g_ascii_strtoull (fields[11], NULL, 10) + g_ascii_strtoull (fields[12], NULL, 10))
+                  / sysconf (_SC_CLK_TCK);
+        g_strfreev (fields);
+    }
+    g_free (contents);
+    g_free (path);
+
+    return res;
+}
+
+static gint
+_compare_latency (gconstpointer a, gconstpointer b)
+{
+    gint64 la = *(const gint64 *)a, lb = *(const gint64 *)b;
+
+    return la < lb ? -1 : (la > lb ? 1 : 0);
+}
+
+static gint64
+_percentile (GArray *sorted, gdouble p)
+{
+    guint index;
+
+    if (!sorted->len) return 0;
+
+    index = (guint)(p * (sorted->len - 1) + 0.5);
+
+    return g_array_index (sorted, gint64, index);
+}
+
+static pid_t
+_start_daemon (const gchar *socket_path)
+{
+    gchar *argv[] = { __daemon_path, NULL };
+    GError *error = NULL;
+    GPid pid = 0;
+    gint i;
+
+    /* prefer the daemon from the build tree, otherwise the installed one */
+    if (!argv[0])
+        argv[0] = g_file_test (BENCH_DAEMON_PATH, G_FILE_TEST_IS_EXECUTABLE)
+                  ? (gchar *)BENCH_DAEMON_PATH : (gchar *)"messageportd";
+
+    /* reaped at cleanup, so that it is gone before its socket is removed */
+    if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                NULL, NULL, &pid, &error)) {
+        g_printerr ("Failed to start daemon '%s' : %s\n", argv[0], error->message);
+        g_error_free (error);
+        return 0;
+    }
+
+    /* wait for the server socket, at most 5 seconds */
+    for (i = 0; i < 500 && !g_file_test (socket_path, G_FILE_TEST_EXISTS); i++)
+        g_usleep (10000);
+
+    if (!g_file_test (socket_path, G_FILE_TEST_EXISTS)) {
+        g_printerr ("Daemon did not create '%s'\n", socket_path);
+        kill (pid, SIGTERM);
+        waitpid (pid, NULL, 0);
+        return 0;
+    }
+
+    return pid;
+}
+
+static void
+_print_results (gint64 n_sent, gint64 n_errors, GArray *latencies, gdouble duration, gdouble daemon_cpu)
+{
+    gdouble rate = duration > 0 ? latencies->len / duration : 0;
+    gint64 p50 = _percentile (latencies, 0.50);
+    gint64 p99 = _percentile (latencies, 0.99);
+    gint64 p999 = _percentile (latencies, 0.999);
+    gint64 max = latencies->len ? g_array_index (latencies, gint64, latencies->len - 1) : 0;
+    gdouble cpu_percent = duration > 0 ? 100.0 * daemon_cpu / duration : 0;
+
+    if (g_strcmp0 (__format, "text") == 0) {
+        g_print ("senders=%d\nreceivers=%d\nmessages=%d\npayload_size=%d\nkeys=%d\n"
+                 "trusted=%d\nbidirectional=%d\npost=%d\n"
+                 "sent=%" G_GINT64_FORMAT "\nsend_errors=%" G_GINT64_FORMAT "\nreceived=%u\n"
+                 "duration_s=%.6f\nmsgs_per_sec=%.1f\n"
+                 "latency_p50_us=%" G_GINT64_FORMAT "\nlatency_p99_us=%" G_GINT64_FORMAT "\n"
+                 "latency_p999_us=%" G_GINT64_FORMAT "\nlatency_max_us=%" G_GINT64_FORMAT "\n"
+                 "daemon_cpu_s=%.3f\ndaemon_cpu_percent=%.1f\n",
+                 __n_senders, __n_receivers, __n_messages, __payload_size, __n_keys,
+                 __trusted, __bidirectional, __post,
+                 n_sent, n_errors, latencies->len, duration, rate,
+                 p50, p99, p999, max, daemon_cpu, cpu_percent);
+        return;
+    }
+
+    g_print ("{\"senders\": %d, \"receivers\": %d, \"messages\": %d, \"payload_size\": %d, \"keys\": %d, "
+             "\"trusted\": %s, \"bidirectional\": %s, \"post\": %s, "
+             "\"sent\": %" G_GINT64_FORMAT ", \"send_errors\": %" G_GINT64_FORMAT ", \"received\": %u, "
+             "\"duration_s\": %.6f, \"msgs_per_sec\": %.1f, "
+             "\"latency_us\": {\"p50\": %" G_GINT64_FORMAT ", \"p99\": %" G_GINT64_FORMAT ", "
+             "\"p999\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT "}, "
+             "\"daemon_cpu_s\": %.3f, \"daemon_cpu_percent\": %.1f}\n",
+             __n_senders, __n_receivers, __n_messages, __payload_size, __n_keys,
+             __trusted ? "true" : "false", __bidirectional ? "true" : "false", __post ? "true" : "false",
+             n_sent, n_errors, latencies->len, duration, rate,
+             p50, p99, p999, max, daemon_cpu, cpu_percent);
+}
+
+int main (int argc, char *argv[])
+{
+    GOptionContext *context = NULL;
+    GError *error = NULL;
+    gchar *tmp_dir = NULL;
+    gchar *socket_path = NULL;
+    gchar *address = NULL;
+    pid_t daemon_pid = 0;
+    pid_t *receivers = NULL;
+    pid_t *senders = NULL;
+    int *receiver_results = NULL;
+    int *sender_results = NULL;
+    int ready_pipe[2], start_pipe[2];
+    GArray *latencies = NULL;
+    gint64 n_sent = 0, n_errors = 0, started = 0, finished = 0;
+    gdouble daemon_cpu = 0;
+    gint i, res = 0;
+    gchar c;
+
+    context = g_option_context_new ("- message port throughput and latency benchmark");
+    g_option_context_add_main_entries (context, __options, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (__n_senders < 1 || __n_receivers < 1 || __n_messages < 0 || __payload_size < 0 || __n_keys < 1) {
+        g_printerr ("Invalid arguments\n");
+        return 1;
+    }
+
+#ifdef USE_SESSION_BUS
+    g_printerr ("Benchmark needs the daemon on its private bus, rebuild without session bus support\n");
+    return 1;
+#endif
+
+    /* private daemon, inherited by all the children */
+    tmp_dir = g_dir_make_tmp ("msgport-bench-XXXXXX", &error);
+    if (!tmp_dir) {
+        g_printerr ("Failed to create temporary directory : %s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    socket_path = g_build_filename (tmp_dir, "bus", NULL);
+    address = g_strdup_printf ("unix:path=%s", socket_path);
+    g_setenv ("MESSAGEPORT_BUS_ADDRESS", address, TRUE);
+
+    if (!(daemon_pid = _start_daemon (socket_path))) {
+        res = 1;
+        goto cleanup;
+    }
+
+    if (pipe (ready_pipe) || pipe (start_pipe)) {
+        g_printerr ("Failed to open pipes\n");
+        res = 1;
+        goto cleanup;
+    }
+
+    receivers = g_new0 (pid_t, __n_receivers);
+    receiver_results = g_new0 (int, __n_receivers);
+    for (i = 0; i < __n_receivers; i++) {
+        int result_pipe[2];
+
+        if (pipe (result_pipe)) g_error ("Failed to open pipe");
+        if ((receivers[i] = fork ()) == 0) {
+            close (result_pipe[0]);
+            exit (_run_receiver (i, ready_pipe[1], result_pipe[1]));
+        }
+        close (result_pipe[1]);
+        receiver_results[i] = result_pipe[0];
+    }
+    for (i = 0; i < __n_receivers; i++) _read_all (ready_pipe[0], &c, 1);
+
+    senders = g_new0 (pid_t, __n_senders);
+    sender_results = g_new0 (int, __n_senders);
+    for (i = 0; i < __n_senders; i++) {
+        int result_pipe[2];
+
+        if (pipe (result_pipe)) g_error ("Failed to open pipe");
+        if ((senders[i] = fork ()) == 0) {
+            close (result_pipe[0]);
+            exit (_run_sender (i, receivers, ready_pipe[1], start_pipe[0], result_pipe[1]));
+        }
+        close (result_pipe[1]);
+        sender_results[i] = result_pipe[0];
+    }
+    for (i = 0; i < __n_senders; i++) _read_all (ready_pipe[0], &c, 1);
+
+    /* go */
+    daemon_cpu = _get_process_cpu_time (daemon_pid);
+    started = g_get_monotonic_time ();
+    for (i = 0; i < __n_senders; i++) _write_all (start_pipe[1], "G", 1);
+
+    for (i = 0; i < __n_senders; i++) {
+        guint32 sent = 0, errors = 0;
+
+        _read_all (sender_results[i], &sent, sizeof (sent));
+        _read_all (sender_results[i], &errors, sizeof (errors));
+        n_sent += sent;
+        n_errors += errors;
+        close (sender_results[i]);
+    }
+
+    latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+    for (i = 0; i < __n_receivers; i++) {
+        guint32 count = 0;
+        gint64 last_received = 0;
+
+        if (_read_all (receiver_results[i], &count, sizeof (count)) &&
+            _read_all (receiver_results[i], &last_received, sizeof (last_received))) {
+            g_array_set_size (latencies, latencies->len + count);
+            _read_all (receiver_results[i], &g_array_index (latencies, gint64, latencies->len - count),
+                    count * sizeof (gint64));
+            if (count && last_received > finished) finished = last_received;
+        }
+        close (receiver_results[i]);
+    }
+    daemon_cpu = _get_process_cpu_time (daemon_pid) - daemon_cpu;
+
+    for (i = 0; i < __n_senders; i++) waitpid (senders[i], NULL, 0);
+    for (i = 0; i < __n_receivers; i++) waitpid (receivers[i], NULL, 0);
+
+    g_array_sort (latencies, _compare_latency);
+    _print_results (n_sent, n_errors, latencies,
+            finished > started ? (gdouble)(finished - started) / G_USEC_PER_SEC : 0, daemon_cpu);
+
+    if ((gint64)latencies->len != n_sent) res = 2;
+    g_array_free (latencies, TRUE);
+
+cleanup:
+    if (daemon_pid) {
+        kill (daemon_pid, SIGTERM);
+        waitpid (daemon_pid, NULL, 0);
+    }
+    g_unlink (socket_path);
+    g_rmdir (tmp_dir);
+    g_free (receivers);
+    g_free (receiver_results);
+    g_free (senders);
+    g_free (sender_results);
+    g_free (address);
+    g_free (socket_path);
+    g_free (tmp_dir);
+
+    return res;
+}
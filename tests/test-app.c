@@ -27,6 +27,7 @@
 #include <glib.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/wait.h>
 #include <string.h>
 #include <message-port.h>
 #include <bundle.h>
@@ -37,6 +38,8 @@ pid_t __daemon_pid; /* dbus daemon pid */
 
 const gchar *PARENT_TEST_PORT = "parent_test_port";
 const gchar *PARENT_TEST_TRUSTED_PORT = "parent_test_trusted_port";
+const gchar *PARENT_TEST_PRIORITY_PORT = "parent_test_priority_port";
+const gchar *PARENT_TEST_VIEW_PORT = "parent_test_view_port";
 const gchar *CHILD_TEST_PORT = "child_test_port";
 const gchar *CHILD_TEST_TRUSTED_PORT = "child_test_trusted_port";
 
@@ -65,12 +68,87 @@ do { \
 } while(0);
 
 
+static const guchar __test_binary[] = { 0x00, 0xff, 0x10, 0x00, 0x7f, 0x80 };
+static const gchar *__test_str_array[] = { "one", "two", "three" };
+
 static void _dump_data (const char *key, const int type, const bundle_keyval_t *kv, void *user_data)
 {
     gchar *val = NULL;
     size_t size;
+
+    if (type == BUNDLE_TYPE_STR_ARRAY) {
+        void **array = NULL;
+        unsigned int len = 0;
+        size_t *sizes = NULL;
+        bundle_keyval_get_array_val ((bundle_keyval_t*)kv, &array, &len, &sizes);
+        g_debug ("       %s - [%u strings]", key, len);
+        return;
+    }
+
     bundle_keyval_get_basic_val ((bundle_keyval_t*)kv, (void**)&val, &size);
-    g_debug ("       %s - %s", key, val);
+    if (type == BUNDLE_TYPE_BYTE) g_debug ("       %s - [%zu bytes]", key, size);
+    else g_debug ("       %s - %s", key, val);
+}
+
+/* big enough to be passed as shared memory */
+#define TEST_LARGE_MESSAGE_SIZE (256 * 1024)
+
+/* compressible text, sent by test_send_compressible_message */
+#define TEST_TEXT_MESSAGE_SIZE (32 * 1024)
+
+static gchar *_test_text_new ()
+{
+    GString *text = g_string_sized_new (TEST_TEXT_MESSAGE_SIZE);
+    guint i;
+
+    for (i = 0; text->len < TEST_TEXT_MESSAGE_SIZE; i++)
+        g_string_append_printf (text, "{\"id\": %u, \"name\": \"item\"},", i);
+
+    return g_string_free (text, FALSE);
+}
+
+/* verifies the binary payload sent by test_send_binary_message
+ * or test_send_large_message, if any */
+static gboolean _check_binary_data (bundle *data)
+{
+    void *bytes = NULL;
+    size_t size = 0;
+    const char **strv = NULL;
+    int len = 0, i;
+
+    if (bundle_get_type (data, "Text") >= 0) {
+        gchar *text = _test_text_new ();
+        gboolean ok = g_strcmp0 (bundle_get_val (data, "Text"), text) == 0;
+        g_free (text);
+        return ok;
+    }
+
+    if (bundle_get_type (data, "Large") >= 0) {
+        if (bundle_get_byte (data, "Large", &bytes, &size) != 0 || size != TEST_LARGE_MESSAGE_SIZE)
+            return FALSE;
+        for (i = 0; i < (int)size; i++)
+            if (((guchar *)bytes)[i] != (guchar)(i & 0xff)) return FALSE;
+        return TRUE;
+    }
+
+    if (bundle_get_type (data, "Binary") < 0) return TRUE;
+
+    if (bundle_get_byte (data, "Binary", &bytes, &size) != 0 ||
+        size != sizeof (__test_binary) || memcmp (bytes, __test_binary, size) != 0)
+        return FALSE;
+
+    strv = bundle_get_str_array (data, "Names", &len);
+    if (!strv || len != G_N_ELEMENTS (__test_str_array)) return FALSE;
+    for (i = 0; i < len; i++)
+        if (g_strcmp0 (strv[i], __test_str_array[i]) != 0) return FALSE;
+
+    /* elements never set arrive as empty strings */
+    strv = bundle_get_str_array (data, "Unset", &len);
+    if (!strv || len != 2) return FALSE;
+    for (i = 0; i < len; i++)
+        if (g_strcmp0 (strv[i], "") != 0) return FALSE;
+
+    return TRUE;
 }
 
 void (_on_child_got_message)(int port_id, const char* remote_app_id, const char* remote_port, gboolean trusted_message, bundle* data)
@@ -110,6 +188,12 @@ void (_on_parent_got_message)(int port_id, const char* remote_app_id, const char
     bundle_foreach (data, _dump_data, NULL);
 
     /* Write acknoledgement */
+    if (!_check_binary_data (data)) {
+        if (write (__pipe[1], "KO", strlen("KO") + 1) < 3) {
+            g_warning ("WRITE failed");
+        }
+        return;
+    }
     if ( write (__pipe[1], "OK", strlen("OK") + 1) < 3) {
         g_warning ("WRITE failed");
     }
@@ -144,6 +228,34 @@ void (_on_parent_got_message)(int port_id, const char* remote_app_id, const char
     else g_debug ("PARENT: Data sent successfully");
 }
 
+static void _count_view_value (const char *key, int type, void *user_data)
+{
+    (*(int *)user_data)++;
+}
+
+void (_on_parent_got_message_view)(int port_id, const char* remote_app_id, const char* remote_port, gboolean trusted_message, const messageport_message_view* view)
+{
+    const void *bytes = NULL;
+    size_t size = 0;
+    int count = 0;
+    gboolean ok;
+
+    g_assert (view);
+
+    messageport_message_view_foreach (view, _count_view_value, &count);
+    bytes = messageport_message_view_get_byte (view, "Binary", &size);
+
+    ok = count == 2 && count == messageport_message_view_get_count (view) &&
+         g_strcmp0 (messageport_message_view_get_str (view, "Name"), "Amarnath") == 0 &&
+         messageport_message_view_get_type (view, "Binary") == BUNDLE_TYPE_BYTE &&
+         bytes && size == sizeof (__test_binary) && memcmp (bytes, __test_binary, size) == 0 &&
+         messageport_message_view_get_str (view, "Missing") == NULL;
+
+    if (write (__pipe[1], ok ? "OK" : "KO", strlen("OK") + 1) < 3) {
+        g_warning ("WRITE failed");
+    }
+}
+
 int _register_test_port (const gchar *port_name, gboolean is_trusted, messageport_message_cb cb)
 {
     int port_id = is_trusted ? messageport_register_trusted_local_port (port_name, cb)
@@ -172,6 +284,33 @@ test_register_trusted_local_port()
     return TRUE;
 }
 
+static gboolean
+test_register_local_port_with_priority ()
+{
+    int port_id = messageport_register_local_port_with_priority (PARENT_TEST_PRIORITY_PORT,
+                        _on_parent_got_message, MESSAGEPORT_PRIORITY_HIGH);
+
+    test_assert (port_id >= 0, "Failed to register port '%s', error : %d", PARENT_TEST_PRIORITY_PORT, port_id);
+
+    port_id = messageport_register_local_port_with_priority (PARENT_TEST_PRIORITY_PORT,
+                        _on_parent_got_message, (messageport_priority_e)42);
+
+    test_assert (port_id == MESSAGEPORT_ERROR_INVALID_PARAMETER,
+        "Expected error : %d, but got : %d", MESSAGEPORT_ERROR_INVALID_PARAMETER, port_id);
+
+    return TRUE;
+}
+
+static gboolean
+test_register_local_port_with_view_cb ()
+{
+    int port_id = messageport_register_local_port_with_view_cb (PARENT_TEST_VIEW_PORT, _on_parent_got_message_view);
+
+    test_assert (port_id >= 0, "Failed to register port '%s', error : %d", PARENT_TEST_VIEW_PORT, port_id);
+
+    return TRUE;
+}
+
 static gboolean
 test_check_remote_port()
 {
@@ -225,6 +364,245 @@ test_send_message()
     return TRUE;
 }
 
+static gboolean
+test_send_binary_message()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    bundle *b = bundle_create ();
+    bundle_add (b, "Name", "Amarnath");
+    bundle_add_byte (b, "Binary", __test_binary, sizeof (__test_binary));
+    bundle_add_str_array (b, "Names", __test_str_array, G_N_ELEMENTS (__test_str_array));
+    bundle_add_str_array (b, "Unset", NULL, 2);
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_message (remote_app_id, PARENT_TEST_PORT, b);
+    bundle_free (b);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send message to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    gchar result[32];
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent received corrupted binary data");
+
+    return TRUE;
+}
+
+static gboolean
+test_send_message_to_view_port()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    bundle *b = bundle_create ();
+    bundle_add (b, "Name", "Amarnath");
+    bundle_add_byte (b, "Binary", __test_binary, sizeof (__test_binary));
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_message (remote_app_id, PARENT_TEST_VIEW_PORT, b);
+    bundle_free (b);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send message to port '%s' at app_id : '%s', error : %d", PARENT_TEST_VIEW_PORT, remote_app_id, res);
+
+    gchar result[32];
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent could not read the message view");
+
+    return TRUE;
+}
+
+static gboolean
+test_send_prepared_message()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    messageport_message_t *message = NULL;
+    gchar result[32];
+    bundle *b = bundle_create ();
+    bundle_add (b, "Name", "Amarnath");
+    bundle_add (b, "Email", "amarnath.valluri@intel.com");
+
+    message = messageport_message_create (b);
+    bundle_free (b);
+    test_assert (message != NULL, "Fail to prepare message");
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_prepared_message (remote_app_id, PARENT_TEST_PORT, message);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send prepared message to port '%s', error : %d", PARENT_TEST_PORT, res);
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent did not received the message");
+
+    /* change a value in place, and send it again */
+    res = messageport_message_set_str (message, "Name", "Valluri");
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to update prepared message : %d", res);
+
+    res = messageport_send_prepared_message (remote_app_id, PARENT_TEST_PORT, message);
+    messageport_message_destroy (message);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send prepared message to port '%s', error : %d", PARENT_TEST_PORT, res);
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent did not received the updated message");
+
+    return TRUE;
+}
+
+static gboolean
+test_send_compressible_message()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    gchar *text = _test_text_new ();
+    bundle *b = bundle_create ();
+    bundle_add (b, "Text", text);
+    g_free (text);
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_message (remote_app_id, PARENT_TEST_PORT, b);
+    bundle_free (b);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send message to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    gchar result[32];
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent received corrupted text");
+
+    return TRUE;
+}
+
+static gboolean
+test_send_large_message()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    guchar *payload = g_malloc (TEST_LARGE_MESSAGE_SIZE);
+    bundle *b = bundle_create ();
+    guint i;
+
+    for (i = 0; i < TEST_LARGE_MESSAGE_SIZE; i++) payload[i] = (guchar)(i & 0xff);
+    bundle_add_byte (b, "Large", payload, TEST_LARGE_MESSAGE_SIZE);
+    g_free (payload);
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_message (remote_app_id, PARENT_TEST_PORT, b);
+    bundle_free (b);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send large message to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    gchar result[32];
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent received corrupted large message");
+
+    return TRUE;
+}
+
+static gpointer
+_send_message_thread (gpointer userdata)
+{
+    const gchar *remote_app_id = (const gchar *)userdata;
+    bundle *b = bundle_create ();
+    messageport_error_e res;
+
+    bundle_add (b, "Name", "Amarnath");
+    bundle_add (b, "Thread", "worker");
+    res = messageport_send_message (remote_app_id, PARENT_TEST_PORT, b);
+    bundle_free (b);
+
+    return GINT_TO_POINTER (res);
+}
+
+static gboolean
+test_send_message_from_thread()
+{
+    messageport_error_e res;
+    gchar remote_app_id[128];
+    gchar result[32];
+    GThread *thread = NULL;
+
+    g_sprintf (remote_app_id, "%d", getppid());
+
+    /* worker thread shares the process wide connection */
+    thread = g_thread_new ("msgport-test", _send_message_thread, remote_app_id);
+    res = GPOINTER_TO_INT (g_thread_join (thread));
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send message from thread to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent did not received the message");
+
+    return TRUE;
+}
+
+struct FirstCallData
+{
+    const gchar        *remote_app_id;
+    GMainLoop          *m_loop;
+    gint                done;
+    messageport_error_e result;
+};
+
+static gpointer
+_first_call_thread (gpointer userdata)
+{
+    struct FirstCallData *data = (struct FirstCallData *)userdata;
+
+    data->result = GPOINTER_TO_INT (_send_message_thread ((gpointer)data->remote_app_id));
+    g_atomic_int_set (&data->done, TRUE);
+
+    return NULL;
+}
+
+static gboolean
+_quit_on_first_call_done (gpointer userdata)
+{
+    struct FirstCallData *data = (struct FirstCallData *)userdata;
+
+    if (!g_atomic_int_get (&data->done)) return TRUE;
+
+    g_main_loop_quit (data->m_loop);
+
+    return FALSE;
+}
+
+/*
+ * First API call made from a thread while the application main loop runs,
+ * on a forked process so that the connection is not shared with the others.
+ */
+static gboolean
+test_first_call_from_thread()
+{
+    gchar remote_app_id[128];
+    gchar result[32];
+    pid_t pid;
+    int status = 0;
+
+    g_sprintf (remote_app_id, "%d", getppid());
+
+    pid = fork ();
+    test_assert (pid >= 0, "Failed to fork");
+
+    if (pid == 0) {
+        struct FirstCallData data = { remote_app_id, g_main_loop_new (NULL, FALSE), FALSE, MESSAGEPORT_ERROR_NONE };
+        GThread *thread = NULL;
+
+        /* setting up the connection must not fight the running main loop */
+        g_log_set_always_fatal (G_LOG_LEVEL_CRITICAL);
+
+        thread = g_thread_new ("msgport-test", _first_call_thread, &data);
+        g_timeout_add (100, _quit_on_first_call_done, &data);
+        g_main_loop_run (data.m_loop);
+        g_thread_join (thread);
+        g_main_loop_unref (data.m_loop);
+
+        _exit (data.result == MESSAGEPORT_ERROR_NONE ? 0 : 1);
+    }
+
+    test_assert (waitpid (pid, &status, 0) == pid, "Failed to wait for the test process");
+    test_assert (WIFEXITED (status) && WEXITSTATUS (status) == 0,
+        "First call from thread failed, status : %d", status);
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent did not received the message");
+
+    return TRUE;
+}
+
 static gboolean
 test_send_trusted_message()
 {
@@ -247,6 +625,15 @@ test_send_trusted_message()
     return TRUE;
 }
 
+static void
+_on_async_message_sent (messageport_error_e result, void *userdata)
+{
+    if (__test_data) {
+        __test_data->result = (result == MESSAGEPORT_ERROR_NONE);
+        g_main_loop_quit (__test_data->m_loop);
+    }
+}
+
 static gboolean
 _update_test_result (gpointer data)
 {
@@ -346,6 +733,95 @@ test_send_bidirectional_trusted_message()
     return TRUE;
 }
 
+static gboolean
+test_send_message_async()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    gchar result[32];
+    gboolean message_sent = FALSE;
+    bundle *b = bundle_create ();
+    bundle_add (b, "Name", "Amarnath");
+    bundle_add (b, "Email", "amarnath.valluri@intel.com");
+
+    __test_data = g_new0 (struct AsyncTestData, 1);
+    __test_data->m_loop = g_main_loop_new (NULL, FALSE);
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_message_async (remote_app_id, PARENT_TEST_PORT, b, _on_async_message_sent, NULL);
+    bundle_free (b);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to start sending message to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    g_timeout_add_seconds (5, _update_test_result, NULL);
+    g_main_loop_run (__test_data->m_loop);
+    message_sent = __test_data->result;
+
+    g_main_loop_unref (__test_data->m_loop);
+    g_free (__test_data);
+    __test_data = NULL;
+
+    test_assert (message_sent == TRUE, "Async send did not complete successfully");
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent did not received the message");
+
+    return TRUE;
+}
+
+static gboolean
+test_post_message()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    gchar result[32];
+    bundle *b = bundle_create ();
+    bundle_add (b, "Name", "Amarnath");
+    bundle_add (b, "Email", "amarnath.valluri@intel.com");
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_post_message (remote_app_id, PARENT_TEST_PORT, b);
+    bundle_free (b);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to post message to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    test_assert ((read (__pipe[0], &result, sizeof(result)) > 0), "Parent did not received the message");
+    test_assert ((g_strcmp0 (result, "OK") == 0), "Parent did not received the message");
+
+    return TRUE;
+}
+
+static gboolean
+test_send_messages()
+{
+    messageport_error_e res;
+    const gchar remote_app_id[128];
+    gchar result[32];
+    bundle *messages[3];
+    guint i;
+    gssize acks_len = 0;
+
+    for (i = 0; i < G_N_ELEMENTS (messages); i++) {
+        gchar *seq = g_strdup_printf ("%u", i);
+        messages[i] = bundle_create ();
+        bundle_add (messages[i], "Name", "Amarnath");
+        bundle_add (messages[i], "Sequence", seq);
+        g_free (seq);
+    }
+
+    g_sprintf (remote_app_id, "%d", getppid());
+    res = messageport_send_messages (remote_app_id, PARENT_TEST_PORT, messages, G_N_ELEMENTS (messages));
+    for (i = 0; i < G_N_ELEMENTS (messages); i++) bundle_free (messages[i]);
+    test_assert (res == MESSAGEPORT_ERROR_NONE, "Fail to send messages to port '%s' at app_id : '%s', error : %d", PARENT_TEST_PORT, remote_app_id, res);
+
+    /* parent acknowledges every message with "OK" */
+    while (acks_len < (gssize)(G_N_ELEMENTS (messages) * sizeof ("OK"))) {
+        gssize len = read (__pipe[0], result, G_N_ELEMENTS (messages) * sizeof ("OK") - acks_len);
+        test_assert (len > 0, "Parent did not received all the messages");
+        acks_len += len;
+    }
+
+    return TRUE;
+}
+
 static gboolean
 test_get_local_port_name()
 {
@@ -485,6 +961,8 @@ int main (int argc, char *argv[])
         /* server ports */
         TEST_CASE(test_register_local_port);
         TEST_CASE(test_register_trusted_local_port);
+        TEST_CASE(test_register_local_port_with_priority);
+        TEST_CASE(test_register_local_port_with_view_cb);
         TEST_CASE(test_get_local_port_name);
         TEST_CASE(test_check_trusted_local_port);
 
@@ -498,9 +976,20 @@ int main (int argc, char *argv[])
         /* sleep sometime till server ports are ready */
         sleep (3);
 
+        /* must run before any other call sets up the connection */
+        TEST_CASE(test_first_call_from_thread);
         TEST_CASE(test_check_remote_port);
         TEST_CASE(test_check_trusted_remote_port);
         TEST_CASE(test_send_message);
+        TEST_CASE(test_send_binary_message);
+        TEST_CASE(test_send_message_to_view_port);
+        TEST_CASE(test_send_prepared_message);
+        TEST_CASE(test_send_large_message);
+        TEST_CASE(test_send_compressible_message);
+        TEST_CASE(test_send_message_from_thread);
+        TEST_CASE(test_send_message_async);
+        TEST_CASE(test_post_message);
+        TEST_CASE(test_send_messages);
         TEST_CASE(test_send_bidirectional_message);
         TEST_CASE(test_send_trusted_message);
         TEST_CASE(test_send_bidirectional_trusted_message);
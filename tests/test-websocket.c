@@ -0,0 +1,458 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * This file is part of message-port.
+ *
+ * Copyright (C) 2013 Intel Corporation.
+ *
+ * Contact: Amarnath Valluri <amarnath.valluri@linux.intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/*
+ * Runs the JSON protocol of the web clients against a private daemon:
+ * a web client registers a port, resolves it, sends a message to it and
+ * gets it back as an event. Clients from other origins are refused.
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <json-glib/json-glib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_ALLOWED_ORIGIN "http://allowed.test"
+#define TEST_REFUSED_ORIGIN "http://refused.test"
+#define TEST_WEB_PORT       "web_test_port"
+
+#define TEST_CASE(case) \
+do { \
+    if (case() != TRUE) { \
+        g_printerr ("%s: FAIL\n", #case); \
+        res = -1; \
+        goto cleanup; \
+    } \
+    else g_print ("%s: SUCCESS\n", #case); \
+}while (0)
+
+#define test_assert(expr, msg...) \
+do { \
+    if ((expr) == FALSE) {\
+        g_print ("%s +%d: assert(%s):%s\n", __FUNCTION__, __LINE__, #expr, ##msg); \
+        return FALSE; \
+    } \
+} while(0);
+
+static guint __port = 0;
+
+/*
+ * Minimal WebSocket client, text frames only
+ */
+typedef struct {
+    GSocketConnection *connection;
+    GQueue             received; /* JsonNode*, not consumed yet */
+} WebClient;
+
+static void
+_web_client_free (WebClient *client)
+{
+    if (!client) return;
+
+    g_queue_foreach (&client->received, (GFunc)json_node_free, NULL);
+    g_queue_clear (&client->received);
+    if (client->connection) g_object_unref (client->connection);
+    g_slice_free (WebClient, client);
+}
+
+/*
+ * Opens the "message-port" protocol connection, NULL if the daemon
+ * refuses the handshake
+ */
+static WebClient *
+_web_client_connect (const gchar *origin)
+{
+    GSocketClient *socket_client = g_socket_client_new ();
+    GSocketConnection *connection = NULL;
+    GInputStream *in = NULL;
+    GString *response = g_string_new (NULL);
+    WebClient *client = NULL;
+    gchar *request = NULL;
+    gchar c;
+
+    g_socket_client_set_timeout (socket_client, 5);
+    connection = g_socket_client_connect_to_host (socket_client, "127.0.0.1", __port, NULL, NULL);
+    g_object_unref (socket_client);
+    if (!connection) goto out;
+
+    request = g_strdup_printf ("GET / HTTP/1.1\r\n"
+            "Host: 127.0.0.1:%u\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Version: 13\r\n"
+            "Sec-WebSocket-Protocol: message-port\r\n"
+            "Origin: %s\r\n\r\n", __port, origin);
+    if (!g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (connection)),
+                request, strlen (request), NULL, NULL, NULL))
+        goto out;
+
+    in = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+    while (!g_str_has_suffix (response->str, "\r\n\r\n")) {
+        gsize n = 0;
+        if (!g_input_stream_read_all (in, &c, 1, &n, NULL, NULL) || n != 1) goto out;
+        g_string_append_c (response, c);
+    }
+
+    if (!g_str_has_prefix (response->str, "HTTP/1.1 101")) goto out;
+
+    client = g_slice_new0 (WebClient);
+    client->connection = connection;
+    connection = NULL;
+    g_queue_init (&client->received);
+
+out:
+    if (connection) g_object_unref (connection);
+    g_string_free (response, TRUE);
+    g_free (request);
+
+    return client;
+}
+
+static gboolean
+_web_client_send (WebClient *client, const gchar *text)
+{
+    gsize len = strlen (text), i;
+    GByteArray *frame = g_byte_array_new ();
+    guint8 header[14];
+    gsize header_len = 2;
+    const guint8 mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    gboolean res;
+
+    /* client frames are always masked */
+    header[0] = 0x81; /* FIN, text */
+    if (len < 126) {
+        header[1] = 0x80 | len;
+    }
+    else {
+        header[1] = 0x80 | 126;
+        header[2] = (len >> 8) & 0xff;
+        header[3] = len & 0xff;
+        header_len = 4;
+    }
+    memcpy (header + header_len, mask, sizeof (mask));
+    header_len += sizeof (mask);
+
+    g_byte_array_append (frame, header, header_len);
+    for (i = 0; i < len; i++) {
+        guint8 b = text[i] ^ mask[i % 4];
+        g_byte_array_append (frame, &b, 1);
+    }
+
+    res = g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (client->connection)),
+            frame->data, frame->len, NULL, NULL, NULL);
+    g_byte_array_unref (frame);
+
+    return res;
+}
+
+static JsonNode *
+_web_client_receive (WebClient *client)
+{
+    GInputStream *in = g_io_stream_get_input_stream (G_IO_STREAM (client->connection));
+    JsonParser *parser = NULL;
+    JsonNode *root = NULL;
+    guint8 header[8], opcode;
+    guint64 len;
+    gchar *payload = NULL;
+    gsize n = 0, i;
+
+    for (;;) {
+        if (!g_input_stream_read_all (in, header, 2, &n, NULL, NULL) || n != 2) return NULL;
+
+        opcode = header[0] & 0x0f;
+        len = header[1] & 0x7f;
+        if (len == 126) {
+            if (!g_input_stream_read_all (in, header, 2, &n, NULL, NULL) || n != 2) return NULL;
+            len = (header[0] << 8) | header[1];
+        }
+        else if (len == 127) {
+            if (!g_input_stream_read_all (in, header, 8, &n, NULL, NULL) || n != 8) return NULL;
+            for (len = 0, i = 0; i < 8; i++) len = (len << 8) | header[i];
+        }
+
+        payload = g_malloc (len + 1);
+        if (!g_input_stream_read_all (in, payload, len, &n, NULL, NULL) || n != len) {
+            g_free (payload);
+            return NULL;
+        }
+        payload[len] = '\0';
+
+        /* server frames are never masked, skip anything but text */
+        if (opcode == 0x1) break;
+        g_free (payload);
+    }
+
+    parser = json_parser_new ();
+    if (json_parser_load_from_data (parser, payload, len, NULL) &&
+        JSON_NODE_HOLDS_OBJECT (json_parser_get_root (parser)))
+        root = json_node_copy (json_parser_get_root (parser));
+    g_object_unref (parser);
+    g_free (payload);
+
+    return root;
+}
+
+static gboolean
+_matches (JsonNode *node, gint64 id, const gchar *event)
+{
+    JsonObject *object = json_node_get_object (node);
+
+    if (event)
+        return json_object_has_member (object, "event") &&
+               !g_strcmp0 (json_object_get_string_member (object, "event"), event);
+
+    return json_object_has_member (object, "id") && json_object_get_int_member (object, "id") == id;
+}
+
+/*
+ * Returns the reply to request id, or the event if given, keeping the
+ * other frames for later. Free it with json_node_free.
+ */
+static JsonNode *
+_web_client_wait (WebClient *client, gint64 id, const gchar *event)
+{
+    JsonNode *node = NULL;
+    GList *l;
+
+    for (l = client->received.head; l; l = l->next) {
+        if (_matches (l->data, id, event)) {
+            node = l->data;
+            g_queue_delete_link (&client->received, l);
+            return node;
+        }
+    }
+
+    while ((node = _web_client_receive (client)) != NULL) {
+        if (_matches (node, id, event)) return node;
+        g_queue_push_tail (&client->received, node);
+    }
+
+    return NULL;
+}
+
+/* service_id of the result of request id, 0 on error */
+static gint64
+_web_client_call (WebClient *client, gint64 id, const gchar *method, const gchar *params)
+{
+    gchar *request = g_strdup_printf ("{\"id\": %" G_GINT64_FORMAT ", \"method\": \"%s\", \"params\": %s}",
+            id, method, params);
+    JsonNode *reply = NULL;
+    JsonObject *result = NULL;
+    gint64 service_id = 0;
+    gboolean sent;
+
+    sent = _web_client_send (client, request);
+    g_free (request);
+    if (!sent || !(reply = _web_client_wait (client, id, NULL))) return 0;
+
+    if (json_object_has_member (json_node_get_object (reply), "result")) {
+        result = json_object_get_object_member (json_node_get_object (reply), "result");
+        service_id = json_object_has_member (result, "service_id")
+                     ? json_object_get_int_member (result, "service_id") : 1;
+    }
+    json_node_free (reply);
+
+    return service_id;
+}
+
+/*
+ * Tests
+ */
+static gboolean
+test_refuse_unknown_origin()
+{
+    WebClient *client = _web_client_connect (TEST_REFUSED_ORIGIN);
+
+    test_assert (client == NULL, "Web client from '%s' was accepted", TEST_REFUSED_ORIGIN);
+
+    return TRUE;
+}
+
+static gboolean
+test_register_send_and_receive()
+{
+    WebClient *client = _web_client_connect (TEST_ALLOWED_ORIGIN);
+    JsonNode *event = NULL;
+    JsonObject *object = NULL, *data = NULL;
+    gint64 local_id, remote_id;
+    gchar *params = NULL;
+    gboolean ok;
+
+    test_assert (client != NULL, "Web client from '%s' was refused", TEST_ALLOWED_ORIGIN);
+
+    local_id = _web_client_call (client, 1, "registerService",
+            "{\"port\": \"" TEST_WEB_PORT "\", \"trusted\": false}");
+    if (local_id <= 0) _web_client_free (client);
+    test_assert (local_id > 0, "Fail to register web port");
+
+    remote_id = _web_client_call (client, 2, "checkForRemoteService",
+            "{\"app_id\": \"web:" TEST_ALLOWED_ORIGIN "\", \"port\": \"" TEST_WEB_PORT "\", \"trusted\": false}");
+    if (remote_id <= 0) _web_client_free (client);
+    test_assert (remote_id > 0, "Fail to find web port");
+
+    params = g_strdup_printf ("{\"service_id\": %" G_GINT64_FORMAT ", \"data\": {\"Name\": \"Amarnath\"}}", remote_id);
+    ok = _web_client_call (client, 3, "sendMessage", params) > 0;
+    g_free (params);
+    if (!ok) _web_client_free (client);
+    test_assert (ok, "Fail to send message to web port");
+
+    event = _web_client_wait (client, 0, "message");
+    _web_client_free (client);
+    test_assert (event != NULL, "Web port did not receive the message");
+
+    object = json_node_get_object (event);
+    data = json_object_has_member (object, "data") ? json_object_get_object_member (object, "data") : NULL;
+    ok = json_object_get_int_member (object, "service_id") == local_id &&
+         !g_strcmp0 (json_object_get_string_member (object, "remote_app_id"), "web:" TEST_ALLOWED_ORIGIN) &&
+         data && json_object_has_member (data, "Name") &&
+         !g_strcmp0 (json_object_get_string_member (data, "Name"), "Amarnath");
+    json_node_free (event);
+    test_assert (ok, "Web port received a corrupted message");
+
+    return TRUE;
+}
+
+/*
+ * Private daemon
+ */
+static guint
+_get_free_port ()
+{
+    GSocket *socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL);
+    GInetAddress *loopback = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+    GSocketAddress *address = g_inet_socket_address_new (loopback, 0);
+    GSocketAddress *bound = NULL;
+    guint port = 0;
+
+    if (socket && g_socket_bind (socket, address, TRUE, NULL) &&
+        (bound = g_socket_get_local_address (socket, NULL)) != NULL) {
+        port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (bound));
+        g_object_unref (bound);
+    }
+
+    g_object_unref (address);
+    g_object_unref (loopback);
+    if (socket) g_object_unref (socket);
+
+    return port;
+}
+
+static GPid
+_start_daemon (const gchar *socket_path)
+{
+    gchar *argv[] = { NULL, NULL };
+    GSocketClient *socket_client = NULL;
+    GSocketConnection *connection = NULL;
+    GError *error = NULL;
+    GPid pid = 0;
+    gint i;
+
+    argv[0] = g_file_test (TEST_DAEMON_PATH, G_FILE_TEST_IS_EXECUTABLE)
+              ? (gchar *)TEST_DAEMON_PATH : (gchar *)"messageportd";
+
+    if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                NULL, NULL, &pid, &error)) {
+        g_printerr ("Failed to start daemon '%s' : %s\n", argv[0], error->message);
+        g_error_free (error);
+        return 0;
+    }
+
+    /* wait for the web socket, at most 5 seconds */
+    socket_client = g_socket_client_new ();
+    for (i = 0; i < 500 && !connection; i++) {
+        if (g_file_test (socket_path, G_FILE_TEST_EXISTS))
+            connection = g_socket_client_connect_to_host (socket_client, "127.0.0.1", __port, NULL, NULL);
+        if (!connection) g_usleep (10000);
+    }
+    g_object_unref (socket_client);
+
+    if (!connection) {
+        g_printerr ("Daemon is not listening for web clients on port %u\n", __port);
+        kill (pid, SIGTERM);
+        waitpid (pid, NULL, 0);
+        return 0;
+    }
+    g_object_unref (connection);
+
+    return pid;
+}
+
+int main (int argc, char *argv[])
+{
+    gchar *tmp_dir = NULL, *socket_path = NULL, *address = NULL, *port = NULL;
+    GError *error = NULL;
+    GPid daemon_pid = 0;
+    int res = 0;
+
+#ifdef USE_SESSION_BUS
+    g_printerr ("Test needs the daemon on its private bus, rebuild without session bus support\n");
+    return -1;
+#endif
+
+    tmp_dir = g_dir_make_tmp ("msgport-websocket-XXXXXX", &error);
+    if (!tmp_dir) {
+        g_printerr ("Failed to create temporary directory : %s\n", error->message);
+        g_error_free (error);
+        return -1;
+    }
+    socket_path = g_build_filename (tmp_dir, "bus", NULL);
+    address = g_strdup_printf ("unix:path=%s", socket_path);
+
+    __port = _get_free_port ();
+    port = g_strdup_printf ("%u", __port);
+
+    g_setenv ("MESSAGEPORT_BUS_ADDRESS", address, TRUE);
+    g_setenv ("MESSAGEPORT_WEBSOCKET_PORT", port, TRUE);
+    g_setenv ("MESSAGEPORT_WEBSOCKET_ORIGINS", TEST_ALLOWED_ORIGIN, TRUE);
+
+    if (!__port || !(daemon_pid = _start_daemon (socket_path))) {
+        res = -1;
+        goto cleanup;
+    }
+
+    TEST_CASE(test_refuse_unknown_origin);
+    TEST_CASE(test_register_send_and_receive);
+
+cleanup:
+    if (daemon_pid) {
+        kill (daemon_pid, SIGTERM);
+        waitpid (daemon_pid, NULL, 0);
+        g_spawn_close_pid (daemon_pid);
+    }
+    g_unlink (socket_path);
+    g_rmdir (tmp_dir);
+    g_free (port);
+    g_free (address);
+    g_free (socket_path);
+    g_free (tmp_dir);
+
+    return res;
+}